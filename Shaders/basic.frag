@@ -1,44 +1,146 @@
 #version 330 core
+// Opcije (HAS_DIFFUSE_MAP, HAS_SPECULAR_MAP, EMISSIVE, ALPHA_BLEND, VEGETATION) ubacuje ShaderVariants posle #version linije
 out vec4 FragColor;
 
 in vec3 chNormal;  
 in vec3 chFragPos;  
 in vec2 chUV;
   
-uniform vec3 uLightPos; 
 uniform vec3 uViewPos; 
-uniform vec3 uLightColor;
-uniform float uLightIntensity;
+uniform mat4 uV;
 
+// Svetla su podeljena po klasterima (LightClusters): ekran u plocice, dubina u eksponencijalne slojeve
+uniform vec3 uClusterGrid;          // broj klastera po x, y i z
+uniform vec2 uClusterDepth;         // sloj = log(dubina) * x + y
+uniform vec2 uViewportSize;
+uniform usamplerBuffer uClusterTable; // po klasteru: pocetak u uLightIndices i broj svetala
+uniform usamplerBuffer uLightIndices;
+uniform samplerBuffer uLightData;     // po svetlu: pozicija + domet, boja * intenzitet
+
+// Senke jednog svetla (CubeShadowMap)
+uniform samplerCubeShadow uShadowMap;
+uniform int uShadowLight;           // indeks svetla koje baca senke, -1 bez senki
+uniform int uShadowTaps;            // 1 = tvrde ivice, 8 ili 20 = PCF
+uniform vec2 uShadowPlanes;         // near i far projekcija strana kocke
+
+// Uglovi kocke pa sredine ivica, prvih 8 za srednji kvalitet
+const vec3 shadowOffsets[20] = vec3[](
+    vec3(1, 1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1, 1,  1),
+    vec3(1, 1, -1), vec3( 1, -1, -1), vec3(-1, -1, -1), vec3(-1, 1, -1),
+    vec3(1, 1,  0), vec3( 1, -1,  0), vec3(-1, -1,  0), vec3(-1, 1,  0),
+    vec3(1, 0,  1), vec3(-1,  0,  1), vec3( 1,  0, -1), vec3(-1, 0, -1),
+    vec3(0, 1,  1), vec3( 0, -1,  1), vec3( 0, -1, -1), vec3( 0, 1, -1)
+);
+
+// Deo svetlosti koji stize do fragmenta, 0 = potpuno u senci
+float shadowFactor(vec3 lightPos)
+{
+    vec3 v = chFragPos - lightPos;
+    float major = max(abs(v.x), max(abs(v.y), abs(v.z)));
+    // pomeraj ka svetlu protiv "shadow acne", raste sa udaljenoscu
+    major = major * 0.985 - 0.02;
+    float n = uShadowPlanes.x, f = uShadowPlanes.y;
+    float depth = ((f + n) / (f - n) - (2.0 * f * n) / ((f - n) * major)) * 0.5 + 0.5;
+    if (uShadowTaps <= 1)
+        return texture(uShadowMap, vec4(v, depth));
+    float radius = 0.015 * major;
+    float lit = 0.0;
+    for (int i = 0; i < uShadowTaps; i++)
+        lit += texture(uShadowMap, vec4(v + shadowOffsets[i] * radius, depth));
+    return lit / float(uShadowTaps);
+}
+
+#ifdef HAS_DIFFUSE_MAP
 uniform sampler2D uDiffMap1;
+#else
+uniform vec4 uAlbedo; // boja materijala bez teksture
+#endif
+#ifdef HAS_SPECULAR_MAP
+uniform sampler2D uSpecMap1;
+#endif
+#ifdef VEGETATION
+flat in vec4 chTintFade;
+
+// Prag iz 4x4 Bayer matrice: primerak koji nestaje se proredjuje po sablonu, bez providnosti i sortiranja
+float ditherThreshold(vec2 fragCoord)
+{
+    const float bayer[16] = float[](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 p = ivec2(fragCoord) & 3;
+    return (bayer[p.y * 4 + p.x] + 0.5) / 16.0;
+}
+#endif
 
 void main()
 {    
+#ifdef HAS_DIFFUSE_MAP
+    vec4 albedo = texture(uDiffMap1, chUV);
+#else
+    vec4 albedo = uAlbedo;
+#endif
+#ifdef VEGETATION
+    if (chTintFade.a < ditherThreshold(gl_FragCoord.xy))
+        discard;
+    albedo.rgb *= chTintFade.rgb;
+#endif
+
+#ifdef EMISSIVE
+    // Izvor svetlosti samo sija, ne osvetljava se
+    FragColor = vec4(albedo.rgb, 1.0);
+#else
     // Proporcije ambijentalnog, difuznog i spekularnog osvetljenja
     float ambientStrength = 0.2;
+#ifdef HAS_SPECULAR_MAP
+    float specularStrength = texture(uSpecMap1, chUV).r;
+#else
     float specularStrength = 0.5;
+#endif
 
-    // Ambijentalna komponenta
-    vec3 ambient = ambientStrength * uLightColor * uLightIntensity;
-  	
-    // Difuzna komponenta 
     vec3 norm = normalize(chNormal);
-    vec3 lightDir = normalize(uLightPos - chFragPos);
-    float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = diff * uLightColor * uLightIntensity;
-    
-    // Spekularna komponenta (Phong)
     vec3 viewDir = normalize(uViewPos - chFragPos);
-    vec3 reflectDir = reflect(-lightDir, norm);  
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32.0);
-    vec3 specular = specularStrength * spec * uLightColor * uLightIntensity;  
 
-    // Slabljenje svetlosti (Attenuation) - da bi izgledalo "prikladnije"
-    float distance = length(uLightPos - chFragPos);
-    float attenuation = 1.0 / (1.0 + 0.045 * distance + 0.0075 * (distance * distance));
+    // Klaster ovog fragmenta
+    ivec3 grid = ivec3(uClusterGrid);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / uViewportSize * vec2(grid.xy)), ivec2(0), grid.xy - 1);
+    float depth = max(-(uV * vec4(chFragPos, 1.0)).z, 1e-4);
+    int slice = clamp(int(log(depth) * uClusterDepth.x + uClusterDepth.y), 0, grid.z - 1);
+    uvec2 cluster = texelFetch(uClusterTable, (slice * grid.y + tile.y) * grid.x + tile.x).rg;
 
-    vec3 result = (ambient + diffuse + specular) * attenuation;
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < cluster.y; i++)
+    {
+        int light = int(texelFetch(uLightIndices, int(cluster.x + i)).r);
+        vec4 positionRange = texelFetch(uLightData, light * 2);
+        vec3 lightColor = texelFetch(uLightData, light * 2 + 1).rgb;
 
-    FragColor = texture(uDiffMap1, chUV) * vec4(result, 1.0);
-}
+        vec3 toLight = positionRange.xyz - chFragPos;
+        float distance = length(toLight);
+        if (distance >= positionRange.w) continue;
+        vec3 lightDir = toLight / distance;
+
+        // Ambijentalna komponenta
+        vec3 ambient = ambientStrength * lightColor;
+
+        // Difuzna komponenta 
+        float diff = max(dot(norm, lightDir), 0.0);
+        vec3 diffuse = diff * lightColor;
+
+        // Spekularna komponenta (Phong)
+        vec3 reflectDir = reflect(-lightDir, norm);  
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32.0);
+        vec3 specular = specularStrength * spec * lightColor;  
 
+        // Slabljenje svetlosti (Attenuation), na dometu svetla pada glatko na nulu
+        float attenuation = 1.0 / (1.0 + 0.045 * distance + 0.0075 * (distance * distance));
+        float falloff = clamp(1.0 - pow(distance / positionRange.w, 4.0), 0.0, 1.0);
+
+        float shadow = light == uShadowLight ? shadowFactor(positionRange.xyz) : 1.0;
+        result += (ambient + (diffuse + specular) * shadow) * attenuation * falloff * falloff;
+    }
+
+#ifdef ALPHA_BLEND
+    FragColor = vec4(albedo.rgb * result, albedo.a);
+#else
+    FragColor = vec4(albedo.rgb * result, 1.0);
+#endif
+#endif
+}
@@ -1,7 +1,19 @@
 #version 330 core
+// INSTANCING i ostale opcije ubacuje ShaderVariants odmah posle #version linije
 layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inUV;
+#ifdef INSTANCING
+layout (location = 3) in mat4 inModel; // zauzima lokacije 3-6
+#endif
+#ifdef VEGETATION
+layout (location = 7) in vec4 inTintFade; // boja i vidljivost primerka
+layout (location = 8) in float inPhase;   // faza vetra
+uniform float uTime;
+uniform vec3 uWind;                       // smer i jacina vetra u prostoru sveta
+uniform float uWindHeightScale;           // 1 / visina modela
+flat out vec4 chTintFade;
+#endif
 
 out vec3 chFragPos;
 out vec3 chNormal;
@@ -13,10 +25,25 @@ uniform mat4 uP;
 
 void main()
 {
+#ifdef INSTANCING
+    mat4 model = inModel;
+#else
+    mat4 model = uM;
+#endif
     chUV = inUV;
-    chFragPos = vec3(uM * vec4(inPos, 1.0));
-    chNormal = mat3(transpose(inverse(uM))) * inNormal;  
+    chFragPos = vec3(model * vec4(inPos, 1.0));
+#ifdef VEGETATION
+    // Njihanje raste sa kvadratom visine, koren stoji; dve frekvencije da ne izgleda kao klatno
+    float height = clamp(inPos.y * uWindHeightScale, 0.0, 1.0);
+    float sway = sin(uTime * 1.3 + inPhase) * 0.7 + sin(uTime * 2.9 + inPhase * 1.7) * 0.3;
+    chFragPos += uWind * (sway * height * height);
+    chTintFade = inTintFade;
+#endif
+#ifndef EMISSIVE
+    chNormal = mat3(transpose(inverse(model))) * inNormal;
+#else
+    chNormal = inNormal;
+#endif
     
     gl_Position = uP * uV * vec4(chFragPos, 1.0);
 }
-
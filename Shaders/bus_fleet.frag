@@ -0,0 +1,13 @@
+#version 330 core
+
+in vec2 chTex;
+out vec4 outCol;
+
+uniform sampler2D busTex;
+
+void main()
+{
+    // the other buses are dimmed so the driven one stands out
+    vec4 col = texture(busTex, chTex);
+    outCol = vec4(col.rgb * 0.55, col.a);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+
+layout(location = 0) in vec2 inPos;
+layout(location = 1) in vec2 inTex;
+layout(location = 2) in vec2 inOffset; // per bus
+out vec2 chTex;
+
+void main()
+{
+    gl_Position = vec4(inPos + inOffset, 0.0, 1.0);
+    chTex = inTex;
+}
@@ -0,0 +1,5 @@
+#version 330 core
+// Upisuje se samo dubina
+void main()
+{
+}
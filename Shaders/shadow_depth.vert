@@ -0,0 +1,10 @@
+#version 330 core
+layout (location = 0) in vec3 inPos;
+
+uniform mat4 uM;
+uniform mat4 uLightViewProjection; // jedna strana kocke senki
+
+void main()
+{
+    gl_Position = uLightViewProjection * uM * vec4(inPos, 1.0);
+}
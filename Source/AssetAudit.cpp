@@ -0,0 +1,315 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "model_import.hpp"
+
+// Audit of the assets under Resources and Projekat2D/Resources. Needs no window or GL context, so it also runs
+// on machines without a GPU. Models are read with importModel exactly as the simulator reads them, images
+// no model uses are decoded on their own. Reports every file, the most expensive first: import time, meshes,
+// vertices, indices, materials, texture sizes, estimated GPU memory (counted like the memory tracker counts
+// uploads), material textures left undecoded because no shader samples their type, and textures whose pixels
+// are identical.
+// Usage: Projekat3DAssetAudit [--budget MB] [--textures LIST] [--savings] [dir ...]
+//   dirs default to ../Resources ../Projekat2D/Resources; the texture types loaded are those ../Shaders/basic.frag
+//   samples, or LIST (as the simulator's --textures); --savings also imports every model with all texture types to
+//   time what skipping the others saves.
+// Exits with 1 when a file fails to load or the estimate is over the budget.
+
+namespace fs = std::filesystem;
+using AuditClock = std::chrono::steady_clock;
+
+struct TextureAudit {
+    std::string path;
+    int width = 0, height = 0, components = 0;
+    size_t decodedBytes = 0, gpuBytes = 0;
+    uint64_t hash = 0;
+};
+
+struct FileAudit {
+    std::string path;
+    bool model = false;
+    bool loaded = false;
+    bool unreferenced = false;   // an image next to a model that none of the models uses
+    double importMs = 0.0;
+    double allTypesMs = 0.0;   // import time with every texture type, measured with --savings
+    size_t meshes = 0, vertices = 0, indices = 0, materials = 0;
+    size_t missingTextures = 0;
+    size_t gpuBytes = 0;
+    std::vector<TextureAudit> textures;
+    std::vector<SkippedTexture> skippedTextures;
+    size_t skippedDecodedBytes = 0, skippedGpuBytes = 0;
+};
+
+double toMb(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+std::string displayName(const std::string& path)
+{
+    size_t start = 0;
+    while (path.compare(start, 3, "../") == 0)
+        start += 3;
+    return path.substr(start);
+}
+
+// FNV-1a over the size and the pixels, so only images that would upload the same texture match
+uint64_t pixelHash(const ImageData& image)
+{
+    uint64_t hash = 1469598103934665603ull;
+    auto mix = [&](const unsigned char* bytes, size_t count) {
+        for (size_t i = 0; i < count; i++)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+    };
+    int size[3] = { image.width, image.height, image.components };
+    mix(reinterpret_cast<const unsigned char*>(size), sizeof(size));
+    mix(image.pixels.get(), image.byteCount());
+    return hash;
+}
+
+TextureAudit auditTexture(const std::string& path, const ImageData& image)
+{
+    TextureAudit t;
+    t.path = path;
+    t.width = image.width;
+    t.height = image.height;
+    t.components = image.components;
+    t.decodedBytes = image.byteCount();
+    t.gpuBytes = imageGpuBytes(image.components, image.width, image.height);
+    t.hash = pixelHash(image);
+    return t;
+}
+
+bool isImage(const std::string& extension)
+{
+    return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".bmp" || extension == ".tga";
+}
+
+int main(int argc, char** argv)
+{
+    double budgetMb = 0.0;
+    std::string textureTypes;
+    bool savings = false;
+    std::vector<std::string> roots;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "--budget" && i + 1 < argc) budgetMb = std::max(0.0, atof(argv[++i]));
+        else if (std::string(argv[i]) == "--textures" && i + 1 < argc) textureTypes = argv[++i];
+        else if (std::string(argv[i]) == "--savings") savings = true;
+        else roots.push_back(argv[i]);
+    }
+    MaterialRequirements requirements;
+    if (textureTypes.empty())
+        requirements = MaterialRequirements::fromShader("../Shaders/basic.frag");
+    else if (!MaterialRequirements::fromList(textureTypes, requirements))
+        return 1;
+    if (roots.empty())
+        roots = { "../Resources", "../Projekat2D/Resources" };
+
+    int failures = 0;
+    std::vector<std::string> modelPaths, imagePaths;
+    Assimp::Importer importer;   // only asked which extensions it reads
+    for (const std::string& root : roots)
+    {
+        if (!fs::is_directory(root))
+        {
+            printf("ERROR::AUDIT:: %s is not a directory\n", root.c_str());
+            failures++;
+            continue;
+        }
+        for (const auto& entry : fs::recursive_directory_iterator(root))
+        {
+            if (!entry.is_regular_file())
+                continue;
+            std::string extension = entry.path().extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+            std::string path = entry.path().lexically_normal().generic_string();
+            if (isImage(extension))
+                imagePaths.push_back(path);
+            else if (!extension.empty() && importer.IsExtensionSupported(extension))
+                modelPaths.push_back(path);
+        }
+    }
+    std::sort(modelPaths.begin(), modelPaths.end());
+    std::sort(imagePaths.begin(), imagePaths.end());
+
+    std::vector<FileAudit> files;
+    std::set<std::string> referenced, modelDirectories;
+    for (const std::string& path : modelPaths)
+    {
+        FileAudit a;
+        a.path = path;
+        a.model = true;
+        auto start = AuditClock::now();
+        ModelData data = importModel(path, requirements);
+        a.importMs = std::chrono::duration<double, std::milli>(AuditClock::now() - start).count();
+        if (savings)
+        {
+            start = AuditClock::now();
+            importModel(path, MaterialRequirements::all());
+            a.allTypesMs = std::chrono::duration<double, std::milli>(AuditClock::now() - start).count();
+        }
+        a.loaded = data.loaded;
+        a.meshes = data.meshes.size();
+        for (const MeshData& mesh : data.meshes)
+        {
+            a.vertices += mesh.vertices.size();
+            a.indices += mesh.indices.size();
+        }
+        a.materials = data.materialCount;
+        a.skippedTextures = data.skippedTextures;
+        a.skippedDecodedBytes = data.skippedDecodedBytes();
+        a.skippedGpuBytes = data.skippedGpuBytes();
+        a.gpuBytes = a.vertices * sizeof(Vertex) + a.indices * sizeof(unsigned int);
+        modelDirectories.insert(fs::path(path).parent_path().generic_string());
+        for (const SkippedTexture& t : data.skippedTextures)
+            referenced.insert((fs::path(data.directory) / t.path).lexically_normal().generic_string());
+        for (const ImageData& image : data.images)
+        {
+            std::string file = (fs::path(data.directory) / image.path).lexically_normal().generic_string();
+            referenced.insert(file);
+            if (!image.pixels)
+                a.missingTextures++;
+            a.textures.push_back(auditTexture(file, image));
+            a.gpuBytes += a.textures.back().gpuBytes;
+        }
+        failures += !a.loaded || a.missingTextures > 0;
+        files.push_back(std::move(a));
+    }
+
+    for (const std::string& path : imagePaths)
+    {
+        if (referenced.count(path))
+            continue;
+        FileAudit a;
+        a.path = path;
+        fs::path file(path);
+        auto start = AuditClock::now();
+        ImageData image = loadImage(file.filename().string().c_str(), file.parent_path().generic_string());
+        a.importMs = std::chrono::duration<double, std::milli>(AuditClock::now() - start).count();
+        a.loaded = image.pixels != nullptr;
+        a.unreferenced = modelDirectories.count(file.parent_path().generic_string()) > 0;
+        a.textures.push_back(auditTexture(path, image));
+        a.gpuBytes = a.textures.back().gpuBytes;
+        failures += !a.loaded;
+        files.push_back(std::move(a));
+    }
+
+    std::sort(files.begin(), files.end(), [](const FileAudit& a, const FileAudit& b) {
+        return a.gpuBytes != b.gpuBytes ? a.gpuBytes > b.gpuBytes : a.importMs > b.importMs;
+    });
+
+    size_t totalGpu = 0;
+    double totalMs = 0.0;
+    for (const FileAudit& a : files)
+    {
+        totalGpu += a.gpuBytes;
+        totalMs += a.importMs;
+    }
+    printf("Assets: %zu models, %zu images, %.1f MB estimated GPU memory, %.1f ms to load, material textures: %s\n\n",
+           modelPaths.size(), files.size() - modelPaths.size(), toMb(totalGpu), totalMs, requirements.describe().c_str());
+    printf("%9s %10s %7s %10s %10s %5s %5s  %s\n", "GPU MB", "load ms", "meshes", "vertices", "indices", "mats", "texs", "file");
+    for (const FileAudit& a : files)
+    {
+        if (a.model)
+            printf("%9.2f %10.1f %7zu %10zu %10zu %5zu %5zu  %s%s\n", toMb(a.gpuBytes), a.importMs, a.meshes, a.vertices, a.indices,
+                   a.materials, a.textures.size(), displayName(a.path).c_str(), a.loaded ? "" : "  FAILED");
+        else
+            printf("%9.2f %10.1f %7s %10s %10s %5s %5s  %s%s\n", toMb(a.gpuBytes), a.importMs, "-", "-", "-", "-", "-",
+                   displayName(a.path).c_str(), !a.loaded ? "  FAILED" : a.unreferenced ? "  (no model uses it)" : "");
+    }
+
+    printf("\nTextures, decoded and as uploaded with mipmaps:\n");
+    for (const FileAudit& a : files)
+    {
+        bool header = false;
+        for (const TextureAudit& t : a.textures)
+        {
+            if (!a.model && t.decodedBytes == 0)
+                continue;
+            if (!header)
+                printf("  %s\n", displayName(a.path).c_str());
+            header = true;
+            if (t.decodedBytes == 0)
+                printf("    %-40s missing\n", displayName(t.path).c_str());
+            else
+                printf("    %-40s %5dx%-5d x%d %8.2f MB decoded %8.2f MB GPU\n", displayName(t.path).c_str(), t.width, t.height,
+                       t.components, toMb(t.decodedBytes), toMb(t.gpuBytes));
+        }
+        if (!header && !a.skippedTextures.empty())
+            printf("  %s\n", displayName(a.path).c_str());
+        for (const SkippedTexture& t : a.skippedTextures)
+            printf("    %-40s %5dx%-5d x%d skipped, no shader samples %s textures\n", t.path.c_str(), t.width, t.height, t.components,
+                   t.type.c_str());
+    }
+
+    // what leaving the unsampled types on disk saves, per model
+    size_t savedDecoded = 0, savedGpu = 0;
+    double savedMs = 0.0;
+    bool anySkipped = false;
+    for (const FileAudit& a : files)
+    {
+        if (a.skippedTextures.empty())
+            continue;
+        if (!anySkipped)
+            printf("\nSkipped textures:\n");
+        anySkipped = true;
+        printf("  %-40s %3zu textures %8.2f MB decoded %8.2f MB GPU", displayName(a.path).c_str(), a.skippedTextures.size(),
+               toMb(a.skippedDecodedBytes), toMb(a.skippedGpuBytes));
+        if (savings)
+            printf(" %8.1f ms", a.allTypesMs - a.importMs);
+        printf("\n");
+        savedDecoded += a.skippedDecodedBytes;
+        savedGpu += a.skippedGpuBytes;
+        savedMs += a.allTypesMs - a.importMs;
+    }
+    if (anySkipped)
+    {
+        printf("  %.2f MB decoded and %.2f MB GPU saved", toMb(savedDecoded), toMb(savedGpu));
+        if (savings)
+            printf(", %.1f ms of loading", savedMs);
+        printf("\n");
+    }
+
+    // the same pixels uploaded more than once, by different files or by several models using one file
+    std::map<uint64_t, std::vector<std::pair<const FileAudit*, const TextureAudit*>>> byHash;
+    for (const FileAudit& a : files)
+        for (const TextureAudit& t : a.textures)
+            if (t.decodedBytes > 0)
+                byHash[t.hash].push_back({ &a, &t });
+    size_t duplicateBytes = 0;
+    bool anyDuplicate = false;
+    for (const auto& [hash, uses] : byHash)
+    {
+        if (uses.size() < 2)
+            continue;
+        if (!anyDuplicate)
+            printf("\nDuplicate textures (identical pixels):\n");
+        anyDuplicate = true;
+        duplicateBytes += (uses.size() - 1) * uses.front().second->gpuBytes;
+        printf("  %zu copies, %.2f MB GPU each:\n", uses.size(), toMb(uses.front().second->gpuBytes));
+        for (const auto& [file, texture] : uses)
+            printf("    %s%s%s\n", displayName(texture->path).c_str(), file->model ? " in " : "", file->model ? displayName(file->path).c_str() : "");
+    }
+    if (anyDuplicate)
+        printf("  %.2f MB GPU spent on copies\n", toMb(duplicateBytes));
+    else
+        printf("\nNo duplicate textures\n");
+
+    if (budgetMb > 0.0)
+    {
+        bool over = toMb(totalGpu) > budgetMb;
+        printf("\nGPU memory %.1f MB of the %.1f MB budget%s\n", toMb(totalGpu), budgetMb, over ? "  OVER BUDGET" : "");
+        failures += over;
+    }
+    if (failures > 0)
+        printf("\n%d problem(s) found\n", failures);
+    return failures > 0 ? 1 : 0;
+}
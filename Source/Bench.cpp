@@ -0,0 +1,407 @@
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "frustum.hpp"
+#include "job_system.hpp"
+#include "light_clusters.hpp"
+#include "passenger_system.hpp"
+#include "fleet.hpp"
+#include "scenery_stream.hpp"
+#include "traffic.hpp"
+#include "vegetation.hpp"
+
+// Headless benchmarks for the simulation systems. No window or GL context is created.
+// Usage: Projekat3DBench [scenario] [size]   (no arguments runs every scenario with its default size)
+
+using BenchClock = std::chrono::steady_clock;
+
+struct FrameTimes {
+    std::vector<double> ms;
+
+    void add(BenchClock::time_point start, BenchClock::time_point end)
+    {
+        ms.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+
+    double mean() const
+    {
+        double sum = 0.0;
+        for (double v : ms) sum += v;
+        return ms.empty() ? 0.0 : sum / ms.size();
+    }
+
+    double max() const
+    {
+        double m = 0.0;
+        for (double v : ms) if (v > m) m = v;
+        return m;
+    }
+};
+
+void printResult(const std::string& name, long long size, const FrameTimes& times)
+{
+    std::cout << name << ": size " << size << ", mean " << times.mean() << " ms/frame, max " << times.max()
+              << " ms over " << times.ms.size() << " frames" << std::endl;
+}
+
+// Starts with `count` seated passengers and turns them over: every frame up to 1% of them get off and each one
+// that does is replaced by a passenger queueing outside, so boarding, alighting and seated passengers are all
+// present at once. The reported size is the mean number of passengers updated per frame, alighting ones included
+// until they have walked out.
+void benchPassengers(long long count)
+{
+    PassengerLayout layout;
+    layout.outside = glm::vec3(3.5f, -1.0f, -4.0f);
+    layout.door = glm::vec3(2.0f, -1.0f, -4.0f);
+    layout.standing = glm::vec3(0.0f, -1.0f, 4.0f);
+    for (int i = 0; i < 50; i++)
+        layout.seats.push_back(glm::vec3(-1.6f + (i % 5) * 0.7f, -1.0f, -1.5f + (i / 5) * 0.6f));
+    layout.walkDuration = 2.0f;
+    layout.doorInterval = 0.0f; // unlimited door throughput, every queued passenger starts walking at once
+
+    PassengerSystem passengers(layout);
+    passengers.reserve(count);
+    for (long long i = 0; i < count; i++)
+        passengers.spawnSeated(static_cast<int>(i % 15));
+
+    const float dt = 1.0f / 75.0f;
+    const int frames = 300;
+    const int turnover = static_cast<int>(count / 100) + 1;
+    srand(1);
+
+    FrameTimes times;
+    long long population = 0;
+    for (int frame = 0; frame < frames; frame++)
+    {
+        for (int i = 0; i < turnover && passengers.seatedCount() > 0; i++)
+        {
+            if (passengers.requestAlight(passengers.seatedPassenger(rand() % passengers.seatedCount())))
+                passengers.spawnBoarding(rand() % 15);
+        }
+
+        population += passengers.count();
+        auto start = BenchClock::now();
+        passengers.update(dt);
+        times.add(start, BenchClock::now());
+    }
+    printResult("passengers", population / frames, times);
+}
+
+// the ten stations of the control panel map
+Route benchRoute()
+{
+    return Route({ { -0.4f, 0.6f }, { 0.15f, 0.55f }, { 0.5f, 0.65f }, { 0.55f, 0.3f }, { 0.65f, -0.35f },
+                   { 0.1f, -0.5f }, { -0.15f, -0.65f }, { -0.4f, -0.1f }, { -0.75f, 0.15f }, { -0.45f, 0.25f } });
+}
+
+// Fleet update scaling, serial and on the job system. Without a size it runs 1, 100 and 10,000 buses.
+void benchFleet(long long size)
+{
+    std::vector<long long> sizes = size > 0 ? std::vector<long long>{ size } : std::vector<long long>{ 1, 100, 10000 };
+    JobSystem jobs;
+    for (long long count : sizes)
+    {
+        for (JobSystem* pool : { (JobSystem*)nullptr, &jobs })
+        {
+            Fleet fleet;
+            fleet.reset(benchRoute(), FleetConfig(), static_cast<int>(count));
+            const float dt = 1.0f / 75.0f;
+            FrameTimes times;
+            for (int frame = 0; frame < 750; frame++)
+            {
+                auto start = BenchClock::now();
+                fleet.update(dt, pool);
+                times.add(start, BenchClock::now());
+            }
+            printResult(pool ? "fleet (" + std::to_string(jobs.workerCount()) + " workers)" : "fleet (serial)", count, times);
+        }
+    }
+}
+
+// Job system scaling on a heavy scene: `size` passengers turning over, 10,000 buses, and every passenger's
+// transform built and frustum culled, with 1, 2, 4 ... workers up to the number of cores.
+void benchJobs(long long count)
+{
+    PassengerLayout layout;
+    layout.outside = glm::vec3(3.5f, -1.0f, -4.0f);
+    layout.door = glm::vec3(2.0f, -1.0f, -4.0f);
+    layout.standing = glm::vec3(0.0f, -1.0f, 4.0f);
+    for (int i = 0; i < 50; i++)
+        layout.seats.push_back(glm::vec3(-1.6f + (i % 5) * 0.7f, -1.0f, -1.5f + (i / 5) * 0.6f));
+    layout.walkDuration = 2.0f;
+    layout.doorInterval = 0.0f;
+
+    glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f) *
+                               glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum = Frustum::fromMatrix(viewProjection);
+    BoundingSphere personBounds = { glm::vec3(0.0f, 0.9f, 0.0f), 1.0f };
+
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> workerCounts;
+    for (unsigned w = 1; w < cores; w *= 2)
+        workerCounts.push_back(w);
+    workerCounts.push_back(cores);
+
+    double singleWorker = 0.0;
+    for (unsigned workers : workerCounts)
+    {
+        JobSystem jobs(workers);
+        PassengerSystem passengers(layout);
+        passengers.reserve(count);
+        for (long long i = 0; i < count; i++)
+            passengers.spawnSeated(static_cast<int>(i % 15));
+        Fleet fleet;
+        fleet.reset(benchRoute(), FleetConfig(), 10000);
+        std::vector<glm::mat4> transforms;
+        std::vector<uint8_t> drawn;
+
+        const float dt = 1.0f / 75.0f;
+        const int turnover = static_cast<int>(count / 100) + 1;
+        srand(1);
+        FrameTimes times;
+        jobs.takeStats();
+        for (int frame = 0; frame < 200; frame++)
+        {
+            for (int i = 0; i < turnover && passengers.seatedCount() > 0; i++)
+            {
+                passengers.requestAlight(passengers.handleAt(rand() % passengers.count()));
+                passengers.spawnBoarding(rand() % 15);
+            }
+
+            auto start = BenchClock::now();
+            fleet.update(dt, &jobs);
+            passengers.update(dt, &jobs);
+            transforms.resize(passengers.count());
+            drawn.resize(passengers.count());
+            jobs.parallelFor(passengers.count(), 256, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++)
+                {
+                    glm::mat4 model = glm::translate(glm::mat4(1.0f), passengers.position[i]);
+                    model = glm::rotate(model, glm::radians(passengers.heading[i]), glm::vec3(0.0f, 1.0f, 0.0f));
+                    transforms[i] = model;
+                    drawn[i] = passengers.isVisible(i) && frustum.intersects(transformSphere(personBounds, model));
+                }
+            });
+            times.add(start, BenchClock::now());
+        }
+
+        if (workers == 1)
+            singleWorker = times.mean();
+        printResult("jobs, " + std::to_string(workers) + " worker(s)", count, times);
+        std::cout << "  speedup " << (times.mean() > 0.0 ? singleWorker / times.mean() : 0.0) << "x" << std::endl;
+        printWorkerStats(jobs);
+    }
+}
+
+// Clustered light binning with 1, 2, 4 ... 256 moving lights spread along a street (or just `size` lights).
+// Next to the CPU time it prints how many lights a fragment loops over, against every light without clusters.
+void benchLights(long long size)
+{
+    std::vector<long long> sizes;
+    if (size > 0)
+        sizes.push_back(size);
+    else
+        for (long long n = 1; n <= 256; n *= 2)
+            sizes.push_back(n);
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+    for (long long count : sizes)
+    {
+        srand(1);
+        std::vector<PointLight> lights;
+        std::vector<float> phases;
+        for (long long i = 0; i < count; i++)
+        {
+            glm::vec3 position(rand() % 1200 / 10.0f - 60.0f, rand() % 60 / 10.0f, -(rand() % 850 / 10.0f) + 5.0f);
+            lights.push_back({ position, 3.0f + rand() % 90 / 10.0f, glm::vec3(1.0f, 0.9f, 0.7f), 1.0f });
+            phases.push_back(rand() % 628 / 100.0f);
+        }
+        std::vector<glm::vec3> origins;
+        for (const auto& light : lights)
+            origins.push_back(light.position);
+
+        LightClusters clusters;
+        FrameTimes times;
+        double perCluster = 0.0;
+        unsigned most = 0;
+        const int frames = 750;
+        for (int frame = 0; frame < frames; frame++)
+        {
+            float t = frame / 75.0f;
+            for (size_t i = 0; i < lights.size(); i++)
+                lights[i].position = origins[i] + glm::vec3(std::sin(t + phases[i]) * 2.0f, 0.0f, std::cos(t + phases[i]) * 2.0f);
+            glm::mat4 view = glm::lookAt(glm::vec3(std::sin(t * 0.2f) * 10.0f, 1.5f, 5.0f), glm::vec3(0.0f, 1.0f, -20.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+            auto start = BenchClock::now();
+            clusters.build(lights, view, projection);
+            times.add(start, BenchClock::now());
+            perCluster += static_cast<double>(clusters.assignmentCount()) / LightClusters::CLUSTER_COUNT;
+            most = std::max(most, clusters.maxLightsPerCluster());
+        }
+        printResult("lights", count, times);
+        std::cout << "  lights per cluster: mean " << perCluster / frames << ", max " << most
+                  << " (unclustered: " << count << ")" << std::endl;
+    }
+}
+
+// Drives one bus `size` times around the route while streaming its scenery, timing the per-frame part (window
+// update and walking the resident chunks like the renderer does). Reported per lap, so the laps should match.
+void benchScenery(long long laps)
+{
+    Fleet fleet;
+    fleet.reset(benchRoute(), FleetConfig(), 1);
+    SceneryStreamer scenery(fleet.getRoute(), SceneryConfig());
+    scenery.start();
+    const float dt = 1.0f / 75.0f;
+    float lastDistance = 0.0f;
+    int lap = 0;
+    FrameTimes times;
+    size_t items = 0, missing = 0;
+    while (lap < laps)
+    {
+        fleet.update(dt);
+        float distance = fleet.getRoute().routeDistance(fleet.currentStation[0], fleet.distance[0]);
+        if (distance < lastDistance)
+        {
+            printResult("scenery lap " + std::to_string(lap + 1), scenery.chunks(), times);
+            SceneryStreamer::Stats stats = scenery.lastStats();
+            std::cout << "  resident " << stats.resident << " of " << stats.poolSize << " pooled, " << stats.built
+                      << " built (" << stats.buildMs << " ms each), " << stats.recycled << " recycled, "
+                      << items / times.ms.size() << " items per frame, " << missing << " frames without the chunk under the bus"
+                      << std::endl;
+            times = FrameTimes();
+            items = missing = 0;
+            lap++;
+        }
+        lastDistance = distance;
+
+        auto start = BenchClock::now();
+        scenery.update(distance);
+        glm::mat4 toBus = sceneryToBus(fleet.getRoute(), distance, SceneryConfig().worldScale);
+        glm::vec3 sum(0.0f);
+        for (const SceneryChunk* chunk : scenery.residentChunks())
+            for (const SceneryItem& item : chunk->items)
+                sum += glm::vec3((toBus * item.transform)[3]);
+        times.add(start, BenchClock::now());
+        for (const SceneryChunk* chunk : scenery.residentChunks())
+            items += chunk->items.size();
+        bool under = false;
+        for (const SceneryChunk* chunk : scenery.residentChunks())
+            under |= glm::length(glm::vec3(toBus * glm::vec4(chunk->bounds.center, 1.0f))) < chunk->bounds.radius;
+        missing += !under;
+        // the builder gets the time the rest of a real frame would take
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+// Per-frame CPU side of instanced vegetation: density thinning, frustum culling and packing of `size` trees
+// scattered over a 400 x 400 field while the camera drives across it. Without a size it runs 1 to 10,000.
+// The GPU side is one instanced submission per material batch of the tree whatever the count.
+void benchVegetation(long long size)
+{
+    std::vector<long long> sizes = size > 0 ? std::vector<long long>{ size } : std::vector<long long>{ 1, 10, 100, 1000, 10000 };
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+    BoundingSphere treeBounds = { glm::vec3(0.0f, 4.0f, 0.0f), 5.0f };
+    for (long long count : sizes)
+    {
+        srand(1);
+        std::vector<VegetationInstance> trees;
+        for (long long i = 0; i < count; i++)
+        {
+            glm::vec3 position(rand() % 4000 / 10.0f - 200.0f, -1.0f, rand() % 4000 / 10.0f - 200.0f);
+            trees.push_back({ glm::translate(glm::mat4(1.0f), position), glm::vec3(1.0f), rand() % 628 / 100.0f, rand() % 1000 / 1000.0f });
+        }
+
+        VegetationSelection selection;
+        FrameTimes times;
+        size_t drawn = 0;
+        const int frames = 750;
+        for (int frame = 0; frame < frames; frame++)
+        {
+            float t = frame / 75.0f;
+            glm::vec3 eye(-150.0f + t * 30.0f, 0.5f, std::sin(t * 0.3f) * 20.0f);
+            glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(std::cos(t * 0.2f), 0.0f, -std::sin(t * 0.2f)), glm::vec3(0.0f, 1.0f, 0.0f));
+            Frustum frustum = Frustum::fromMatrix(projection * view);
+
+            auto start = BenchClock::now();
+            selection.clear();
+            selection.add(trees, glm::mat4(1.0f), treeBounds, eye, [&frustum](const BoundingSphere& b) { return frustum.intersects(b); });
+            times.add(start, BenchClock::now());
+            drawn += selection.instances.size();
+        }
+        printResult("vegetation", count, times);
+        std::cout << "  instances drawn per frame: " << drawn / frames << " ("
+                  << drawn / frames * sizeof(VegetationGpuInstance) / 1024.0 << " KB uploaded)" << std::endl;
+    }
+}
+
+// Traffic update alone, serial and on every core. Without a size it runs 1,000, 10,000 and 100,000 cars on the
+// four lanes of the simulator; one car is braked hard at the start so the frames include a jam building up.
+void benchTraffic(long long size)
+{
+    std::vector<long long> sizes = size > 0 ? std::vector<long long>{ size } : std::vector<long long>{ 1000, 10000, 100000 };
+    std::vector<TrafficLane> lanes = { { -7.5f, -1.0f }, { -4.0f, -1.0f }, { 4.0f, 1.0f }, { 7.5f, 1.0f } };
+    float laneLength = benchRoute().totalLength() * SceneryConfig().worldScale;
+    JobSystem jobs;
+    for (long long count : sizes)
+    {
+        // longer than the route loop for the big counts, so the cars still fit at a realistic spacing
+        float length = std::max(laneLength, count / lanes.size() * 25.0f);
+        for (JobSystem* pool : { (JobSystem*)nullptr, &jobs })
+        {
+            TrafficSystem traffic;
+            traffic.reset(length, lanes, static_cast<int>(count));
+            traffic.brake(0, 0.1f);
+            const float dt = 1.0f / 75.0f;
+            FrameTimes times;
+            for (int frame = 0; frame < 750; frame++)
+            {
+                auto start = BenchClock::now();
+                traffic.update(dt, pool);
+                times.add(start, BenchClock::now());
+            }
+            printResult(pool ? "traffic (" + std::to_string(jobs.workerCount()) + " workers)" : "traffic (serial)", count, times);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::map<std::string, std::pair<std::function<void(long long)>, long long>> scenarios = {
+        { "passengers", { benchPassengers, 100000 } },
+        { "fleet", { benchFleet, 0 } },
+        { "jobs", { benchJobs, 100000 } },
+        { "lights", { benchLights, 0 } },
+        { "scenery", { benchScenery, 3 } },
+        { "traffic", { benchTraffic, 0 } },
+        { "vegetation", { benchVegetation, 0 } },
+    };
+
+    if (argc < 2)
+    {
+        for (auto& [name, scenario] : scenarios)
+            scenario.first(scenario.second);
+        return 0;
+    }
+
+    auto it = scenarios.find(argv[1]);
+    if (it == scenarios.end())
+    {
+        std::cout << "Unknown scenario \"" << argv[1] << "\". Available:";
+        for (auto& [name, scenario] : scenarios)
+            std::cout << " " << name;
+        std::cout << std::endl;
+        return 1;
+    }
+    long long size = argc > 2 ? std::atoll(argv[2]) : it->second.second;
+    it->second.first(size);
+    return 0;
+}
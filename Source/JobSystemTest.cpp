@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <vector>
+
+#include "job_system.hpp"
+
+// Checks the job system with several workers: parallelFor covers every item exactly once, and runAfter starts a
+// job only after its dependency finished, including chains and dependencies that are already done. Every round
+// uses counters on the stack that go out of scope right after the wait, the way parallelFor uses them, so a
+// worker touching a finished counter shows up under -fsanitize=thread.
+// Usage: Projekat3DJobTest [rounds]   (exits with 1 on the first failure)
+
+int failures = 0;
+
+void check(bool ok, const char* what, int round)
+{
+    if (ok)
+        return;
+    printf("ERROR::JOBS:: %s failed in round %d\n", what, round);
+    failures++;
+}
+
+void testParallelFor(JobSystem& jobs, int round)
+{
+    std::vector<int> hits(10000 + round % 97, 0);
+    jobs.parallelFor(hits.size(), 16, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            hits[i]++;
+    });
+    check(std::all_of(hits.begin(), hits.end(), [](int h) { return h == 1; }), "parallelFor coverage", round);
+}
+
+void testRunAfter(JobSystem& jobs, int round)
+{
+    const int producers = 16;
+    std::vector<int> values(producers, 0);
+    std::atomic<int> sum{ -1 };
+    std::atomic<int> doubled{ -1 };
+    std::atomic<int> immediate{ 0 };
+
+    JobCounter produced, summed, finished;
+    for (int i = 0; i < producers; i++)
+        jobs.run([&values, i] { values[i] = i + 1; }, &produced);
+    // reads what every producer wrote, so it must not start before all of them are done
+    jobs.runAfter(produced, [&] { sum = std::accumulate(values.begin(), values.end(), 0); }, &summed);
+    // a chain: waits on the continuation above
+    jobs.runAfter(summed, [&] { doubled = sum * 2; }, &finished);
+    jobs.wait(finished);
+    check(sum == producers * (producers + 1) / 2, "runAfter ordering", round);
+    check(doubled == producers * (producers + 1), "runAfter chain", round);
+
+    // a dependency that is already done runs the job right away
+    JobCounter again;
+    jobs.runAfter(produced, [&] { immediate = 1; }, &again);
+    jobs.wait(again);
+    check(immediate == 1, "runAfter on a finished counter", round);
+}
+
+int main(int argc, char** argv)
+{
+    int rounds = argc > 1 ? std::max(1, atoi(argv[1])) : 2000;
+    JobSystem jobs(4);
+    for (int round = 0; round < rounds && failures == 0; round++)
+    {
+        testParallelFor(jobs, round);
+        testRunAfter(jobs, round);
+    }
+    printf("%s after %d rounds on %u workers\n", failures == 0 ? "Job system OK" : "Job system FAILED", rounds, jobs.workerCount());
+    return failures == 0 ? 0 : 1;
+}
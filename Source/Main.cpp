@@ -1,13 +1,46 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
-#include <ft2build.h>
-#include FT_FREETYPE_H
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
 #include <map>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
 #include <vector>
 
 #include "model.hpp"
+#include "bench_report.hpp"
 #include "camera.hpp"
+#include "cluster_buffers.hpp"
+#include "passenger_system.hpp"
+#include "portals.hpp"
+#include "fleet.hpp"
+#include "frame_capture.hpp"
+#include "frame_pipeline.hpp"
+#include "frustum.hpp"
+#include "gl_handles.hpp"
+#include "hot_reload.hpp"
+#include "job_system.hpp"
+#include "light_clusters.hpp"
+#include "memory_tracker.hpp"
+#include "process_memory.hpp"
+#include "panel_target.hpp"
+#include "program_cache.hpp"
+#include "replay.hpp"
+#include "resolution_controller.hpp"
+#include "scaled_render_target.hpp"
+#include "scenery_stream.hpp"
+#include "shader_variants.hpp"
+#include "shadow_map.hpp"
+#include "text_layout.hpp"
+#include "trace.hpp"
+#include "traffic.hpp"
+#include "traffic_renderer.hpp"
+#include "vegetation_renderer.hpp"
 #include "../Header/Util.h"
 
 const unsigned int SCR_WIDTH = 800;
@@ -32,18 +65,9 @@ int numberOfTickets = 0;
 int currentStation = 0;
 int nextStation = 1;
 float distanceTraveled = 0.0f;
-float sceneOffset = 0.0f;
-double stopStartTime = 0.0;
-
-struct PassengerModel {
-    int modelIndex; // 0-14 for person1-15
-    float scale;
-    float rotationOffset;
-    bool isActive;
-    bool isWalkingIn;
-    bool isWalkingOut;
-    float walkProgress; // 0.0 to 1.0
-};
+Fleet fleet;
+// simulation and render preparation run on these workers, GL calls stay on the main thread
+std::unique_ptr<JobSystem> jobs;
 
 struct ModelConfig {
     float baseScale;
@@ -70,13 +94,82 @@ ModelConfig personConfigs[15] = {
 };
 
 ModelConfig controlConfig = {1.0f, 0.0f, 0.0f};
-std::vector<PassengerModel> activePassengers;
-std::vector<Model*> personModels;
-Model* controlModel;
-bool isPassengerWalking = false;
+std::vector<std::unique_ptr<Model>> personModels;
+std::unique_ptr<Model> controlModel;
+// copy of every person model's bounds for culling on the simulation thread, a hot reload may swap the models
+std::vector<BoundingSphere> personBounds;
+std::mutex personBoundsMutex;
+// CPU copies of mesh data are dropped after upload, nothing reads them once the meshes are on the GPU
+const bool keepModelCpuData = false;
+bool isControlWalking = false;
 int pendingPassengersChange = 0; // >0 for entering, <0 for leaving
+const int maxPassengers = 50;
+
+PassengerLayout makeBusPassengerLayout() {
+    PassengerLayout layout;
+    layout.outside = glm::vec3(3.5f, -1.0f, -4.0f);
+    layout.door = glm::vec3(2.0f, -1.0f, -4.0f);
+    layout.standing = glm::vec3(0.0f, -1.0f, 4.0f);
+    // 10 rows of 5 places behind the driver, one for every passenger up to the cap
+    for (int row = 0; row < 10; row++)
+        for (int col = 0; col < 5; col++)
+            layout.seats.push_back(glm::vec3(-1.6f + col * 0.7f, -1.0f, -1.5f + row * 0.6f));
+    return layout;
+}
+PassengerSystem passengers(makeBusPassengerLayout());
 bool pendingControlChange = false;
 
+// Everything the renderer needs from one simulation step. The simulation fills one of these per step and the
+// renderer draws only from it, so with --serial off the two can run on different threads.
+struct FrameSnapshot {
+    float time = 0.0f;
+    float simMs = 0.0f;
+    uint32_t step = 0;   // of the simulation that produced it
+    int width = 1, height = 1;
+
+    // camera with the bus jog already applied
+    glm::mat4 projection = glm::mat4(1.0f);
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+
+    // bus and scenery
+    float busJogX = 0.0f, busJogY = 0.0f;
+    float routeDistance = 0.0f;
+    glm::mat4 sceneryToBus = glm::mat4(1.0f);   // streamed scenery into bus space, the bus faces -z
+    float doorAngle = 0.0f;
+    float wheelRotation = 0.0f;
+    glm::vec3 cigarettePosition = glm::vec3(0.0f);
+    bool busStopped = false;
+
+    // traffic near the bus, in scenery space
+    size_t trafficCount = 0;   // cars on the whole route
+    std::vector<glm::mat4> trafficFrames;
+    std::vector<uint8_t> trafficModels;
+
+    // people, culled against the camera
+    std::vector<glm::mat4> passengerTransforms;
+    std::vector<uint8_t> passengerModels;
+    std::vector<uint8_t> passengerDrawn;
+    std::vector<uint8_t> passengerCastsShadow;   // within reach of the roof light, camera culling aside
+    bool controlVisible = false;
+    glm::mat4 controlTransform = glm::mat4(1.0f);
+
+    // control panel
+    glm::vec2 bus2D = glm::vec2(0.0f);
+    std::vector<glm::vec2> fleetOffsets;
+    bool controlInside = false;
+    int passengers = 0;
+    int tickets = 0;
+
+    // render toggles
+    bool depthTest = true;
+    bool faceCulling = false;
+    bool frameStats = false;
+    bool memoryOverlay = false;
+    int shadowQuality = 0;
+    bool dynamicResolution = true;
+};
+
 void initializeStations() {
     stations[0].x = -0.4f; stations[0].y = 0.6f; stations[0].number = 0;
     stations[1].x = 0.15f; stations[1].y = 0.55f; stations[1].number = 1;
@@ -93,27 +186,11 @@ void initializeStations() {
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-unsigned int fbo, fboTex;
+// The control panel is laid out for this size (text scale, station aspect); the target it is drawn into
+// follows its size on screen, see PanelRenderTarget
 const unsigned int FBO_WIDTH = 1024;
 const unsigned int FBO_HEIGHT = 1024;
 
-void setupFBO() {
-    glGenFramebuffers(1, &fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-
-    glGenTextures(1, &fboTex);
-    glBindTexture(GL_TEXTURE_2D, fboTex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, FBO_WIDTH, FBO_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fboTex, 0);
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
-
 unsigned bus2DTex;
 unsigned doorsOpenTex;
 unsigned doorsClosedTex;
@@ -126,10 +203,10 @@ extern unsigned int textShader;
 void draw2DStations(unsigned int shader, unsigned int vao) {
     glUseProgram(shader);
     GLint loc = glGetUniformLocation(shader, "uOffset");
-    glBindVertexArray(vao);
+    bindVertexArray(vao);
     for (int i = 0; i < 10; i++) {
         glUniform2f(loc, stations[i].x, stations[i].y);
-        glDrawArrays(GL_TRIANGLE_FAN, 0, 42); // NUM_SLICES + 2
+        drawArrays(GL_TRIANGLE_FAN, 0, 42); // NUM_SLICES + 2
     }
 
     for (int i = 0; i < 10; i++) {
@@ -141,14 +218,14 @@ void draw2DStations(unsigned int shader, unsigned int vao) {
 
 float bus2DX = -0.4f, bus2DY = 0.6f;
 
-void draw2DBus(unsigned int shader, unsigned int vao) {
+void draw2DBus(unsigned int shader, unsigned int vao, const FrameSnapshot& s) {
     glUseProgram(shader);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, bus2DTex);
     GLint loc = glGetUniformLocation(shader, "uOffset");
-    glUniform2f(loc, bus2DX, bus2DY);
-    glBindVertexArray(vao);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    glUniform2f(loc, s.bus2D.x, s.bus2D.y);
+    bindVertexArray(vao);
+    drawArrays(GL_TRIANGLE_FAN, 0, 4);
 }
 
 struct PathData {
@@ -183,146 +260,141 @@ void init2DPaths() {
         pd.count = vertices.size() / 2;
         glGenVertexArrays(1, &pd.VAO);
         glGenBuffers(1, &pd.VBO);
-        glBindVertexArray(pd.VAO);
+        bindVertexArray(pd.VAO);
         glBindBuffer(GL_ARRAY_BUFFER, pd.VBO);
         glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+        memoryTracker.track(MemoryTracker::BUFFER, pd.VBO, vertices.size() * sizeof(float), MemoryCategory::Mesh, "control panel");
         glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(0);
         pathDataList.push_back(pd);
     }
 }
 
+GLBuffer fleetInstanceVBO;
+
+// every bus of the fleet except the driven one, filled on the job system for the snapshot
+void prepareFleetOffsets(FrameSnapshot& s) {
+    std::vector<glm::vec2>& offsets = s.fleetOffsets;
+    offsets.resize(fleet.size() - 1);
+    jobs->parallelFor(offsets.size(), 4096, [&offsets](size_t begin, size_t end) {
+        for (size_t j = begin; j < end; j++)
+            offsets[j] = fleet.position[j < (size_t)fleet.driven ? j : j + 1];
+    });
+}
+
+// the other buses of the fleet as one instanced draw
+void draw2DFleet(unsigned int shader, unsigned int vao, const FrameSnapshot& s) {
+    const std::vector<glm::vec2>& offsets = s.fleetOffsets;
+    if (offsets.empty()) return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, fleetInstanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, offsets.size() * sizeof(glm::vec2), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, offsets.size() * sizeof(glm::vec2), offsets.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    memoryTracker.track(MemoryTracker::BUFFER, fleetInstanceVBO, offsets.size() * sizeof(glm::vec2), MemoryCategory::Streaming, "control panel");
+
+    glUseProgram(shader);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, bus2DTex);
+    bindVertexArray(vao);
+    drawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, static_cast<GLsizei>(offsets.size()));
+}
+
 void draw2DPaths(unsigned int shader) {
     glUseProgram(shader);
     glLineWidth(3.0f);
     for (const auto& pd : pathDataList) {
-        glBindVertexArray(pd.VAO);
-        glDrawArrays(GL_LINE_STRIP, 0, pd.count);
+        bindVertexArray(pd.VAO);
+        drawArrays(GL_LINE_STRIP, 0, pd.count);
     }
 }
 
-void draw2DDoors(unsigned int shader, unsigned int vao) {
+void draw2DDoors(unsigned int shader, unsigned int vao, const FrameSnapshot& s) {
     glUseProgram(shader);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, busStopped ? doorsOpenTex : doorsClosedTex);
-    glBindVertexArray(vao);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    glBindTexture(GL_TEXTURE_2D, s.busStopped ? doorsOpenTex : doorsClosedTex);
+    bindVertexArray(vao);
+    drawArrays(GL_TRIANGLE_FAN, 0, 4);
 }
 
-void draw2DControl(unsigned int shader, unsigned int vao) {
-    if (!isControlInside) return;
+void draw2DControl(unsigned int shader, unsigned int vao, const FrameSnapshot& s) {
+    if (!s.controlInside) return;
     glUseProgram(shader);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, control2DTex);
-    glBindVertexArray(vao);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    bindVertexArray(vao);
+    drawArrays(GL_TRIANGLE_FAN, 0, 4);
 }
 
-void draw2DText() {
+void draw2DText(const FrameSnapshot& s) {
     char passengerText[64];
-    snprintf(passengerText, sizeof(passengerText), "Passengers: %d", numberOfPassengers);
+    snprintf(passengerText, sizeof(passengerText), "Passengers: %d", s.passengers);
     char ticketsText[64];
-    snprintf(ticketsText, sizeof(ticketsText), "Tickets: %d", numberOfTickets);
+    snprintf(ticketsText, sizeof(ticketsText), "Tickets: %d", s.tickets);
 
     renderText(textShader, passengerText, 0.4f, 0.9f, 0.8f, 0.9f, 0.9f, 0.9f, FBO_WIDTH, FBO_HEIGHT);
     renderText(textShader, ticketsText, 0.4f, 0.8f, 0.8f, 0.9f, 0.9f, 0.9f, FBO_WIDTH, FBO_HEIGHT);
 }
 
 void updateBusLogic() {
-    const float speed = 0.3f;
-    const int segments = 100;
-    const double stopDuration = 10.0;
-
-    if (distanceTraveled == 0.0f) {
-        if (stopStartTime == 0.0) {
-            if (isControlInside) {
-                int fined = (numberOfPassengers > 1) ? (rand() % (numberOfPassengers - 1)) : 0;
-                numberOfTickets += fined;
-                pendingControlChange = true;
-            }
-            stopStartTime = glfwGetTime();
-        }
-        double elapsed = glfwGetTime() - stopStartTime;
-        if (elapsed < stopDuration) {
-            busStopped = true;
-        } else {
-            stopStartTime = 0.0;
-            busStopped = false;
-        }
-    } else {
-        busStopped = false;
+    TRACE_ZONE("updateBusLogic");
+    fleet.update(deltaTime, jobs.get());
+
+    int d = fleet.driven;
+    if (fleet.arrived[d] && isControlInside) {
+        int fined = (numberOfPassengers > 1) ? (rand() % (numberOfPassengers - 1)) : 0;
+        numberOfTickets += fined;
+        pendingControlChange = true;
     }
 
-    if (!busStopped) {
-        float dx = stations[nextStation].x - stations[currentStation].x;
-        float dy = stations[nextStation].y - stations[currentStation].y;
-        float cx = (stations[currentStation].x + stations[nextStation].x) / 2.0f;
-        float cy = (stations[currentStation].y + stations[nextStation].y) / 2.0f;
-        float length_dir = sqrt(dx*dx + dy*dy);
-        if (length_dir > 0.0f) {
-            cx += -dy / length_dir * 0.35f;
-            cy += dx / length_dir * 0.35f;
-        }
-
-        float totalLength = 0.0f;
-        float lastX = stations[currentStation].x;
-        float lastY = stations[currentStation].y;
-        for (int i = 1; i <= segments; i++) {
-            float tSeg = (float)i / segments;
-            float u = 1.0f - tSeg;
-            float x = u*u*stations[currentStation].x + 2*u*tSeg*cx + tSeg*tSeg*stations[nextStation].x;
-            float y = u*u*stations[currentStation].y + 2*u*tSeg*cy + tSeg*tSeg*stations[nextStation].y;
-            totalLength += sqrt((x-lastX)*(x-lastX) + (y-lastY)*(y-lastY));
-            lastX = x;
-            lastY = y;
-        }
+    // the globals below describe the bus the player is in
+    currentStation = fleet.currentStation[d];
+    nextStation = fleet.nextStation[d];
+    distanceTraveled = fleet.distance[d];
+    busStopped = fleet.stopped[d];
+    bus2DX = fleet.position[d].x;
+    bus2DY = fleet.position[d].y;
+}
 
-        distanceTraveled += (speed * 0.3f) * deltaTime;
+void initFleet(int count) {
+    std::vector<glm::vec2> stationPositions;
+    for (int i = 0; i < 10; i++)
+        stationPositions.push_back(glm::vec2(stations[i].x, stations[i].y));
+    fleet.reset(Route(stationPositions), FleetConfig(), count);
+}
 
-        if (distanceTraveled >= totalLength) {
-            if (isControlInside) {
-                int fined = (numberOfPassengers > 1) ? (rand() % (numberOfPassengers - 1)) : 0;
-                numberOfTickets += fined;
-                pendingControlChange = true;
-            }
+// Ambient cars on two lanes each way beside the bus, the same loop as the route but in scenery units
+TrafficSystem traffic;
 
-            distanceTraveled = 0.0f;
-            currentStation = nextStation;
-            nextStation = (nextStation + 1) % 10;
-            busStopped = true;
-            stopStartTime = glfwGetTime();
-        }
+void initTraffic(int count, float worldScale) {
+    std::vector<TrafficLane> lanes = { { -7.5f, -1.0f }, { -4.0f, -1.0f }, { 4.0f, 1.0f }, { 7.5f, 1.0f } };
+    traffic.reset(fleet.getRoute().totalLength() * worldScale, lanes, count);
+}
 
-        float traveled = 0.0f;
-        bus2DX = stations[currentStation].x;
-        bus2DY = stations[currentStation].y;
-        lastX = stations[currentStation].x;
-        lastY = stations[currentStation].y;
-        for (int i = 1; i <= segments; i++) {
-            float tSeg = (float)i / segments;
-            float u = 1.0f - tSeg;
-            float x = u*u*stations[currentStation].x + 2*u*tSeg*cx + tSeg*tSeg*stations[nextStation].x;
-            float y = u*u*stations[currentStation].y + 2*u*tSeg*cy + tSeg*tSeg*stations[nextStation].y;
-            float d = sqrt((x-lastX)*(x-lastX) + (y-lastY)*(y-lastY));
-            if (traveled + d >= distanceTraveled) {
-                float remain = distanceTraveled - traveled;
-                float ratio = (d > 0) ? (remain / d) : 0;
-                bus2DX = lastX + (x-lastX) * ratio;
-                bus2DY = lastY + (y-lastY) * ratio;
-                break;
-            }
-            traveled += d;
-            lastX = x;
-            lastY = y;
-        }
-    } else {
-        bus2DX = stations[currentStation].x;
-        bus2DY = stations[currentStation].y;
-    }
+// Moves the player into another bus of the fleet. Only allowed while nobody is walking through the door,
+// the passengers of the old bus are kept as a count and the new bus gets its people seated.
+void switchDrivenBus(int bus) {
+    if (bus == fleet.driven || passengers.doorBusy() || isControlWalking || pendingControlChange) return;
+
+    int old = fleet.driven;
+    fleet.passengers[old] = numberOfPassengers;
+    fleet.tickets[old] = numberOfTickets;
+    fleet.controlInside[old] = isControlInside;
+
+    fleet.driven = bus;
+    numberOfPassengers = fleet.passengers[bus];
+    numberOfTickets = fleet.tickets[bus];
+    isControlInside = fleet.controlInside[bus];
+    pendingPassengersChange = 0;
+
+    passengers.clear();
+    int seated = numberOfPassengers - (isControlInside ? 1 : 0);
+    for (int i = 0; i < seated; i++)
+        passengers.spawnSeated(rand() % 15);
 }
 
-void passengersInputCallback(GLFWwindow* window, int button, int action, int mods) {
-    if (!busStopped || isPassengerWalking || pendingControlChange)  return;
+void handleMouseButton(int button, int action) {
+    if (!busStopped || isControlWalking || pendingControlChange)  return;
     if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
         pendingPassengersChange++;
     }
@@ -331,18 +403,11 @@ void passengersInputCallback(GLFWwindow* window, int button, int action, int mod
     }
 }
 
-void controlInputCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
-    if (busStopped && !isPassengerWalking && key == GLFW_KEY_K && action == GLFW_PRESS) {
-        if (!isControlInside && !pendingControlChange) {
-            pendingControlChange = true;
-        }
-    }
-}
-
-void renderControlPanelToFBO(unsigned int busShader, unsigned int stationShader, unsigned int pathShader, unsigned int simpleShader, 
-                              unsigned int busVAO, unsigned int stationVAO, unsigned int doorVAO, unsigned int controlVAO, unsigned int signatureVAO) {
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-    glViewport(0, 0, FBO_WIDTH, FBO_HEIGHT);
+void renderControlPanelToFBO(unsigned int busShader, unsigned int stationShader, unsigned int pathShader, unsigned int simpleShader, unsigned int fleetShader,
+                              unsigned int busVAO, unsigned int stationVAO, unsigned int doorVAO, unsigned int controlVAO, unsigned int signatureVAO, unsigned int fleetVAO,
+                              PanelRenderTarget& target, float screenPixels, const FrameSnapshot& s) {
+    TRACE_ZONE("renderControlPanelToFBO");
+    if (!target.beginUpdate(screenPixels)) return;
 
     glClearColor(0.2f, 0.2f, 0.2f, 1.0f); // Set a true background color (dark grey)
     glClear(GL_COLOR_BUFFER_BIT); // Clear previous frame's textures
@@ -350,163 +415,113 @@ void renderControlPanelToFBO(unsigned int busShader, unsigned int stationShader,
     drawSignature(simpleShader, signatureVAO);
     draw2DStations(stationShader, stationVAO);
     draw2DPaths(pathShader);
-    draw2DBus(busShader, busVAO);
-    draw2DDoors(simpleShader, doorVAO);
-    draw2DText();
-    draw2DControl(simpleShader, controlVAO);
+    draw2DFleet(fleetShader, fleetVAO, s);
+    draw2DBus(busShader, busVAO, s);
+    draw2DDoors(simpleShader, doorVAO, s);
+    draw2DText(s);
+    draw2DControl(simpleShader, controlVAO, s);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    target.endUpdate();
 }
 
 float globalControlWalkProgress = 0.0f;
 float doorProgress = 0.0f;
 
 void processPassengersLogic() {
-    if (isPassengerWalking) {
-        bool found = false;
-        
-        // Handle control walking
-        if (pendingControlChange) {
-            globalControlWalkProgress += deltaTime / 1.5f;
-            if (globalControlWalkProgress >= 1.0f) {
-                globalControlWalkProgress = 0.0f;
-                if (!isControlInside) {
-                    isControlInside = true;
-                    numberOfPassengers++;
-                } else {
-                    isControlInside = false;
-                    numberOfPassengers--;
-                }
-                pendingControlChange = false;
-                isPassengerWalking = false;
-            }
-            found = true;
-        }
-        
-        if (!found) {
-            for (auto it = activePassengers.begin(); it != activePassengers.end(); ++it) {
-                if (it->isWalkingIn || it->isWalkingOut) {
-                    it->walkProgress += deltaTime;
-                    if (it->walkProgress >= 1.0f) {
-                        it->walkProgress = 0.0f;
-                        if (it->isWalkingIn) {
-                            it->isWalkingIn = false;
-                            it->isActive = true;
-                            numberOfPassengers++;
-                        } else {
-                            it->isActive = false;
-                            numberOfPassengers--;
-                            activePassengers.erase(it);
-                        }
-                        isPassengerWalking = false;
-                        pendingPassengersChange = (pendingPassengersChange > 0) ? (pendingPassengersChange - 1) : (pendingPassengersChange + 1);
-                    }
-                    found = true;
-                    break;
-                }
+    TRACE_ZONE("processPassengersLogic");
+    // The control walks alone: it waits until nobody is using the door and blocks boarding while it walks
+    if (isControlWalking) {
+        globalControlWalkProgress += deltaTime / 1.5f;
+        if (globalControlWalkProgress >= 1.0f) {
+            globalControlWalkProgress = 0.0f;
+            if (!isControlInside) {
+                isControlInside = true;
+                numberOfPassengers++;
+            } else {
+                isControlInside = false;
+                numberOfPassengers--;
             }
-        }
-    } else {
-        if (!busStopped) {
-            pendingPassengersChange = 0;
             pendingControlChange = false;
-            return;
+            isControlWalking = false;
         }
+    } else if (busStopped && pendingControlChange && !passengers.doorBusy()) {
+        isControlWalking = true;
+        globalControlWalkProgress = 0.0f;
+    }
 
-        if (pendingControlChange) {
-            isPassengerWalking = true;
-            globalControlWalkProgress = 0.0f;
-        } else if (pendingPassengersChange != 0) {
-            if (isControlInside) {
-                pendingPassengersChange = 0;
-                return;
+    if (!busStopped) {
+        pendingPassengersChange = 0;
+        if (!isControlWalking) pendingControlChange = false;
+    } else if (!pendingControlChange && !isControlWalking && pendingPassengersChange != 0) {
+        if (isControlInside) {
+            pendingPassengersChange = 0;
+        } else if (pendingPassengersChange > 0) {
+            // everyone queues at the door at once, the door lets them in one after another
+            while (pendingPassengersChange > 0 && numberOfPassengers + passengers.boardingCount() < maxPassengers) {
+                passengers.spawnBoarding(rand() % 15);
+                pendingPassengersChange--;
             }
-            
-            if (pendingPassengersChange > 0) {
-                if (numberOfPassengers >= 50) {
-                    pendingPassengersChange = 0;
-                    return;
-                }
-                PassengerModel p;
-                p.modelIndex = rand() % 15;
-                p.scale = personConfigs[p.modelIndex].baseScale;
-                p.rotationOffset = personConfigs[p.modelIndex].rotationAdjustment;
-                p.isActive = false;
-                p.isWalkingIn = true;
-                p.isWalkingOut = false;
-                p.walkProgress = 0.0f;
-                activePassengers.push_back(p);
-                isPassengerWalking = true;
-            } else if (pendingPassengersChange < 0) {
-                if (activePassengers.empty()) {
-                    pendingPassengersChange = 0;
-                    return;
-                }
-                int idx = rand() % activePassengers.size();
-                activePassengers[idx].isWalkingOut = true;
-                activePassengers[idx].isActive = false;
-                activePassengers[idx].walkProgress = 0.0f;
-                isPassengerWalking = true;
-            } else {
-                pendingPassengersChange = 0;
+            pendingPassengersChange = 0;
+        } else {
+            while (pendingPassengersChange < 0 && passengers.seatedCount() > 0) {
+                passengers.requestAlight(passengers.seatedPassenger(rand() % passengers.seatedCount()));
+                pendingPassengersChange++;
             }
+            pendingPassengersChange = 0;
         }
     }
+
+    PassengerUpdateResult result = passengers.update(deltaTime, jobs.get());
+    numberOfPassengers += result.boarded - result.alighted;
 }
 
 extern float busJogY;
 extern float busJogX;
-
-void draw3DPassengers(Shader& shader) {
-    for (auto& p : activePassengers) {
-        if (p.isActive || p.isWalkingIn || p.isWalkingOut) {
-            glm::mat4 model = glm::mat4(1.0f);
-            glm::vec3 pos;
-            float angle = -90.0f;
-
-            glm::vec3 outside(3.5f, -1.0f, -4.0f);
-            glm::vec3 door(2.0f, -1.0f, -4.0f);
-            glm::vec3 inside(-1.0f, -1.0f, 2.0f);
-
-            bool isInside = p.isActive || (p.isWalkingIn && p.walkProgress >= 0.5f) || (p.isWalkingOut && p.walkProgress < 0.5f);
-
-            if (p.isActive) {
-                pos = inside;
-            } else if (p.isWalkingIn) {
-                if (p.walkProgress < 0.5f) {
-                    pos = glm::mix(outside, door, p.walkProgress * 2.0f);
-                    angle = -90.0f;
-                } else {
-                    pos = glm::mix(door, inside, (p.walkProgress - 0.5f) * 2.0f);
-                    angle = 180.0f;
-                }
-            } else if (p.isWalkingOut) {
-                if (p.walkProgress < 0.5f) {
-                    pos = glm::mix(inside, door, p.walkProgress * 2.0f);
-                    angle = 0.0f;
-                } else {
-                    pos = glm::mix(door, outside, (p.walkProgress - 0.5f) * 2.0f);
-                    angle = 90.0f;
-                }
-            }
-
-            if (isInside) {
+extern glm::vec3 lightPos;
+extern const float lightRange;
+
+// Builds every passenger's model matrix and culls it against the camera on the job system.
+// Only fills the snapshot, draw3DPassengers issues the GL calls afterwards.
+void preparePassengerTransforms(const Frustum& frustum, FrameSnapshot& s) {
+    size_t n = passengers.count();
+    s.passengerTransforms.resize(n);
+    s.passengerModels.resize(n);
+    s.passengerDrawn.resize(n);
+    s.passengerCastsShadow.resize(n);
+    glm::vec3 roofLight = lightPos + glm::vec3(busJogX, busJogY, 0.0f);
+    std::vector<BoundingSphere> bounds;
+    {
+        std::lock_guard<std::mutex> lock(personBoundsMutex);
+        bounds = personBounds;
+    }
+    jobs->parallelFor(n, 256, [&frustum, &bounds, &s, roofLight](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            s.passengerDrawn[i] = 0;
+            s.passengerCastsShadow[i] = 0;
+            s.passengerModels[i] = passengers.modelIndex[i];
+            if (!passengers.isVisible(i)) continue;
+            const ModelConfig& config = personConfigs[passengers.modelIndex[i]];
+
+            glm::vec3 pos = passengers.position[i];
+            if (passengers.isInside(i)) {
                 pos.x += busJogX;
                 pos.y += busJogY;
             }
-            pos.y += personConfigs[p.modelIndex].verticalOffset;
+            pos.y += config.verticalOffset;
 
-            model = glm::translate(model, pos);
-            model = glm::rotate(model, glm::radians(angle + p.rotationOffset), glm::vec3(0.0f, 1.0f, 0.0f));
-            model = glm::scale(model, glm::vec3(p.scale));
-            shader.setMat4("uM", model);
-            personModels[p.modelIndex]->Draw(shader);
+            glm::mat4 model = placementMatrix(pos, passengers.heading[i] + config.rotationAdjustment, config.baseScale);
+            s.passengerTransforms[i] = model;
+            BoundingSphere sphere = transformSphere(bounds[passengers.modelIndex[i]], model);
+            s.passengerDrawn[i] = frustum.intersects(sphere);
+            s.passengerCastsShadow[i] = glm::distance(sphere.center, roofLight) < lightRange + sphere.radius;
         }
-    }
+    });
+}
 
-    // Draw Control if inside or walking
-    if (isControlInside || (pendingControlChange && isPassengerWalking)) {
-        glm::mat4 model = glm::mat4(1.0f);
+// Control if inside or walking
+void prepareControlTransform(FrameSnapshot& s) {
+    s.controlVisible = isControlInside || isControlWalking;
+    if (s.controlVisible) {
         glm::vec3 pos;
         float angle = -90.0f;
 
@@ -547,18 +562,36 @@ void draw3DPassengers(Shader& shader) {
         }
         pos.y += controlConfig.verticalOffset;
 
-        model = glm::translate(model, pos);
-        model = glm::rotate(model, glm::radians(angle + controlConfig.rotationAdjustment), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(controlConfig.baseScale));
-        shader.setMat4("uM", model);
+        s.controlTransform = placementMatrix(pos, angle + controlConfig.rotationAdjustment, controlConfig.baseScale);
+    }
+}
+
+
+void draw3DPassengers(ShaderVariants& shader, const FrameSnapshot& s) {
+    for (size_t i = 0; i < s.passengerTransforms.size(); i++) {
+        if (!s.passengerDrawn[i]) continue;
+        shader.setMat4("uM", s.passengerTransforms[i]);
+        personModels[s.passengerModels[i]]->Draw(shader);
+    }
+
+    if (s.controlVisible) {
+        shader.setMat4("uM", s.controlTransform);
         controlModel->Draw(shader);
     }
 }
 
 bool depthTestEnabled = true;
 bool faceCullingEnabled = false;
-
-void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
+bool frameStatsEnabled = false;
+bool memoryOverlayEnabled = false;
+// 0 off, 1 hard, 2 and 3 filtered with more taps
+int shadowQuality = 2;
+const int shadowTaps[] = { 0, 1, 8, 20 };
+const char* shadowQualityNames[] = { "off", "hard", "PCF 8", "PCF 20" };
+// the scene renders below window size when frames run over the 75 Hz budget
+bool dynamicResolutionEnabled = true;
+
+void handleCursor(double xposIn, double yposIn)
 {
     float xpos = static_cast<float>(xposIn);
     float ypos = static_cast<float>(yposIn);
@@ -579,13 +612,146 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
     camera.ProcessMouseMovement(xoffset, yoffset);
 }
 
-struct Character {
-    unsigned int TextureID;
-    int SizeX, SizeY;
-    int BearingX, BearingY;
-    unsigned int Advance;
+std::atomic<bool> closeRequested{ false };
+
+void handleKey(int key, int action) {
+    if (action != GLFW_PRESS) return;
+    switch (key) {
+    case GLFW_KEY_ESCAPE: closeRequested = true; break;
+    case GLFW_KEY_1: depthTestEnabled = !depthTestEnabled; break;
+    case GLFW_KEY_2: faceCullingEnabled = !faceCullingEnabled; break;
+    case GLFW_KEY_3: frameStatsEnabled = !frameStatsEnabled; break;
+    case GLFW_KEY_4: shadowQuality = (shadowQuality + 1) % 4; break;
+    case GLFW_KEY_5: dynamicResolutionEnabled = !dynamicResolutionEnabled; break;
+    case GLFW_KEY_6: memoryOverlayEnabled = !memoryOverlayEnabled; break;
+    case GLFW_KEY_M:
+        if (memoryTracker.writeJson("memory.json"))
+            std::cout << "Memory report written to memory.json" << std::endl;
+        break;
+    case GLFW_KEY_T: TRACE_DUMP(); break;
+    case GLFW_KEY_TAB: switchDrivenBus((fleet.driven + 1) % fleet.size()); break;
+    case GLFW_KEY_K:
+        if (busStopped && !isControlWalking && !passengers.doorBusy() && !isControlInside && !pendingControlChange)
+            pendingControlChange = true;
+        break;
+    }
+}
+
+// Record and replay (--record FILE, --replay FILE): rand() is seeded from the log and the simulation steps on a
+// fixed timeline, so the same input at the same steps gives the same state, checked by a hash after every step.
+// A benchmark (--bench NAME) runs on the same timeline with its input coming from a script.
+enum class SessionMode { Live, Record, Replay, Bench };
+struct Session {
+    SessionMode mode = SessionMode::Live;
+    ReplayHeader header;
+    ReplayRecorder recorder;
+    ReplayLog log;
+    ReplayCheck check;
+    uint32_t step = 0;
+    bool finished = false;   // the whole log was replayed, or the benchmark ran its time
+} session;
+
+// The GLFW callbacks run on the main thread and only record input, the simulation step applies it.
+// A replay takes its input from the log and a benchmark from its script, live input other than Escape is ignored.
+InputQueue inputQueue;
+
+bool scriptedInput() {
+    return session.mode == SessionMode::Replay || session.mode == SessionMode::Bench;
+}
+
+void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
+    if (scriptedInput()) return;
+    inputQueue.push({ InputEvent::Type::CursorMove, 0, 0, xpos, ypos });
+}
+
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
+    if (scriptedInput()) return;
+    inputQueue.push({ InputEvent::Type::MouseButton, button, action });
+}
+
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if (scriptedInput()) {
+        if (key == GLFW_KEY_ESCAPE) closeRequested = true;
+        return;
+    }
+    inputQueue.push({ InputEvent::Type::Key, key, action });
+}
+
+// Benchmark scenarios. Each runs a fixed simulated time with a fixed seed; its script runs before every step
+// and presses keys and buttons the way a player would in that situation.
+void clickPassengerIn() {
+    inputQueue.push({ InputEvent::Type::MouseButton, GLFW_MOUSE_BUTTON_LEFT, GLFW_PRESS });
+}
+
+void scriptBoarding() {
+    // at every stop a few get off, then the bus fills up to the cap again
+    static bool wasStopped = false;
+    if (busStopped && !wasStopped)
+        for (int i = 0; i < 5; i++)
+            inputQueue.push({ InputEvent::Type::MouseButton, GLFW_MOUSE_BUTTON_RIGHT, GLFW_PRESS });
+    else if (busStopped && !isControlInside && numberOfPassengers + passengers.boardingCount() < maxPassengers)
+        clickPassengerIn();
+    wasStopped = busStopped;
+}
+
+void scriptInspection() {
+    // the control gets on at one stop and off at the next, with passengers boarding in between
+    if (busStopped && !isControlInside && !isControlWalking && !pendingControlChange)
+        inputQueue.push({ InputEvent::Type::Key, GLFW_KEY_K, GLFW_PRESS });
+    else if (busStopped && !isControlInside && numberOfPassengers < maxPassengers / 2)
+        clickPassengerIn();
+}
+
+struct BenchScenario {
+    const char* name;
+    float seconds;
+    int fleetSize;
+    int trafficCount;
+    int shadowQuality;
+    void (*script)();
 };
 
+const BenchScenario benchScenarios[] = {
+    { "idle", 60.0f, 1, 300, 2, nullptr },
+    { "boarding", 90.0f, 1, 300, 2, scriptBoarding },
+    { "inspection", 90.0f, 1, 300, 2, scriptInspection },
+    { "scenery", 60.0f, 1, 4000, 3, nullptr },
+    { "long-route", 600.0f, 40, 1000, 2, scriptBoarding },
+};
+
+// What a benchmark run collects and where it goes
+struct BenchRun {
+    const BenchScenario* scenario = nullptr;
+    BenchReport report;
+    std::string outPath;
+    std::string baselinePath;
+    bool writeBaseline = false;   // save the report as the baseline instead of comparing against it
+    double threshold = 0.1;   // allowed growth over the baseline, as a fraction
+    uint32_t warmupSteps = 150;   // the first two seconds build caches, stream scenery and fill the GPU queues
+    uint32_t totalSteps = 0;
+} bench;
+
+void applyInput() {
+    TRACE_ZONE("input");
+    static std::vector<InputEvent> events;
+    if (session.mode == SessionMode::Replay && session.step < session.log.steps.size()) {
+        const ReplayLog::Step& step = session.log.steps[session.step];
+        for (size_t i = 0; i < step.eventCount; i++)
+            inputQueue.push(session.log.events[step.firstEvent + i]);
+    }
+    if (session.mode == SessionMode::Bench && bench.scenario->script)
+        bench.scenario->script();
+    inputQueue.drain(events);
+    for (const InputEvent& e : events) {
+        if (session.mode == SessionMode::Record) session.recorder.event(e);
+        switch (e.type) {
+        case InputEvent::Type::Key: handleKey(e.code, e.action); break;
+        case InputEvent::Type::MouseButton: handleMouseButton(e.code, e.action); break;
+        case InputEvent::Type::CursorMove: handleCursor(e.x, e.y); break;
+        }
+    }
+}
+
 std::map<char, Character> Characters;
 
 // Main fajl funkcija sa osnovnim komponentama OpenGL programa
@@ -601,6 +767,12 @@ void preprocessTexture(unsigned& texture, const char* filepath) {
     // Generisanje mipmapa - predefinisani različiti formati za lakše skaliranje po potrebi (npr. da postoji 32 x 32 verzija slike, ali i 16 x 16, 256 x 256...)
     glGenerateMipmap(GL_TEXTURE_2D);
 
+    GLint width = 0, height = 0, format = GL_RGBA8;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+    memoryTracker.track(MemoryTracker::TEXTURE, texture, textureBytes(format, width, height, true), MemoryCategory::Texture, filepath);
+
     // Podešavanje strategija za wrap-ovanje - šta da radi kada se dimenzije teksture i poligona ne poklapaju
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); // S - tekseli po x-osi
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT); // T - tekseli po y-osi
@@ -614,9 +786,10 @@ void formVAOTexture(float* vertices, size_t size, unsigned int& vao, unsigned in
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &vbo);
 
-    glBindVertexArray(vao);
+    bindVertexArray(vao);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, size, vertices, GL_STATIC_DRAW);
+    memoryTracker.track(MemoryTracker::BUFFER, vbo, size, MemoryCategory::Mesh);
 
     // Atribut 0 (pozicija):
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
@@ -631,9 +804,10 @@ void formVAOPositionOnly(float* vertices, size_t size, unsigned int& vao, unsign
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &vbo);
 
-    glBindVertexArray(vao);
+    bindVertexArray(vao);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, size, vertices, GL_STATIC_DRAW);
+    memoryTracker.track(MemoryTracker::BUFFER, vbo, size, MemoryCategory::Mesh);
 
     // Atribut 0 (pozicija):
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
@@ -644,9 +818,10 @@ void formVAO3D(float* vertices, size_t size, unsigned int& vao, unsigned int& vb
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &vbo);
 
-    glBindVertexArray(vao);
+    bindVertexArray(vao);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, size, vertices, GL_STATIC_DRAW);
+    memoryTracker.track(MemoryTracker::BUFFER, vbo, size, MemoryCategory::Mesh);
 
     // position attribute
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
@@ -753,35 +928,17 @@ void drawSignature(unsigned int shader, unsigned int vao) {
     glUseProgram(shader);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, signatureTex);
-    glBindVertexArray(vao);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    bindVertexArray(vao);
+    drawArrays(GL_TRIANGLE_FAN, 0, 4);
 }
 
 unsigned int textVAO, textVBO;
 unsigned int textShader;
 
 void initFreeType(const char* fontPath) {
-    FT_Library ft;
-    if (FT_Init_FreeType(&ft)) {
-        fprintf(stderr, "ERROR::FREETYPE: Could not init FreeType Library\n");
-        return;
-    }
-
-    FT_Face face;
-    if (FT_New_Face(ft, fontPath, 0, &face)) {
-        fprintf(stderr, "ERROR::FREETYPE: Failed to load font\n");
-        return;
-    }
-
-    FT_Set_Pixel_Sizes(face, 0, 48);
+    TRACE_ZONE("initFreeType");
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-    for (unsigned char c = 32; c < 128; c++) {
-        if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
-            fprintf(stderr, "ERROR::FREETYPE: Failed to load Glyph\n");
-            continue;
-        }
-
+    rasterizeGlyphs(fontPath, 48, [fontPath](unsigned char c, FT_GlyphSlot glyph) {
         unsigned int texture;
         glGenTextures(1, &texture);
         glBindTexture(GL_TEXTURE_2D, texture);
@@ -789,13 +946,14 @@ void initFreeType(const char* fontPath) {
             GL_TEXTURE_2D,
             0,
             GL_RED,
-            face->glyph->bitmap.width,
-            face->glyph->bitmap.rows,
+            glyph->bitmap.width,
+            glyph->bitmap.rows,
             0,
             GL_RED,
             GL_UNSIGNED_BYTE,
-            face->glyph->bitmap.buffer
+            glyph->bitmap.buffer
         );
+        memoryTracker.track(MemoryTracker::TEXTURE, texture, textureBytes(GL_RED, glyph->bitmap.width, glyph->bitmap.rows), MemoryCategory::Font, fontPath);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -804,27 +962,25 @@ void initFreeType(const char* fontPath) {
 
         Character character = {
             texture,
-            (int)face->glyph->bitmap.width,
-            (int)face->glyph->bitmap.rows,
-            face->glyph->bitmap_left,
-            face->glyph->bitmap_top,
-            (unsigned int)face->glyph->advance.x
+            (int)glyph->bitmap.width,
+            (int)glyph->bitmap.rows,
+            glyph->bitmap_left,
+            glyph->bitmap_top,
+            (unsigned int)glyph->advance.x
         };
         Characters[c] = character;
-    }
-
-    FT_Done_Face(face);
-    FT_Done_FreeType(ft);
+    });
 
     glGenVertexArrays(1, &textVAO);
     glGenBuffers(1, &textVBO);
-    glBindVertexArray(textVAO);
+    bindVertexArray(textVAO);
     glBindBuffer(GL_ARRAY_BUFFER, textVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
+    memoryTracker.track(MemoryTracker::BUFFER, textVBO, sizeof(float) * 6 * 4, MemoryCategory::Font, fontPath);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    bindVertexArray(0);
 }
 
 void renderText(unsigned int shader, std::string text, float x, float y, float scale, float r, float g, float b, float screenWidth, float screenHeight) {
@@ -832,69 +988,448 @@ void renderText(unsigned int shader, std::string text, float x, float y, float s
     glUniform3f(glGetUniformLocation(shader, "textColor"), r, g, b);
     glUniform1i(glGetUniformLocation(shader, "text"), 0);
     glActiveTexture(GL_TEXTURE0);
-    glBindVertexArray(textVAO);
+    bindVertexArray(textVAO);
     glBindBuffer(GL_ARRAY_BUFFER, textVBO);
 
     float startX = x;
     for (char c : text) {
         Character ch = Characters[c];
-
-        float xpos = startX + ch.BearingX * scale / screenWidth * 2.0f;
-        float ypos = y - (ch.SizeY - ch.BearingY) * scale / screenHeight * 2.0f;
-
-        float w = ch.SizeX * scale / screenWidth * 2.0f;
-        float h = ch.SizeY * scale / screenHeight * 2.0f;
-
-        float vertices[6][4] = {
-            { xpos,     ypos + h,   0.0f, 0.0f },
-            { xpos,     ypos,       0.0f, 1.0f },
-            { xpos + w, ypos,       1.0f, 1.0f },
-
-            { xpos,     ypos + h,   0.0f, 0.0f },
-            { xpos + w, ypos,       1.0f, 1.0f },
-            { xpos + w, ypos + h,   1.0f, 0.0f }
-        };
+        float vertices[6][4];
+        glyphQuad(ch, startX, y, scale, screenWidth, screenHeight, vertices);
 
         glBindTexture(GL_TEXTURE_2D, ch.TextureID);
         glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        drawArrays(GL_TRIANGLES, 0, 6);
 
-        startX += (ch.Advance >> 6) * scale / screenWidth * 2.0f;
+        startX += glyphAdvance(ch, scale, screenWidth);
     }
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    bindVertexArray(0);
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-unsigned int createColorTexture(float r, float g, float b, float a = 1.0f) {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
+// light settings
+glm::vec3 lightPos(0.0f, 1.8f, -3.0f); // Inside the bus, near the roof, in bus space
+glm::vec3 lightColor(0.95f, 0.9f, 0.7f); // Warm yellow-ish light
+float lightIntensity = 1.2f;
+const float lightRange = 25.0f;
+
+// the world outside, streamed in chunks along the route of the driven bus
+const SceneryConfig sceneryConfig;
+
+// Every point light of a frame: the main roof light, a row of ceiling lights and the headlights move with the
+// bus, the lamps of the streamed scenery line the road. Returns how many come first and get a visible bulb.
+size_t gatherSceneLights(const FrameSnapshot& s, const std::vector<SceneryChunk*>& scenery, std::vector<PointLight>& lights) {
+    lights.clear();
+    lights.push_back({ lightPos + glm::vec3(s.busJogX, s.busJogY, 0.0f), lightRange, lightColor, lightIntensity });
+    for (float z : { -1.0f, 1.0f, 3.0f })
+        lights.push_back({ glm::vec3(s.busJogX, 1.85f + s.busJogY, z), 4.0f, glm::vec3(1.0f, 0.95f, 0.85f), 0.5f });
+    for (const SceneryChunk* chunk : scenery)
+        for (const glm::vec3& lamp : chunk->lamps)
+            lights.push_back({ glm::vec3(s.sceneryToBus * glm::vec4(lamp, 1.0f)), 8.0f, glm::vec3(1.0f, 0.8f, 0.5f), 1.0f });
+    size_t withBulbs = lights.size();
+    for (float x : { -1.5f, 1.5f })
+        lights.push_back({ glm::vec3(x + s.busJogX, -0.5f + s.busJogY, -5.3f), 15.0f, glm::vec3(1.0f, 1.0f, 0.95f), 1.5f });
+    return withBulbs;
+}
+
+// The bus interior is modelled in bus space, the jog moves all of it together
+glm::mat4 busToWorld(const FrameSnapshot& s) {
+    return glm::translate(glm::mat4(1.0f), glm::vec3(s.busJogX, s.busJogY, 0.0f));
+}
 
-    unsigned char data[] = {
-        static_cast<unsigned char>(r * 255),
-        static_cast<unsigned char>(g * 255),
-        static_cast<unsigned char>(b * 255),
-        static_cast<unsigned char>(a * 255)
+glm::mat4 placeBox(const glm::vec3& center, const glm::vec3& size) {
+    return glm::scale(glm::translate(glm::mat4(1.0f), center), size);
+}
+
+// floor, left and right wall, roof, back and the front below the windshield
+const std::array<glm::mat4, 6>& busShellBoxes() {
+    static const std::array<glm::mat4, 6> boxes = {
+        placeBox(glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(4.0f, 0.1f, 10.0f)),
+        placeBox(glm::vec3(-2.0f, 0.5f, 0.0f), glm::vec3(0.1f, 3.0f, 10.0f)),
+        placeBox(glm::vec3(2.0f, 0.5f, 1.0f), glm::vec3(0.1f, 3.0f, 8.0f)),
+        placeBox(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(4.0f, 0.1f, 10.0f)),
+        placeBox(glm::vec3(0.0f, 0.5f, 5.0f), glm::vec3(4.0f, 3.0f, 0.1f)),
+        placeBox(glm::vec3(0.0f, -0.25f, -5.0f), glm::vec3(4.0f, 1.5f, 0.1f)),
     };
+    return boxes;
+}
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+glm::mat4 controlPanelBox() {
+    return placeBox(glm::vec3(0.0f, 0.0f, -4.8f), glm::vec3(1.0f, 0.6f, 0.1f));
+}
 
-    return textureID;
+// the unit quad showing the panel texture, slightly in front of the box face
+glm::mat4 controlPanelScreen() {
+    return glm::translate(controlPanelBox(), glm::vec3(0.0f, 0.0f, 0.501f));
 }
 
-// light settings
-glm::vec3 lightPos(0.0f, 1.8f, -3.0f); // Inside the bus, near the roof
-glm::vec3 lightColor(0.95f, 0.9f, 0.7f); // Warm yellow-ish light
-float lightIntensity = 1.2f;
+glm::mat4 doorBox(float doorAngle) {
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(2.0f, 0.5f, -3.0f));
+    model = glm::rotate(model, glm::radians(doorAngle), glm::vec3(0.0f, 1.0f, 0.0f));
+    model = glm::translate(model, glm::vec3(0.0f, 0.0f, -1.0f));
+    return glm::scale(model, glm::vec3(0.1f, 3.0f, 2.0f));
+}
+
+glm::mat4 steeringWheelTransform(float rotation) {
+    // Position the wheel in the bus (Y adjusted from 0.0f to 0.26f to compensate for centering translation)
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(-1.0f, 0.26f, -4.5f));
+    model = glm::rotate(model, glm::radians(-20.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    model = glm::rotate(model, glm::radians(rotation), glm::vec3(0.0f, 0.0f, 1.0f));
+    model = glm::scale(model, glm::vec3(0.11f));
+    return glm::translate(model, glm::vec3(0.0f, -2.39f, 0.0f)); // Center the wheel (Y center is ~2.39)
+}
+
+// in world space, the simulation already applies the jog to the cigarette
+glm::mat4 cigaretteTransform(const glm::vec3& position) {
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+    model = glm::rotate(model, glm::radians(50.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    model = glm::rotate(model, glm::radians(-45.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    return glm::scale(model, glm::vec3(0.3f));
+}
+
+// The outside is only seen through the windshield and the door opening, both in bus space
+PortalVisibility makeBusPortals() {
+    PortalVisibility portals(glm::vec3(-2.0f, -1.0f, -5.0f), glm::vec3(2.0f, 2.0f, 5.0f));
+    portals.addPortal(glm::vec3(-2.0f, 0.5f, -5.0f), glm::vec3(2.0f, 0.5f, -5.0f), glm::vec3(2.0f, 2.0f, -5.0f), glm::vec3(-2.0f, 2.0f, -5.0f));
+    // the whole opening, open or closed: the door leaf does not cover the gap next to the front wall
+    portals.addPortal(glm::vec3(2.0f, -1.0f, -5.0f), glm::vec3(2.0f, -1.0f, -3.0f), glm::vec3(2.0f, 2.0f, -3.0f), glm::vec3(2.0f, 2.0f, -5.0f));
+    return portals;
+}
 
-int main()
+int runSimulator(GLFWwindow* window, int fleetSize, int trafficCount, bool pipelined, bool hotReload, const std::string& capturePath);
+
+float wheelTime = 0.0f;
+
+// Everything one step of the simulation changes; two runs that agree on it behave the same from there on
+uint64_t simulationStateHash() {
+    StateHash h;
+    h.add(fleet.currentStation);
+    h.add(fleet.nextStation);
+    h.add(fleet.distance);
+    h.add(fleet.stopped);
+    h.add(fleet.stopTimer);
+    h.add(fleet.passengers);
+    h.add(fleet.tickets);
+    h.add(fleet.controlInside);
+    h.add(fleet.rng);
+    h.add(fleet.driven);
+    h.add(passengers.state);
+    h.add(passengers.progress);
+    h.add(passengers.modelIndex);
+    h.add(passengers.seat);
+    h.add(passengers.position);
+    h.add(passengers.heading);
+    h.add(traffic.position);
+    h.add(traffic.speed);
+    for (int v : { numberOfPassengers, numberOfTickets, pendingPassengersChange, (int)isControlInside, (int)isControlWalking,
+                   (int)pendingControlChange })
+        h.add(v);
+    for (float v : { globalControlWalkProgress, doorProgress, wheelTime, busJogX, busJogY })
+        h.add(v);
+    return h.result();
+}
+
+// Applies the queued input and advances the world to currentTime, or to the next step of the fixed timeline
+// when recording or replaying. Returns the time it advanced to.
+float advanceSimulation(float currentTime) {
+    if (session.mode != SessionMode::Live)
+        currentTime = session.step * session.header.stepSeconds;
+    deltaTime = currentTime - lastFrame;
+    lastFrame = currentTime;
+
+    applyInput();
+    updateBusLogic();
+    processPassengersLogic();
+    {
+        TRACE_ZONE("traffic");
+        traffic.update(std::min(deltaTime, 0.1f), jobs.get()); // a long hitch would let cars jump through their leaders
+    }
+
+    // Calculate bus jogging
+    if (!busStopped) {
+        busJogY = sin(currentTime * 10.0f) * 0.02f; // Up-down
+        busJogX = cos(currentTime * 7.0f) * 0.01f;  // Slight left-right
+    } else {
+        busJogY = 0.0f;
+        busJogX = 0.0f;
+    }
+
+    float doorSpeed = 2.0f;
+    if (busStopped) {
+        doorProgress += deltaTime * doorSpeed;
+        if (doorProgress > 1.0f) doorProgress = 1.0f;
+    } else {
+        doorProgress -= deltaTime * doorSpeed;
+        if (doorProgress < 0.0f) doorProgress = 0.0f;
+    }
+
+    // Simulating wheel movement (slight left-right rotation)
+    if (!busStopped) {
+        wheelTime += deltaTime;
+    }
+
+    if (session.mode == SessionMode::Record) {
+        session.recorder.endStep(session.step, simulationStateHash());
+    } else if (session.mode == SessionMode::Replay && !session.finished) {
+        session.check.verify(session.step, session.log.steps[session.step].hash, simulationStateHash());
+        if (session.step + 1 == session.log.steps.size()) {
+            session.check.report();
+            session.finished = true;
+            closeRequested = true;
+        }
+    } else if (session.mode == SessionMode::Bench && session.step + 1 >= bench.totalSteps) {
+        session.finished = true;
+        closeRequested = true;
+    }
+    session.step++;
+    return currentTime;
+}
+
+// One simulation step: advances the world and records everything the renderer needs in s. Touches no GL
+// state, so it can run on its own thread.
+void stepSimulation(float currentTime, int width, int height, FrameSnapshot& s) {
+    TRACE_ZONE("stepSimulation");
+    auto stepStart = std::chrono::steady_clock::now();
+    currentTime = advanceSimulation(currentTime);
+
+    // Cigarette
+    glm::vec3 cigaretteBasePos = glm::vec3(-0.7f + busJogX, 0.38f + busJogY, -4.6f);
+    glm::vec3 cigaretteTargetPos = glm::vec3(-0.95f + busJogX, 0.38f + busJogY, -4.15f);
+    float smokingCycle = 10.0f; // total cycle in seconds
+    float timeInCycle = fmod(currentTime, smokingCycle);
+    float smokingDuration = 3.0f;
+    s.cigarettePosition = cigaretteBasePos;
+    if (timeInCycle < smokingDuration) {
+        // Normalize time in smoking duration to [0, 1]
+        float t = timeInCycle / smokingDuration;
+        // Use a smooth movement (sinusoidal) for back and forth
+        // sin(0) = 0, sin(pi/2) = 1 (at face), sin(pi) = 0 (back)
+        float moveFactor = sin(t * 3.14159f);
+        s.cigarettePosition = glm::mix(cigaretteBasePos, cigaretteTargetPos, moveFactor);
+    }
+
+    s.time = currentTime;
+    s.width = std::max(width, 1);
+    s.height = std::max(height, 1);
+    s.busJogX = busJogX;
+    s.busJogY = busJogY;
+    s.routeDistance = fleet.getRoute().routeDistance(currentStation, distanceTraveled);
+    s.sceneryToBus = sceneryToBus(fleet.getRoute(), s.routeDistance, sceneryConfig.worldScale);
+    s.trafficCount = traffic.count();
+    traffic.gatherNear(fleet.getRoute(), s.routeDistance, sceneryConfig.worldScale, 30.0f, 100.0f, s.trafficFrames, s.trafficModels);
+    s.doorAngle = doorProgress * -90.0f; // Opens 90 degrees outwards
+    s.wheelRotation = sin(wheelTime * 1.5f) * 15.0f; // Oscillation between -15 and 15 degrees
+    s.busStopped = busStopped;
+
+    s.projection = glm::perspective(glm::radians(camera.Zoom), (float)s.width / (float)s.height, 0.1f, 100.0f);
+    s.cameraPosition = camera.Position;
+    camera.Position += glm::vec3(busJogX, busJogY, 0.0f);
+    s.view = camera.GetViewMatrix();
+    camera.Position = s.cameraPosition;
+
+    preparePassengerTransforms(Frustum::fromMatrix(s.projection * s.view), s);
+    prepareControlTransform(s);
+    prepareFleetOffsets(s);
+
+    s.bus2D = glm::vec2(bus2DX, bus2DY);
+    s.controlInside = isControlInside;
+    s.passengers = numberOfPassengers;
+    s.tickets = numberOfTickets;
+    s.depthTest = depthTestEnabled;
+    s.faceCulling = faceCullingEnabled;
+    s.frameStats = frameStatsEnabled;
+    s.memoryOverlay = memoryOverlayEnabled;
+    s.shadowQuality = shadowQuality;
+    s.dynamicResolution = dynamicResolutionEnabled;
+    s.step = session.step;
+    TRACE_COUNTER("passengers", numberOfPassengers);
+    TRACE_FLOW_BEGIN("snapshot", s.step);
+    s.simMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - stepStart).count();
+}
+
+// Replays the loaded log with the simulation alone: no window, no GL, no pacing
+int runHeadlessReplay() {
+    initializeStations();
+    initFleet(session.header.fleetSize);
+    initTraffic(session.header.trafficCount, sceneryConfig.worldScale);
+    auto start = std::chrono::steady_clock::now();
+    while (!session.finished)
+        advanceSimulation(0.0f);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("Headless replay: %u steps in %.1f ms, %.3f ms per step\n", session.step, ms, ms / std::max(session.step, 1u));
+    return session.check.mismatches == 0 ? 0 : 1;
+}
+
+// Writes the report of a finished benchmark and compares it against the baseline, or with --write-baseline saves
+// it as the baseline. Returns 1 when a gated statistic regressed or there is no baseline to compare against.
+int finishBenchmark() {
+    BenchRun& b = bench;
+    b.report.set("rss_mb", toMegabytes(currentResidentBytes()));
+    b.report.set("peak_rss_mb", toMegabytes(peakResidentBytes()));
+    int handles = 0;
+    for (const auto& live : liveGLHandles) handles += live;
+    b.report.set("gl_handles", handles);
+    b.report.set("gpu_memory_mb", toMegabytes(memoryTracker.gpuBytes()));
+    b.report.set("peak_gpu_memory_mb", toMegabytes(memoryTracker.gpuPeakBytes()));
+    b.report.set("scenery_budget_kb", sceneryConfig.memoryBudget / 1024.0);
+
+    std::string name = b.scenario->name;
+    std::string json = b.report.toJson(name, b.scenario->seconds);
+    if (!b.outPath.empty())
+        b.report.write(b.outPath, name, b.scenario->seconds);
+    printf("Benchmark %s: %zu frames measured over %.0f simulated seconds\n", name.c_str(), b.report.frames(), b.scenario->seconds);
+    if (b.baselinePath.empty()) {
+        std::cout << json;
+        return 0;
+    }
+
+    if (b.writeBaseline) {
+        printf("Saving this run as the baseline at %s\n", b.baselinePath.c_str());
+        return b.report.write(b.baselinePath, name, b.scenario->seconds) ? 0 : 1;
+    }
+    std::ifstream file(b.baselinePath);
+    if (!file) {
+        printf("ERROR::BENCH:: No baseline at %s, record one with --write-baseline\n", b.baselinePath.c_str());
+        return 1;
+    }
+    std::stringstream baseline;
+    baseline << file.rdbuf();
+    static const std::vector<BenchGate> gates = {
+        { "frame_ms", "mean" }, { "frame_ms", "p95" }, { "frame_ms", "p99" }, { "gpu_frame_ms", "p95" },
+        { "sim_cpu_ms", "p95" }, { "render_cpu_ms", "p95" }, { "draw_calls", "mean" }, { "peak_rss_mb", "value" },
+    };
+    printf("Against %s, failing above +%.0f%%:\n", b.baselinePath.c_str(), b.threshold * 100.0);
+    int regressions = BenchReport::compare(json, baseline.str(), gates, b.threshold, 0.05);
+    printf("%s\n", regressions == 0 ? "No regressions" : "Benchmark regressed");
+    return regressions == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv)
 {
-    srand(time(NULL));
+    // --fleet N runs N buses on the route instead of one, --workers N sets the job system size (default: all cores),
+    // --serial simulates and renders one after another on the main thread instead of pipelining them,
+    // --hot-reload watches Shaders and Resources and swaps edited shaders and models in while running,
+    // --traffic N puts N ambient cars on the lanes beside the route (default 300),
+    // --capture PATH records every frame: "dir/" as PPM images, "*.y4m" as a raw stream, anything else through ffmpeg,
+    // --record FILE logs the seed and input of the session, --replay FILE plays such a log back and checks that every
+    // step reaches the recorded state, --headless with --replay does that without a window or GL, as fast as it can,
+    // --bench NAME runs a scripted scenario (idle, boarding, inspection, scenery, long-route) unpaced and reports frame
+    // time percentiles, per pass timings, draw calls and memory as JSON to --bench-out FILE, --baseline FILE compares
+    // them with an earlier report and exits with 1 when any grew by more than --bench-threshold PERCENT (default 10)
+    // or the file is missing, --write-baseline saves the report to the --baseline FILE instead,
+    // --gpu-budget MB and --ram-budget MB warn when the tracked GPU memory or the RAM kept by assets grows past them
+    // (6 shows the per-asset breakdown on screen, M writes it to memory.json),
+    // --textures LIST loads only these material texture types (diffuse, specular, normal, metalness, roughness,
+    // emissive, comma separated) instead of the ones basic.frag declares samplers for,
+    // in builds with BUS_TRACING: --trace FILE writes a Chrome/Perfetto trace of the last seconds at exit, T writes one
+    // on demand and --trace-budget MS whenever a frame takes longer than that
+    int fleetSize = 1;
+    int trafficCount = 300;
+    std::string capturePath;
+    std::string recordPath, replayPath;
+    bool headless = false;
+    std::string benchName;
+    std::string tracePath;
+    double traceBudgetMs = 0.0;
+    double gpuBudgetMb = 0.0, ramBudgetMb = 0.0;
+    std::string textureTypes;
+    unsigned workerCount = std::max(1u, std::thread::hardware_concurrency());
+    bool pipelined = true;
+    bool hotReload = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--fleet" && i + 1 < argc) fleetSize = std::max(1, atoi(argv[++i]));
+        else if (std::string(argv[i]) == "--workers" && i + 1 < argc) workerCount = std::max(1, atoi(argv[++i]));
+        else if (std::string(argv[i]) == "--traffic" && i + 1 < argc) trafficCount = std::max(0, atoi(argv[++i]));
+        else if (std::string(argv[i]) == "--capture" && i + 1 < argc) capturePath = argv[++i];
+        else if (std::string(argv[i]) == "--record" && i + 1 < argc) recordPath = argv[++i];
+        else if (std::string(argv[i]) == "--replay" && i + 1 < argc) replayPath = argv[++i];
+        else if (std::string(argv[i]) == "--bench" && i + 1 < argc) benchName = argv[++i];
+        else if (std::string(argv[i]) == "--bench-out" && i + 1 < argc) bench.outPath = argv[++i];
+        else if (std::string(argv[i]) == "--baseline" && i + 1 < argc) bench.baselinePath = argv[++i];
+        else if (std::string(argv[i]) == "--bench-threshold" && i + 1 < argc) bench.threshold = std::max(0.0, atof(argv[++i]) / 100.0);
+        else if (std::string(argv[i]) == "--trace" && i + 1 < argc) tracePath = argv[++i];
+        else if (std::string(argv[i]) == "--trace-budget" && i + 1 < argc) traceBudgetMs = std::max(0.0, atof(argv[++i]));
+        else if (std::string(argv[i]) == "--gpu-budget" && i + 1 < argc) gpuBudgetMb = std::max(0.0, atof(argv[++i]));
+        else if (std::string(argv[i]) == "--ram-budget" && i + 1 < argc) ramBudgetMb = std::max(0.0, atof(argv[++i]));
+        else if (std::string(argv[i]) == "--textures" && i + 1 < argc) textureTypes = argv[++i];
+        else if (std::string(argv[i]) == "--write-baseline") bench.writeBaseline = true;
+        else if (std::string(argv[i]) == "--headless") headless = true;
+        else if (std::string(argv[i]) == "--serial") pipelined = false;
+        else if (std::string(argv[i]) == "--hot-reload") hotReload = true;
+    }
+#ifdef BUS_TRACING
+    TRACE_THREAD("main");
+    Tracer::instance().configure(tracePath.empty() ? "trace.json" : tracePath, !tracePath.empty(), traceBudgetMs);
+#else
+    if (!tracePath.empty() || traceBudgetMs > 0.0)
+        std::cout << "Built without BUS_TRACING, --trace and --trace-budget are ignored" << std::endl;
+#endif
+    memoryTracker.setBudget(static_cast<size_t>(gpuBudgetMb * 1024 * 1024), static_cast<size_t>(ramBudgetMb * 1024 * 1024));
+    // models only decode the texture types the shader they are drawn with samples
+    if (textureTypes.empty())
+        modelMaterialRequirements = MaterialRequirements::fromShader("../Shaders/basic.frag");
+    else if (!MaterialRequirements::fromList(textureTypes, modelMaterialRequirements))
+        return -1;
+    std::cout << "Material textures loaded: " << modelMaterialRequirements.describe() << std::endl;
+    jobs = std::make_unique<JobSystem>(workerCount);
+
+    // a replay takes the seed and the setup of the recorded run
+    session.header.seed = static_cast<uint32_t>(time(NULL));
+    if (!replayPath.empty()) {
+        if (!session.log.load(replayPath)) return -1;
+        session.mode = SessionMode::Replay;
+        session.header = session.log.header;
+        fleetSize = session.header.fleetSize;
+        trafficCount = session.header.trafficCount;
+    } else if (!benchName.empty()) {
+        for (const BenchScenario& scenario : benchScenarios)
+            if (benchName == scenario.name) bench.scenario = &scenario;
+        if (!bench.scenario) {
+            std::cout << "Unknown benchmark " << benchName << ", one of:";
+            for (const BenchScenario& scenario : benchScenarios) std::cout << " " << scenario.name;
+            std::cout << std::endl;
+            return -1;
+        }
+        if (bench.writeBaseline && bench.baselinePath.empty()) {
+            std::cout << "--write-baseline needs --baseline FILE" << std::endl;
+            return -1;
+        }
+        // a gate without its baseline would pass every time, so it fails before the run instead
+        if (!bench.writeBaseline && !bench.baselinePath.empty() && !std::ifstream(bench.baselinePath)) {
+            printf("ERROR::BENCH:: No baseline at %s, record one with --write-baseline\n", bench.baselinePath.c_str());
+            return 1;
+        }
+        // the same work every run: fixed seed, one step per frame, no pacing, nothing that adapts to the timings
+        session.mode = SessionMode::Bench;
+        session.header.seed = 1;
+        bench.totalSteps = static_cast<uint32_t>(bench.scenario->seconds / session.header.stepSeconds);
+        fleetSize = bench.scenario->fleetSize;
+        trafficCount = bench.scenario->trafficCount;
+        shadowQuality = bench.scenario->shadowQuality;
+        dynamicResolutionEnabled = false;
+        pipelined = false;
+        capturePath.clear();
+    } else if (!recordPath.empty()) {
+        session.header.fleetSize = fleetSize;
+        session.header.trafficCount = trafficCount;
+        if (!session.recorder.open(recordPath, session.header)) return -1;
+        session.mode = SessionMode::Record;
+    }
+    srand(session.header.seed);
+    if (headless) {
+        if (session.mode != SessionMode::Replay) {
+            std::cout << "--headless needs --replay FILE" << std::endl;
+            return -1;
+        }
+        int result = runHeadlessReplay();
+        jobs.reset();
+#ifdef BUS_TRACING
+        Tracer::instance().finish();
+#endif
+        return result;
+    }
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -910,18 +1445,86 @@ int main()
     if (window == NULL) return endProgram("Prozor nije uspeo da se kreira.");
     glfwMakeContextCurrent(window);
     glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetMouseButtonCallback(window, passengersInputCallback);
-    glfwSetKeyCallback(window, controlInputCallback);
+    glfwSetMouseButtonCallback(window, mouseButtonCallback);
+    glfwSetKeyCallback(window, keyCallback);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     if (glewInit() != GLEW_OK) return endProgram("GLEW nije uspeo da se inicijalizuje.");
 
+    int result = runSimulator(window, fleetSize, trafficCount, pipelined, hotReload, capturePath);
+    // every GL handle is gone by now, anything still counted leaked
+    reportLeakedGLHandles();
+    jobs.reset();
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+#ifdef BUS_TRACING
+    Tracer::instance().finish();
+#endif
+    return result;
+}
+
+// Everything that owns GL objects lives in this scope, so it is released before the context is destroyed.
+int runSimulator(GLFWwindow* window, int fleetSize, int trafficCount, bool pipelined, bool hotReload, const std::string& capturePath)
+{
+    // a benchmark measures the frames themselves, not the refresh rate
+    if (session.mode == SessionMode::Bench) glfwSwapInterval(0);
+
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+    // the models come first, their materials decide which shader variants the program build below includes
+    for (int i = 1; i <= 15; i++) {
+        std::string path = "../Resources/person" + std::to_string(i) + "/model.obj";
+        personModels.push_back(std::make_unique<Model>(path, false, &staticMeshArena(), keepModelCpuData));
+    }
+    controlModel = std::make_unique<Model>("../Resources/control/control.obj", false, &staticMeshArena(), keepModelCpuData);
+    for (auto& m : personModels)
+        personBounds.push_back(m->bounds);
+    Model tree("../Resources/tree/Tree.obj", false, &staticMeshArena(), keepModelCpuData);
+    Model lamborghini("../Resources/lamborghini/2021_lamborghini_countach_lpi_800-4.obj", false, &staticMeshArena(), keepModelCpuData);
+    Model porsche("../Resources/porsche/free_porsche_911_carrera_4s.obj", false, &staticMeshArena(), keepModelCpuData);
+    Model wheel("../Resources/wheel/merc steering.obj", false, &staticMeshArena(), keepModelCpuData);
+    Model cigarette("../Resources/cigarette/CHAHIN_CIGARETTE_BUTT.obj", false, &staticMeshArena(), keepModelCpuData);
+
+    // every program is built up front so the driver can compile them side by side, or load them from the cache
+    ProgramCache programCache("../ShaderCache");
+    size_t simpleTextureProgram = programCache.add("../Shaders/simple_texture.vert", "../Shaders/simple_texture.frag");
+    size_t bus2DProgram = programCache.add("../Projekat2D/Shaders/bus.vert", "../Projekat2D/Shaders/bus.frag");
+    size_t station2DProgram = programCache.add("../Projekat2D/Shaders/station.vert", "../Projekat2D/Shaders/station.frag");
+    size_t path2DProgram = programCache.add("../Projekat2D/Shaders/path.vert", "../Projekat2D/Shaders/path.frag");
+    size_t fleet2DProgram = programCache.add("../Shaders/bus_fleet.vert", "../Shaders/bus_fleet.frag");
+    size_t textProgram = programCache.add("../Projekat2D/Shaders/text.vert", "../Projekat2D/Shaders/text.frag");
+    size_t shadowDepthProgram = programCache.add("../Shaders/shadow_depth.vert", "../Shaders/shadow_depth.frag");
+
+    // every variant of basic.vert/frag the scene draws with is built here; any other one on first use
+    ShaderVariants unifiedShader(programCache, "../Shaders/basic.vert", "../Shaders/basic.frag");
+    // bus boxes, the screen, the windshield, the lights and the traffic boxes
+    for (unsigned features : { 0u, unsigned(FEATURE_DIFFUSE_MAP), unsigned(FEATURE_ALPHA_BLEND), unsigned(FEATURE_EMISSIVE),
+                               unsigned(FEATURE_INSTANCING) })
+        unifiedShader.prebuild(features);
+    auto prebuildModel = [&](const Model& model, unsigned features) {
+        for (unsigned set : model.shaderFeatureSets(features))
+            unifiedShader.prebuild(set);
+    };
+    for (auto& m : personModels)
+        prebuildModel(*m, 0);
+    for (const Model* m : { controlModel.get(), &wheel, &cigarette, &lamborghini, &porsche })
+        prebuildModel(*m, 0);
+    prebuildModel(lamborghini, FEATURE_INSTANCING);
+    prebuildModel(porsche, FEATURE_INSTANCING);
+    prebuildModel(tree, FEATURE_INSTANCING | FEATURE_VEGETATION);
+    {
+        TRACE_ZONE("shader builds");
+        programCache.build();
+    }
+    std::cout << "Shader programs:" << std::endl;
+    programCache.printReport();
+    unifiedShader.adopt();
+
     preprocessTexture(signatureTex, "../Resources/signature.png");
 
-    unsigned int simpleTextureShader = createShader("../Shaders/simple_texture.vert", "../Shaders/simple_texture.frag");
+    GLProgram simpleTextureShader = programCache.take(simpleTextureProgram);
     glUseProgram(simpleTextureShader);
     glUniform1i(glGetUniformLocation(simpleTextureShader, "signatureTex"), 0);
 
@@ -953,24 +1556,38 @@ int main()
     };
     formVAO3D(rectVertices, sizeof(rectVertices), rectVAO, rectVBO);
 
-    unsigned int busColorTex = createColorTexture(0.3f, 0.3f, 0.3f); // Grey-ish bus
-    unsigned int windshieldTex = createColorTexture(0.1f, 0.1f, 0.1f, 0.5f); // Light transparent
-    unsigned int controlPanelTex = createColorTexture(1.0f, 0.0f, 0.0f); // Red
-    unsigned int wheelTex = createColorTexture(0.15f, 0.15f, 0.15f); // Dark gray
-    unsigned int doorTex = createColorTexture(0.2f, 0.6f, 0.3f); // Dark doors
-    unsigned int lightTex = createColorTexture(lightColor.r, lightColor.g, lightColor.b); // Light source color
+    // solid colours go to the untextured shader variants as uAlbedo instead of through 1x1 textures
+    const glm::vec4 busColor(0.3f, 0.3f, 0.3f, 1.0f); // Grey-ish bus
+    const glm::vec4 windshieldColor(0.1f, 0.1f, 0.1f, 0.5f); // Light transparent
+    const glm::vec4 controlPanelColor(1.0f, 0.0f, 0.0f, 1.0f); // Red
+    const glm::vec4 wheelColor(0.15f, 0.15f, 0.15f, 1.0f); // Dark gray
+    const glm::vec4 doorColor(0.2f, 0.6f, 0.3f, 1.0f); // Dark doors
+    const glm::vec4 lightSourceColor(lightColor, 1.0f); // Light source color
 
-    setupFBO();
+    PanelRenderTarget panelTarget;
+    unsigned long long panelPixelsShaded = 0;   // since the last stats report
     preprocessTexture(bus2DTex, "../Projekat2D/Resources/bus.png");
     preprocessTexture(doorsClosedTex, "../Projekat2D/Resources/doors_closed.png");
     preprocessTexture(doorsOpenTex, "../Projekat2D/Resources/doors_open.png");
     preprocessTexture(control2DTex, "../Projekat2D/Resources/bus_control.png");
 
-    unsigned int bus2DShader = createShader("../Projekat2D/Shaders/bus.vert", "../Projekat2D/Shaders/bus.frag");
-    unsigned int station2DShader = createShader("../Projekat2D/Shaders/station.vert", "../Projekat2D/Shaders/station.frag");
-    unsigned int path2DShader = createShader("../Projekat2D/Shaders/path.vert", "../Projekat2D/Shaders/path.frag");
+    GLProgram bus2DShader = programCache.take(bus2DProgram);
+    GLProgram station2DShader = programCache.take(station2DProgram);
+    GLProgram path2DShader = programCache.take(path2DProgram);
+    GLProgram fleet2DShader = programCache.take(fleet2DProgram);
 
     initializeStations();
+    initFleet(fleetSize);
+    initTraffic(trafficCount, sceneryConfig.worldScale);
+
+    // chunks are built on the streamer's thread, their road goes into one buffer slot per pooled chunk
+    SceneryStreamer scenery(fleet.getRoute(), sceneryConfig);
+    unsigned int roadVAO, roadVBO;
+    formVAO3D(NULL, scenery.poolSize() * SceneryChunk::ROAD_VERTICES * 8 * sizeof(float), roadVAO, roadVBO);
+    memoryTracker.track(MemoryTracker::BUFFER, roadVBO, scenery.poolSize() * SceneryChunk::ROAD_VERTICES * 8 * sizeof(float), MemoryCategory::Streaming, "scenery");
+    const glm::vec4 roadColor(0.25f, 0.25f, 0.27f, 1.0f);
+    const glm::vec3 sceneryWind = glm::normalize(glm::vec3(1.0f, 0.0f, 0.4f)) * 0.35f;
+    scenery.start();
 
     float verticesBus2D[] = {
         -0.06f, 0.1f, 0.0f, 1.0f,
@@ -981,6 +1598,16 @@ int main()
     unsigned int VAOBus2D, VBOBus2D;
     formVAOTexture(verticesBus2D, sizeof(verticesBus2D), VAOBus2D, VBOBus2D);
 
+    // same quad as the driven bus plus one offset per instance
+    unsigned int VAOfleet2D, VBOfleet2D;
+    formVAOTexture(verticesBus2D, sizeof(verticesBus2D), VAOfleet2D, VBOfleet2D);
+    fleetInstanceVBO = GLBuffer::create();
+    glBindBuffer(GL_ARRAY_BUFFER, fleetInstanceVBO);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
     float verticesStation2D[42 * 2];
     float xc2D = 0.0f, yc2D = 0.0f, r2D = 0.1f;
     float aspect2D = (float)FBO_WIDTH / (float)FBO_HEIGHT;
@@ -1014,24 +1641,97 @@ int main()
 
     init2DPaths();
 
-    for (int i = 1; i <= 15; i++) {
-        std::string path = "../Resources/person" + std::to_string(i) + "/model.obj";
-        personModels.push_back(new Model(path));
-    }
-    controlModel = new Model("../Resources/control/control.obj");
-
-    textShader = createShader("../Projekat2D/Shaders/text.vert", "../Projekat2D/Shaders/text.frag");
+    textShader = programCache.take(textProgram).release();
     initFreeType("../Projekat2D/Resources/font.ttf");
 
-    Shader unifiedShader("../Shaders/basic.vert", "../Shaders/basic.frag");
-    unifiedShader.use();
-    unifiedShader.setInt("uDiffMap1", 0);
-
-    Model tree("../Resources/tree/Tree.obj");
-    Model lamborghini("../Resources/lamborghini/2021_lamborghini_countach_lpi_800-4.obj");
-    Model porsche("../Resources/porsche/free_porsche_911_carrera_4s.obj");
-    Model wheel("../Resources/wheel/merc steering.obj");
-    Model cigarette("../Resources/cigarette/CHAHIN_CIGARETTE_BUTT.obj");
+    unifiedShader.setVec3("uClusterGrid", glm::vec3(LightClusters::GRID_X, LightClusters::GRID_Y, LightClusters::GRID_Z));
+    unifiedShader.setInt("uClusterTable", ClusterBuffers::TABLE_UNIT);
+    unifiedShader.setInt("uLightIndices", ClusterBuffers::INDEX_UNIT);
+    unifiedShader.setInt("uLightData", ClusterBuffers::LIGHT_UNIT);
+
+    std::vector<PointLight> sceneLights;
+    LightClusters lightClusters;
+    ClusterBuffers clusterBuffers;
+
+    // only the roof light (scene light 0) casts shadows, its reach is the far plane of the cube
+    CubeShadowMap shadowMap(512, 0.05f, lightRange);
+    PortalVisibility busPortals = makeBusPortals();
+    Shader shadowDepthShader(programCache.take(shadowDepthProgram));
+    unifiedShader.setInt("uShadowMap", CubeShadowMap::UNIT);
+    unifiedShader.setVec2("uShadowPlanes", shadowMap.planes());
+
+    // dynamic resolution: the scene target, the GPU frame time it is steered by and the controller
+    ScaledRenderTarget sceneTarget;
+    GpuFrameTimer frameTimer;
+    ResolutionController resolution;
+
+    // session recording, read back without stalls and written on its own thread
+    std::unique_ptr<FrameCapture> frameCapture;
+    if (!capturePath.empty())
+        frameCapture = std::make_unique<FrameCapture>(capturePath);
+
+    // every roadside tree is an instance of the one tree mesh
+    VegetationRenderer treeRenderer(tree);
+    VegetationSelection treeSelection;
+    // traffic shares the parked car models, far away cars are boxes
+    Model* trafficModels[TrafficRenderer::MODELS] = { &lamborghini, &porsche };
+    TrafficRenderer trafficRenderer(trafficModels, cubeVBO);
+    const glm::vec4 trafficBoxColor(0.35f, 0.38f, 0.45f, 1.0f);
+
+    std::cout << "Models loaded: RSS " << toMegabytes(currentResidentBytes()) << " MB, peak "
+              << toMegabytes(peakResidentBytes()) << " MB" << std::endl;
+
+    // Reloaded programs and models replace the live ones between frames, on the render thread.
+    HotReloader hotReloader;
+    if (hotReload) {
+        auto watchProgram = [&](const char* vs, const char* fs, GLProgram& target) {
+            hotReloader.watchProgram(vs, fs, [&target](GLProgram p) { target = std::move(p); });
+        };
+        auto watchModel = [&](const std::string& path, Model& target) {
+            hotReloader.watchModel(path, [&target](ModelData&& d) {
+                target = Model(std::move(d), false, &staticMeshArena(), keepModelCpuData);
+            });
+        };
+        hotReloader.watchProgram("../Shaders/simple_texture.vert", "../Shaders/simple_texture.frag", [&](GLProgram p) {
+            simpleTextureShader = std::move(p);
+            glUseProgram(simpleTextureShader);
+            glUniform1i(glGetUniformLocation(simpleTextureShader, "signatureTex"), 0);
+        });
+        watchProgram("../Projekat2D/Shaders/bus.vert", "../Projekat2D/Shaders/bus.frag", bus2DShader);
+        watchProgram("../Projekat2D/Shaders/station.vert", "../Projekat2D/Shaders/station.frag", station2DShader);
+        watchProgram("../Projekat2D/Shaders/path.vert", "../Projekat2D/Shaders/path.frag", path2DShader);
+        watchProgram("../Shaders/bus_fleet.vert", "../Shaders/bus_fleet.frag", fleet2DShader);
+        hotReloader.watchProgram("../Projekat2D/Shaders/text.vert", "../Projekat2D/Shaders/text.frag", [](GLProgram p) {
+            glDeleteProgram(textShader);
+            textShader = p.release();
+        });
+        hotReloader.watchProgram("../Shaders/shadow_depth.vert", "../Shaders/shadow_depth.frag", [&](GLProgram p) {
+            shadowDepthShader = Shader(std::move(p));
+            shadowMap.invalidate();
+        });
+        hotReloader.watchSources("../Shaders/basic.vert", "../Shaders/basic.frag", [&](std::string vs, std::string fs) {
+            return unifiedShader.reload(std::move(vs), std::move(fs));
+        });
+
+        for (int i = 0; i < static_cast<int>(personModels.size()); i++) {
+            hotReloader.watchModel("../Resources/person" + std::to_string(i + 1) + "/model.obj", [i](ModelData&& d) {
+                *personModels[i] = Model(std::move(d), false, &staticMeshArena(), keepModelCpuData);
+                std::lock_guard<std::mutex> lock(personBoundsMutex);
+                personBounds[i] = personModels[i]->bounds;
+            });
+        }
+        watchModel("../Resources/control/control.obj", *controlModel);
+        watchModel("../Resources/tree/Tree.obj", tree);
+        watchModel("../Resources/lamborghini/2021_lamborghini_countach_lpi_800-4.obj", lamborghini);
+        watchModel("../Resources/porsche/free_porsche_911_carrera_4s.obj", porsche);
+        // the wheel is cached in the static shadow map
+        hotReloader.watchModel("../Resources/wheel/merc steering.obj", [&](ModelData&& d) {
+            wheel = Model(std::move(d), false, &staticMeshArena(), keepModelCpuData);
+            shadowMap.invalidate();
+        });
+        watchModel("../Resources/cigarette/CHAHIN_CIGARETTE_BUTT.obj", cigarette);
+        hotReloader.start({ "../Shaders", "../Projekat2D/Shaders", "../Resources" });
+    }
 
     camera.Position = glm::vec3(-1.0f, 0.5f, -4.0f);
 
@@ -1039,321 +1739,459 @@ int main()
     glEnable(GL_DEPTH_TEST);
     glCullFace(GL_BACK);
 
-    while (!glfwWindowShouldClose(window))
-    {
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-            glfwSetWindowShouldClose(window, true);
-
-        static bool key1Pressed = false;
-        if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS) {
-            if (!key1Pressed) {
-                depthTestEnabled = !depthTestEnabled;
-                if (depthTestEnabled) glEnable(GL_DEPTH_TEST);
-                else glDisable(GL_DEPTH_TEST);
-                key1Pressed = true;
-            }
-        } else {
-            key1Pressed = false;
-        }
-
-        static bool key2Pressed = false;
-        if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS) {
-            if (!key2Pressed) {
-                faceCullingEnabled = !faceCullingEnabled;
-                if (faceCullingEnabled) glEnable(GL_CULL_FACE);
-                else glDisable(GL_CULL_FACE);
-                key2Pressed = true;
-            }
-        } else {
-            key2Pressed = false;
-        }
-
-        updateBusLogic();
-        processPassengersLogic();
-
-        // Calculate bus jogging
-        if (!busStopped) {
-            float time = (float)glfwGetTime();
-            busJogY = sin(time * 10.0f) * 0.02f; // Up-down
-            busJogX = cos(time * 7.0f) * 0.01f;  // Slight left-right
-            
-            static float sceneTime = 0.0f;
-            sceneTime += deltaTime;
-            sceneOffset = sin(sceneTime * 0.2f) * 15.0f; // Move scene left-right (slower and less range)
-        } else {
-            busJogY = 0.0f;
-            busJogX = 0.0f;
+    // Draws one snapshot. All GL work of a frame happens here, on whichever thread owns the context.
+    auto renderFrame = [&](const FrameSnapshot& s) {
+        TRACE_ZONE("renderFrame");
+        TRACE_FLOW_END("snapshot", s.step);
+        auto renderStart = std::chrono::steady_clock::now();
+        hotReloader.applyPending();
+        if (s.depthTest) glEnable(GL_DEPTH_TEST);
+        else glDisable(GL_DEPTH_TEST);
+        if (s.faceCulling) glEnable(GL_CULL_FACE);
+        else glDisable(GL_CULL_FACE);
+
+        // the scale for this frame comes from the GPU time of one a few frames back
+        bool gpuFrameMeasured = frameTimer.collect();
+        if (gpuFrameMeasured && s.dynamicResolution)
+            resolution.update(frameTimer.lastMs());
+        frameTimer.begin();
+
+        // the panel texture is drawn at about the size it covers on screen, and less often when that is small
+        glm::mat4 toWorld = busToWorld(s);
+        glm::mat4 screenModel = toWorld * controlPanelScreen();
+        float panelPixels = PanelRenderTarget::projectedSize(s.projection * s.view, screenModel, s.width, s.height);
+        renderControlPanelToFBO(bus2DShader, station2DShader, path2DShader, simpleTextureShader, fleet2DShader,
+                                VAOBus2D, VAOstations2D, VAOdoors2D, VAOcontrol2D, VAOsignature, VAOfleet2D,
+                                panelTarget, panelPixels, s);
+        panelPixelsShaded += panelTarget.pixelsShaded();
+
+        // Shadows of the roof light. The shell, panel and wheel (in its rest pose) never move in bus space and
+        // come from the cached cube; people, the door and the cigarette are drawn on top every frame.
+        if (s.shadowQuality > 0) {
+            TRACE_ZONE("shadows");
+            shadowDepthShader.use();
+            auto drawStatic = [&](const glm::mat4& face) {
+                shadowDepthShader.setMat4("uLightViewProjection", face);
+                bindVertexArray(cubeVAO);
+                for (const glm::mat4& box : busShellBoxes()) {
+                    shadowDepthShader.setMat4("uM", box);
+                    drawArrays(GL_TRIANGLES, 0, 36);
+                }
+                shadowDepthShader.setMat4("uM", controlPanelBox());
+                drawArrays(GL_TRIANGLES, 0, 36);
+                shadowDepthShader.setMat4("uM", steeringWheelTransform(0.0f));
+                wheel.DrawGeometry();
+            };
+            auto drawDynamic = [&](const glm::mat4& face, const Frustum& frustum) {
+                unsigned drawn = 0;
+                auto drawCaster = [&](Model& caster, const BoundingSphere& bounds, const glm::mat4& model) {
+                    if (!frustum.intersects(transformSphere(bounds, model))) return;
+                    shadowDepthShader.setMat4("uM", model);
+                    caster.DrawGeometry();
+                    drawn++;
+                };
+                shadowDepthShader.setMat4("uLightViewProjection", face);
+                glm::mat4 door = toWorld * doorBox(s.doorAngle);
+                if (frustum.intersects(transformSphere({ glm::vec3(0.0f), 0.87f }, door))) {
+                    shadowDepthShader.setMat4("uM", door);
+                    bindVertexArray(cubeVAO);
+                    drawArrays(GL_TRIANGLES, 0, 36);
+                    drawn++;
+                }
+                for (size_t i = 0; i < s.passengerTransforms.size(); i++) {
+                    if (!s.passengerCastsShadow[i]) continue;
+                    Model& person = *personModels[s.passengerModels[i]];
+                    drawCaster(person, person.bounds, s.passengerTransforms[i]);
+                }
+                if (s.controlVisible)
+                    drawCaster(*controlModel, controlModel->bounds, s.controlTransform);
+                drawCaster(cigarette, cigarette.bounds, cigaretteTransform(s.cigarettePosition));
+                return drawn;
+            };
+            shadowMap.render(lightPos, glm::vec3(toWorld * glm::vec4(lightPos, 1.0f)), drawStatic, drawDynamic);
         }
 
-        renderControlPanelToFBO(bus2DShader, station2DShader, path2DShader, simpleTextureShader, 
-                                VAOBus2D, VAOstations2D, VAOdoors2D, VAOcontrol2D, VAOsignature);
-
-        int width, height;
-        glfwGetFramebufferSize(window, &width, &height);
-        glViewport(0, 0, width, height);
+        // the 3D scene goes to the scaled target, the signature on top is drawn at full size after the upscale
+        TRACE_ZONE_NAMED(sceneZone, "scene");
+        bool scaled = s.dynamicResolution && sceneTarget.begin(s.width, s.height, resolution.scale());
+        if (!scaled) glViewport(0, 0, s.width, s.height);
+        glm::vec2 sceneSize = scaled ? glm::vec2(sceneTarget.drawnWidth(), sceneTarget.drawnHeight()) : glm::vec2(s.width, s.height);
 
         glClearColor(0.3f, 0.4f, 0.8f, 1.0f); // kind of sky color
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        unifiedShader.use();
-        unifiedShader.setVec3("uLightPos", lightPos);
-        unifiedShader.setVec3("uViewPos", camera.Position);
-        unifiedShader.setVec3("uLightColor", lightColor);
-        unifiedShader.setFloat("uLightIntensity", lightIntensity);
-        
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)width / (float)height, 0.1f, 100.0f);
-        unifiedShader.setMat4("uP", projection);
-
-        glm::vec3 originalCamPos = camera.Position;
-        camera.Position += glm::vec3(busJogX, busJogY, 0.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        unifiedShader.setMat4("uV", view);
-        camera.Position = originalCamPos;
-
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(sceneOffset, -1.0f, -15.0f));
-        unifiedShader.setMat4("uM", model);
-        tree.Draw(unifiedShader);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(sceneOffset + 18.0f, 0.5f, -40.0f));
-        model = glm::scale(model, glm::vec3(1.2f));
-        unifiedShader.setMat4("uM", model);
-        lamborghini.Draw(unifiedShader);
+        scenery.update(s.routeDistance);
+        glBindBuffer(GL_ARRAY_BUFFER, roadVBO);
+        for (const SceneryChunk* chunk : scenery.activatedChunks())
+            glBufferSubData(GL_ARRAY_BUFFER, chunk->slot * SceneryChunk::ROAD_VERTICES * 8 * sizeof(float),
+                            chunk->road.size() * sizeof(float), chunk->road.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        size_t lightBulbs = gatherSceneLights(s, scenery.residentChunks(), sceneLights);
+        lightClusters.build(sceneLights, s.view, s.projection);
+        clusterBuffers.upload(lightClusters);
+        clusterBuffers.bind();
+        unifiedShader.setVec2("uClusterDepth", lightClusters.sliceParams());
+        unifiedShader.setVec2("uViewportSize", sceneSize);
+        shadowMap.bind();
+        unifiedShader.setInt("uShadowLight", s.shadowQuality > 0 ? 0 : -1);
+        unifiedShader.setInt("uShadowTaps", shadowTaps[s.shadowQuality]);
+
+        unifiedShader.setVec3("uViewPos", s.cameraPosition);
+        unifiedShader.setMat4("uP", s.projection);
+        unifiedShader.setMat4("uV", s.view);
+
+        // Scenery outside the bus is only drawn when it shows through the windshield or the door
+        busPortals.update(toWorld, s.projection, s.view, glm::vec3(toWorld * glm::vec4(s.cameraPosition, 1.0f)));
+        unsigned exteriorDrawn = 0, exteriorTotal = 0;
+        auto exteriorVisible = [&](const BoundingSphere& bounds) {
+            exteriorTotal++;
+            bool visible = busPortals.visible(bounds);
+            exteriorDrawn += visible;
+            return visible;
+        };
 
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(sceneOffset - 18.0f, 0.5f, -40.0f));
-        model = glm::scale(model, glm::vec3(1.2f)); // Larger to compensate for distance
-        unifiedShader.setMat4("uM", model);
-        porsche.Draw(unifiedShader);
+        Model* sceneryModels[] = { &lamborghini, &porsche };
+        glm::mat4 model;
+        glm::vec3 eye = glm::vec3(toWorld * glm::vec4(s.cameraPosition, 1.0f));
+        treeSelection.clear();
+        size_t treePlacements = 0;
+        for (const SceneryChunk* chunk : scenery.residentChunks()) {
+            treePlacements += chunk->trees.size();
+            if (!exteriorVisible(transformSphere(chunk->bounds, s.sceneryToBus))) continue;
+            unifiedShader.setVec4("uAlbedo", roadColor);
+            unifiedShader.setMat4("uM", s.sceneryToBus);
+            unifiedShader.use(0);
+            bindVertexArray(roadVAO);
+            drawArrays(GL_TRIANGLES, chunk->slot * SceneryChunk::ROAD_VERTICES, SceneryChunk::ROAD_VERTICES);
+
+            for (const SceneryItem& item : chunk->items) {
+                Model& itemModel = *sceneryModels[item.kind];
+                model = s.sceneryToBus * item.transform;
+                if (!exteriorVisible(transformSphere(itemModel.bounds, model))) continue;
+                unifiedShader.setMat4("uM", model);
+                itemModel.Draw(unifiedShader);
+            }
+            treeSelection.add(chunk->trees, s.sceneryToBus, tree.bounds, eye,
+                              [&](const BoundingSphere& bounds) { return busPortals.visible(bounds); });
+        }
+        unifiedShader.setFloat("uTime", s.time);
+        unifiedShader.setVec3("uWind", glm::mat3(s.sceneryToBus) * sceneryWind);
+        unsigned callsBeforeTrees = frameStats.drawCalls;
+        treeRenderer.draw(unifiedShader, treeSelection);
+        unsigned treeDrawCalls = frameStats.drawCalls - callsBeforeTrees;
+
+        // cars within trafficDetailDistance of the eye keep their model, the rest become boxes
+        const float trafficDetailDistance = 45.0f;
+        const glm::mat4 trafficModelScale = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.5f, 0.0f)), glm::vec3(1.2f));
+        const glm::mat4 trafficBox = placeBox(glm::vec3(0.0f, sceneryConfig.roadHeight + 0.65f, 0.0f), glm::vec3(2.0f, 1.3f, 4.5f));
+        trafficRenderer.clear();
+        for (size_t i = 0; i < s.trafficFrames.size(); i++) {
+            glm::mat4 frame = s.sceneryToBus * s.trafficFrames[i];
+            glm::vec3 d = glm::vec3(frame[3]) - eye;
+            if (glm::dot(d, d) < trafficDetailDistance * trafficDetailDistance) {
+                Model& carModel = *trafficModels[s.trafficModels[i]];
+                model = frame * trafficModelScale;
+                if (exteriorVisible(transformSphere(carModel.bounds, model)))
+                    trafficRenderer.addModel(s.trafficModels[i], model);
+            } else {
+                model = frame * trafficBox;
+                if (exteriorVisible({ glm::vec3(model[3]), 2.6f }))
+                    trafficRenderer.addBox(model);
+            }
+        }
+        unsigned callsBeforeTraffic = frameStats.drawCalls;
+        trafficRenderer.draw(unifiedShader, trafficBoxColor);
+        unsigned trafficDrawCalls = frameStats.drawCalls - callsBeforeTraffic;
 
         // Render Bus Body (main shell)
-        glBindVertexArray(cubeVAO);
-        glActiveTexture(GL_TEXTURE0);
-
-        glBindTexture(GL_TEXTURE_2D, busColorTex);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(busJogX, -1.0f + busJogY, 0.0f));
-        model = glm::scale(model, glm::vec3(4.0f, 0.1f, 10.0f));
-        unifiedShader.setMat4("uM", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-2.0f + busJogX, 0.5f + busJogY, 0.0f));
-        model = glm::scale(model, glm::vec3(0.1f, 3.0f, 10.0f));
-        unifiedShader.setMat4("uM", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(2.0f + busJogX, 0.5f + busJogY, 1.0f));
-        model = glm::scale(model, glm::vec3(0.1f, 3.0f, 8.0f));
-        unifiedShader.setMat4("uM", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(busJogX, 2.0f + busJogY, 0.0f));
-        model = glm::scale(model, glm::vec3(4.0f, 0.1f, 10.0f));
-        unifiedShader.setMat4("uM", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        bindVertexArray(cubeVAO);
+        unifiedShader.setVec4("uAlbedo", busColor);
 
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(busJogX, 0.5f + busJogY, 5.0f));
-        model = glm::scale(model, glm::vec3(4.0f, 3.0f, 0.1f));
-        unifiedShader.setMat4("uM", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(busJogX, -0.25f + busJogY, -5.0f));
-        model = glm::scale(model, glm::vec3(4.0f, 1.5f, 0.1f));
-        unifiedShader.setMat4("uM", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-        float doorSpeed = 2.0f; 
-        if (busStopped) {
-            doorProgress += deltaTime * doorSpeed;
-            if (doorProgress > 1.0f) doorProgress = 1.0f;
-        } else {
-            doorProgress -= deltaTime * doorSpeed;
-            if (doorProgress < 0.0f) doorProgress = 0.0f;
+        for (const glm::mat4& box : busShellBoxes()) {
+            unifiedShader.setMat4("uM", toWorld * box);
+            unifiedShader.use(0);
+            drawArrays(GL_TRIANGLES, 0, 36);
         }
 
-        glBindTexture(GL_TEXTURE_2D, doorTex);
-        model = glm::mat4(1.0f);
-        float doorAngle = doorProgress * -90.0f; // Opens 90 degrees outwards
-        model = glm::translate(model, glm::vec3(2.0f + busJogX, 0.5f + busJogY, -3.0f)); 
-        model = glm::rotate(model, glm::radians(doorAngle), glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, -1.0f)); 
-        model = glm::scale(model, glm::vec3(0.1f, 3.0f, 2.0f));
-        unifiedShader.setMat4("uM", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        unifiedShader.setVec4("uAlbedo", doorColor);
+        unifiedShader.setMat4("uM", toWorld * doorBox(s.doorAngle));
+        unifiedShader.use(0);
+        drawArrays(GL_TRIANGLES, 0, 36);
 
-        glBindTexture(GL_TEXTURE_2D, controlPanelTex);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(busJogX, busJogY, -4.8f)); 
-        model = glm::scale(model, glm::vec3(1.0f, 0.6f, 0.1f));
-        unifiedShader.setMat4("uM", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        unifiedShader.setVec4("uAlbedo", controlPanelColor);
+        unifiedShader.setMat4("uM", toWorld * controlPanelBox());
+        unifiedShader.use(0);
+        drawArrays(GL_TRIANGLES, 0, 36);
 
-        unifiedShader.setFloat("uLightIntensity", 5.0f); // Make it bright
-        glBindTexture(GL_TEXTURE_2D, lightTex);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, lightPos);
+        // the light source glows in its own colour, no lighting pass
+        unifiedShader.setVec4("uAlbedo", lightSourceColor);
+        model = glm::translate(toWorld, lightPos);
         model = glm::scale(model, glm::vec3(0.2f)); 
         unifiedShader.setMat4("uM", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        unifiedShader.setFloat("uLightIntensity", lightIntensity);
-
-        glBindTexture(GL_TEXTURE_2D, fboTex);
-        glBindVertexArray(rectVAO);
-        glm::mat4 screenModel = glm::mat4(1.0f);
-        screenModel = glm::translate(screenModel, glm::vec3(busJogX, busJogY, -4.8f)); 
-        screenModel = glm::scale(screenModel, glm::vec3(1.0f, 0.6f, 0.1f));
-        screenModel = glm::translate(screenModel, glm::vec3(0.0f, 0.0f, 0.501f)); // Slightly in front of the cube face
+        unifiedShader.use(FEATURE_EMISSIVE);
+        drawArrays(GL_TRIANGLES, 0, 36);
+
+        // ceiling lights and street lamp heads, the main light has its own cube above
+        for (size_t i = 1; i < lightBulbs; i++) {
+            const PointLight& light = sceneLights[i];
+            if (!busPortals.contains(light.position) && !exteriorVisible({ light.position, 0.15f })) continue;
+            unifiedShader.setVec4("uAlbedo", glm::vec4(light.color, 1.0f));
+            model = glm::mat4(1.0f);
+            model = glm::translate(model, light.position);
+            model = glm::scale(model, glm::vec3(0.15f));
+            unifiedShader.setMat4("uM", model);
+            unifiedShader.use(FEATURE_EMISSIVE);
+            drawArrays(GL_TRIANGLES, 0, 36);
+        }
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, panelTarget.texture());
+        bindVertexArray(rectVAO);
         unifiedShader.setMat4("uM", screenModel);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        unifiedShader.use(FEATURE_DIFFUSE_MAP);
+        drawArrays(GL_TRIANGLES, 0, 6);
 
         // 3D Passengers
-        draw3DPassengers(unifiedShader);
+        draw3DPassengers(unifiedShader, s);
 
         // Steering Wheel
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, wheelTex);
-        
-        // Simulating wheel movement (slight left-right rotation)
-        static float wheelTime = 0.0f;
-        if (!busStopped) {
-            wheelTime += deltaTime;
-        }
-        float wheelRotation = sin(wheelTime * 1.5f) * 15.0f; // Oscillation between -15 and 15 degrees
-        
-        model = glm::mat4(1.0f);
-        // Position the wheel in the bus (Y adjusted from 0.0f to 0.26f to compensate for centering translation)
-        model = glm::translate(model, glm::vec3(-1.0f + busJogX, 0.26f + busJogY, -4.5f));
-        model = glm::rotate(model, glm::radians(-20.0f), glm::vec3(1.0f, 0.0f, 0.0f)); 
-        model = glm::rotate(model, glm::radians(wheelRotation), glm::vec3(0.0f, 0.0f, 1.0f));
-        model = glm::scale(model, glm::vec3(0.11f));
-        model = glm::translate(model, glm::vec3(0.0f, -2.39f, 0.0f)); // Center the wheel (Y center is ~2.39)
-        
-        unifiedShader.setMat4("uM", model);
-        wheel.Draw(unifiedShader);
+        unifiedShader.setMat4("uM", toWorld * steeringWheelTransform(s.wheelRotation));
+        wheel.Draw(unifiedShader, wheelColor);
 
         // Cigarette
-        model = glm::mat4(1.0f);
-        glm::vec3 cigaretteBasePos = glm::vec3(-0.7f + busJogX, 0.38f + busJogY, -4.6f);
-        glm::vec3 cigaretteTargetPos = glm::vec3(-0.95f + busJogX, 0.38f + busJogY, -4.15f);
-
-        float smokingCycle = 10.0f; // total cycle in seconds
-        float currentTime = (float)glfwGetTime();
-        float timeInCycle = fmod(currentTime, smokingCycle);
-        
-        float smokingDuration = 3.0f;
-        glm::vec3 currentCigarettePos = cigaretteBasePos;
-
-        if (timeInCycle < smokingDuration) {
-            // Normalize time in smoking duration to [0, 1]
-            float t = timeInCycle / smokingDuration;
-            // Use a smooth movement (sinusoidal) for back and forth
-            // sin(0) = 0, sin(pi/2) = 1 (at face), sin(pi) = 0 (back)
-            float moveFactor = sin(t * 3.14159f); 
-            currentCigarettePos = glm::mix(cigaretteBasePos, cigaretteTargetPos, moveFactor);
-        }
-
-        model = glm::translate(model, currentCigarettePos);
-        model = glm::rotate(model, glm::radians(50.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        model = glm::rotate(model, glm::radians(-45.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.3f));
-        unifiedShader.setMat4("uM", model);
+        unifiedShader.setMat4("uM", cigaretteTransform(s.cigarettePosition));
         cigarette.Draw(unifiedShader);
 
 
         glEnable(GL_BLEND);
         glDepthMask(GL_FALSE);
-        glBindTexture(GL_TEXTURE_2D, windshieldTex);
-        glBindVertexArray(windshieldVAO);
+        unifiedShader.setVec4("uAlbedo", windshieldColor);
+        bindVertexArray(windshieldVAO);
         model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(busJogX, 1.25f + busJogY, -5.0f));
+        model = glm::translate(model, glm::vec3(s.busJogX, 1.25f + s.busJogY, -5.0f));
         model = glm::scale(model, glm::vec3(4.0f, 1.5f, 0.1f));
         unifiedShader.setMat4("uM", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        unifiedShader.use(FEATURE_ALPHA_BLEND);
+        drawArrays(GL_TRIANGLES, 0, 36);
         glDepthMask(GL_TRUE);
 
-        unifiedShader.use();
-        unifiedShader.setFloat("uLightIntensity", 5.0f);
-        glBindTexture(GL_TEXTURE_2D, lightTex);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, lightPos);
+        unifiedShader.setVec4("uAlbedo", lightSourceColor);
+        bindVertexArray(cubeVAO);
+        model = glm::translate(toWorld, lightPos);
         model = glm::scale(model, glm::vec3(0.2f)); 
         unifiedShader.setMat4("uM", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        
+        unifiedShader.use(FEATURE_EMISSIVE);
+        drawArrays(GL_TRIANGLES, 0, 36);
+    
+        TRACE_ZONE_END(sceneZone);
+        if (scaled) sceneTarget.resolve();
         glDisable(GL_DEPTH_TEST);
         drawSignature(simpleTextureShader, VAOsignature);
-        if (depthTestEnabled) glEnable(GL_DEPTH_TEST);
+        if (s.memoryOverlay) {
+            // memory totals and the costliest assets in the top left corner, 24 px per line
+            std::vector<std::string> lines = memoryTracker.summaryLines(8);
+            for (size_t i = 0; i < lines.size(); i++)
+                renderText(textShader, lines[i], -0.98f, 1.0f - (i + 1) * 48.0f / s.height, 0.4f, 1.0f, 1.0f, 0.6f, (float)s.width, (float)s.height);
+        }
+        if (s.depthTest) glEnable(GL_DEPTH_TEST);
+        frameTimer.end();
+        if (frameCapture) frameCapture->capture(s.width, s.height);
+
+        endFrameStats();
+        TRACE_COUNTER("draw calls", lastFrameStats.drawCalls);
+        float renderMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - renderStart).count();
+        // a benchmark frame lasts from the start of one render to the next, so it includes the swap
+        static auto lastRenderStart = renderStart;
+        if (session.mode == SessionMode::Bench && session.step > bench.warmupSteps) {
+            BenchReport& report = bench.report;
+            report.add("frame_ms", std::chrono::duration<double, std::milli>(renderStart - lastRenderStart).count());
+            report.add("sim_cpu_ms", s.simMs);
+            report.add("render_cpu_ms", renderMs);
+            if (gpuFrameMeasured) report.add("gpu_frame_ms", frameTimer.lastMs());
+            if (s.shadowQuality > 0) {
+                report.add("shadow_cpu_ms", shadowMap.lastStats().cpuMs);
+                report.add("shadow_gpu_ms", shadowMap.lastStats().gpuMs);
+            }
+            report.add("panel_pixels", panelTarget.pixelsShaded());
+            report.add("draw_calls", lastFrameStats.drawCalls);
+            report.add("vao_binds", lastFrameStats.vaoBinds);
+        }
+        lastRenderStart = renderStart;
+        static double lastStatsReport = 0.0;
+        static unsigned framesSinceReport = 0;
+        framesSinceReport++;
+        if (s.frameStats && s.time - lastStatsReport >= 1.0) {
+            printFrameStats();
+            printf("  sim %.2f ms, render %.2f ms\n", s.simMs, renderMs);
+            printf("  lights %zu, %zu cluster assignments, at most %u per cluster\n", sceneLights.size(),
+                   lightClusters.assignmentCount(), lightClusters.maxLightsPerCluster());
+            if (busPortals.cameraInside())
+                printf("  exterior %u of %u objects drawn, %zu of %zu portals in view\n", exteriorDrawn, exteriorTotal,
+                       busPortals.openPortals(), busPortals.portalCount());
+            else
+                printf("  exterior %u of %u objects drawn, camera outside the bus\n", exteriorDrawn, exteriorTotal);
+            if (s.shadowQuality > 0) {
+                const CubeShadowMap::Stats& shadow = shadowMap.lastStats();
+                printf("  shadows %s: %.2f ms GPU, %.2f ms CPU, %u dynamic caster draws, static cache built %u times\n",
+                       shadowQualityNames[s.shadowQuality], shadow.gpuMs, shadow.cpuMs, shadow.dynamicDraws, shadow.staticRebuilds);
+            } else {
+                printf("  shadows off\n");
+            }
+            if (s.dynamicResolution)
+                printf("  resolution %.0f%% (%.0fx%.0f of %dx%d), GPU frame %.2f ms, average %.2f of %.2f ms, %s, %u changes\n",
+                       resolution.scale() * 100.0f, sceneSize.x, sceneSize.y, s.width, s.height, frameTimer.lastMs(),
+                       resolution.averageMs(), resolution.targetMs(), ResolutionController::stateName(resolution.currentState()),
+                       resolution.changeCount());
+            else
+                printf("  resolution native %dx%d, GPU frame %.2f ms, dynamic scaling off\n", s.width, s.height, frameTimer.lastMs());
+            printf("  panel %dx%d target for %.0f px on screen, updated every %d frames, %llu pixels shaded per frame, %u reallocations\n",
+                   panelTarget.currentSize(), panelTarget.currentSize(), panelPixels, panelTarget.updateInterval(),
+                   panelPixelsShaded / framesSinceReport, panelTarget.reallocations());
+            if (frameCapture) {
+                const FrameCapture::Stats& captured = frameCapture->lastStats();
+                printf("  capture %llu frames read back, %llu written, %llu dropped, %d of %d buffers busy (%.1f MB), %.3f ms render thread (max %.3f)\n",
+                       (unsigned long long)captured.captured, (unsigned long long)captured.written, (unsigned long long)captured.dropped,
+                       captured.busySlots, frameCapture->slotCount(), frameCapture->bufferBytes() / (1024.0 * 1024.0),
+                       captured.renderMs, captured.maxRenderMs);
+            }
+            printf("  trees %zu of %zu placements drawn in %u draw calls\n", treeSelection.instances.size(), treePlacements, treeDrawCalls);
+            printf("  traffic %zu cars, %zu near the bus, %zu drawn as models and %zu as boxes in %u draw calls\n", s.trafficCount,
+                   s.trafficFrames.size(), trafficRenderer.modelInstances(), trafficRenderer.boxInstances(), trafficDrawCalls);
+            SceneryStreamer::Stats streamed = scenery.lastStats();
+            printf("  scenery %zu of %zu pooled chunks resident (%zu KB budget), %llu built in %.3f ms each, %llu recycled\n",
+                   streamed.resident, streamed.poolSize, sceneryConfig.memoryBudget / 1024,
+                   (unsigned long long)streamed.built, streamed.buildMs, (unsigned long long)streamed.recycled);
+            printWorkerStats(*jobs);
+            for (const std::string& line : memoryTracker.summaryLines(5))
+                printf("  memory %s\n", line.c_str());
+            lastStatsReport = s.time;
+            framesSinceReport = 0;
+            panelPixelsShaded = 0;
+        }
+    };
+
+    if (!pipelined) {
+        FrameSnapshot snapshot;
+        while (!glfwWindowShouldClose(window))
+        {
+            float currentFrame = static_cast<float>(glfwGetTime());
+            int width, height;
+            glfwGetFramebufferSize(window, &width, &height);
+
+            stepSimulation(currentFrame, width, height, snapshot);
+            renderFrame(snapshot);
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+            {
+                TRACE_ZONE("glfwSwapBuffers");
+                glfwSwapBuffers(window);
+            }
+            TRACE_FRAME_END();
+            glfwPollEvents();
+            if (closeRequested) glfwSetWindowShouldClose(window, true);
 
-        while (glfwGetTime() - currentFrame < 1.0 / 75.0) {}
+            if (session.mode == SessionMode::Bench) continue;
+            TRACE_ZONE("pacing");
+            while (glfwGetTime() - currentFrame < 1.0 / 75.0) {}
+        }
+    } else {
+        // The main thread only pumps events, the simulation thread steps the world into a triple buffer and the
+        // render thread draws the newest finished step, so a frame costs max(sim, render) instead of their sum.
+        TripleBuffer<FrameSnapshot> snapshots;
+        std::atomic<bool> running{ true };
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        std::atomic<int> framebufferWidth{ width }, framebufferHeight{ height };
+
+        glfwMakeContextCurrent(NULL);
+        std::thread renderThread([&] {
+            glfwMakeContextCurrent(window);
+            TRACE_THREAD("render");
+            while (running) {
+                if (!snapshots.acquire(std::chrono::milliseconds(100))) continue;
+                renderFrame(snapshots.readBuffer());
+                {
+                    TRACE_ZONE("glfwSwapBuffers");
+                    glfwSwapBuffers(window);
+                }
+                TRACE_FRAME_END();
+            }
+            glfwMakeContextCurrent(NULL);
+        });
+        std::thread simulationThread([&] {
+            TRACE_THREAD("simulation");
+            while (running) {
+                double stepStart = glfwGetTime();
+                stepSimulation(static_cast<float>(stepStart), framebufferWidth, framebufferHeight, snapshots.writeBuffer());
+                snapshots.publish();
+                TRACE_ZONE("pacing");
+                std::this_thread::sleep_for(std::chrono::duration<double>(1.0 / 75.0 - (glfwGetTime() - stepStart)));
+            }
+        });
+
+        while (!glfwWindowShouldClose(window))
+        {
+            glfwWaitEventsTimeout(1.0 / 120.0);
+            glfwGetFramebufferSize(window, &width, &height);
+            framebufferWidth = width;
+            framebufferHeight = height;
+            if (closeRequested) glfwSetWindowShouldClose(window, true);
+        }
+
+        running = false;
+        simulationThread.join();
+        renderThread.join();
+        glfwMakeContextCurrent(window);
     }
 
-    glDeleteVertexArrays(1, &VAOsignature);
+    deleteVertexArray(VAOsignature);
     glDeleteBuffers(1, &VBOsignature);
-    glDeleteVertexArrays(1, &cubeVAO);
+    deleteVertexArray(cubeVAO);
     glDeleteBuffers(1, &cubeVBO);
-    glDeleteVertexArrays(1, &windshieldVAO);
+    deleteVertexArray(windshieldVAO);
     glDeleteBuffers(1, &windshieldVBO);
-    glDeleteVertexArrays(1, &rectVAO);
+    deleteVertexArray(rectVAO);
     glDeleteBuffers(1, &rectVBO);
-    glDeleteVertexArrays(1, &VAOBus2D);
+    deleteVertexArray(roadVAO);
+    glDeleteBuffers(1, &roadVBO);
+    deleteVertexArray(VAOBus2D);
     glDeleteBuffers(1, &VBOBus2D);
-    glDeleteVertexArrays(1, &VAOstations2D);
+    deleteVertexArray(VAOfleet2D);
+    glDeleteBuffers(1, &VBOfleet2D);
+    fleetInstanceVBO.reset();
+    deleteVertexArray(VAOstations2D);
     glDeleteBuffers(1, &VBOstations2D);
-    glDeleteVertexArrays(1, &VAOdoors2D);
+    deleteVertexArray(VAOdoors2D);
     glDeleteBuffers(1, &VBOdoors2D);
-    glDeleteVertexArrays(1, &VAOcontrol2D);
+    deleteVertexArray(VAOcontrol2D);
     glDeleteBuffers(1, &VBOcontrol2D);
-    glDeleteVertexArrays(1, &textVAO);
+    deleteVertexArray(textVAO);
     glDeleteBuffers(1, &textVBO);
 
     for (auto& pd : pathDataList) {
-        glDeleteVertexArrays(1, &pd.VAO);
+        deleteVertexArray(pd.VAO);
         glDeleteBuffers(1, &pd.VBO);
     }
 
-    glDeleteFramebuffers(1, &fbo);
-    glDeleteTextures(1, &fboTex);
     glDeleteTextures(1, &signatureTex);
     glDeleteTextures(1, &bus2DTex);
     glDeleteTextures(1, &doorsOpenTex);
     glDeleteTextures(1, &doorsClosedTex);
     glDeleteTextures(1, &control2DTex);
-    glDeleteTextures(1, &busColorTex);
-    glDeleteTextures(1, &windshieldTex);
-    glDeleteTextures(1, &controlPanelTex);
-    glDeleteTextures(1, &wheelTex);
-    glDeleteTextures(1, &doorTex);
-    glDeleteTextures(1, &lightTex);
 
     for (auto const& [c, ch] : Characters) {
         glDeleteTextures(1, &ch.TextureID);
     }
 
-    glDeleteProgram(simpleTextureShader);
-    glDeleteProgram(bus2DShader);
-    glDeleteProgram(station2DShader);
-    glDeleteProgram(path2DShader);
     glDeleteProgram(textShader);
-    glDeleteProgram(unifiedShader.ID);
 
-    for (auto m : personModels) delete m;
-    delete controlModel;
-
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    personModels.clear();
+    controlModel.reset();
+    staticMeshArena().release();
+    if (session.mode == SessionMode::Bench) {
+        if (session.finished) return finishBenchmark();
+        std::cout << "Benchmark interrupted, nothing reported" << std::endl;
+        return 1;
+    }
     return 0;
 }
\ No newline at end of file
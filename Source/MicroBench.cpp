@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "model_import.hpp"
+
+#include "fleet.hpp"
+#include "frustum.hpp"
+#include "passenger_system.hpp"
+#include "route.hpp"
+#include "text_layout.hpp"
+
+// Microbenchmarks of single CPU paths of the simulator and its asset loading, each in isolation. Needs no window
+// or GL context. Run from the build directory so ../Resources and ../Projekat2D/Resources are found; a benchmark
+// whose input file is missing is skipped.
+// Usage: Projekat3DMicroBench [filter]   (runs the benchmarks whose name contains filter, all without one)
+
+using BenchClock = std::chrono::steady_clock;
+
+std::string filter;
+volatile double sink = 0.0;   // every benchmark returns something derived from its work, so none of it is optimised out
+
+// Times fn, which does itemsPerCall units of work per call. The batch of calls doubles until one batch takes at
+// least 20 ms, then five batches are timed and the median is reported.
+template <typename F>
+void measure(const std::string& name, double itemsPerCall, F&& fn)
+{
+    if (name.find(filter) == std::string::npos)
+        return;
+    auto timeBatch = [&](long long calls) {
+        auto start = BenchClock::now();
+        for (long long i = 0; i < calls; i++)
+            sink = sink + fn();
+        return std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+    };
+
+    long long batch = 1;
+    while (timeBatch(batch) < 20e6 && batch < (1ll << 30))
+        batch *= 2;
+    std::vector<double> nsPerCall;
+    for (int i = 0; i < 5; i++)
+        nsPerCall.push_back(timeBatch(batch) / batch);
+    std::sort(nsPerCall.begin(), nsPerCall.end());
+    double median = nsPerCall[2];
+    printf("%-22s %14.1f ns/call %10.2f ns/item %10.3f M items/s  (%lld calls x 5, spread %.1f%%)\n", name.c_str(), median,
+           median / itemsPerCall, itemsPerCall / median * 1e3, batch, (nsPerCall[4] - nsPerCall[0]) / median * 100.0);
+}
+
+void skipped(const std::string& name, const std::string& missing)
+{
+    if (name.find(filter) != std::string::npos)
+        printf("%-22s skipped, %s not found\n", name.c_str(), missing.c_str());
+}
+
+// the ten stations of the control panel map
+std::vector<glm::vec2> benchStations()
+{
+    return { { -0.4f, 0.6f }, { 0.15f, 0.55f }, { 0.5f, 0.65f }, { 0.55f, 0.3f }, { 0.65f, -0.35f },
+             { 0.1f, -0.5f }, { -0.15f, -0.65f }, { -0.4f, -0.1f }, { -0.75f, 0.15f }, { -0.45f, 0.25f } };
+}
+
+// Building the Bezier legs of the route, and walking along them the way a bus does every step
+void benchRoute()
+{
+    std::vector<glm::vec2> stations = benchStations();
+    measure("route/build", 1, [&] {
+        Route route(stations);
+        return static_cast<double>(route.totalLength());
+    });
+
+    Route route(stations);
+    const int samples = 1000;
+    measure("route/walk", samples, [&] {
+        float sum = 0.0f;
+        float step = route.totalLength() / samples;
+        for (int i = 0; i < samples; i++)
+        {
+            glm::vec2 position = route.positionAt(i * step), tangent = route.tangentAt(i * step);
+            sum += position.x + position.y + tangent.x + tangent.y;
+        }
+        return static_cast<double>(sum);
+    });
+
+    // the step updateBusLogic runs for the one driven bus
+    Fleet fleet;
+    fleet.reset(route, FleetConfig(), 1);
+    measure("fleet/update", 1, [&] {
+        fleet.update(1.0f / 75.0f);
+        return static_cast<double>(fleet.distance[0]);
+    });
+}
+
+// A flat grid of size x size vertices with normals and texture coordinates, two triangles per cell
+void fillGridMesh(aiMesh& mesh, unsigned size)
+{
+    mesh.mNumVertices = size * size;
+    mesh.mVertices = new aiVector3D[mesh.mNumVertices];
+    mesh.mNormals = new aiVector3D[mesh.mNumVertices];
+    mesh.mTextureCoords[0] = new aiVector3D[mesh.mNumVertices];
+    for (unsigned y = 0; y < size; y++)
+    {
+        for (unsigned x = 0; x < size; x++)
+        {
+            unsigned i = y * size + x;
+            mesh.mVertices[i] = aiVector3D(static_cast<float>(x), 0.0f, static_cast<float>(y));
+            mesh.mNormals[i] = aiVector3D(0.0f, 1.0f, 0.0f);
+            mesh.mTextureCoords[0][i] = aiVector3D(x / float(size - 1), y / float(size - 1), 0.0f);
+        }
+    }
+    mesh.mNumFaces = (size - 1) * (size - 1) * 2;
+    mesh.mFaces = new aiFace[mesh.mNumFaces];
+    unsigned f = 0;
+    for (unsigned y = 0; y + 1 < size; y++)
+    {
+        for (unsigned x = 0; x + 1 < size; x++)
+        {
+            unsigned i = y * size + x;
+            unsigned corners[2][3] = { { i, i + size, i + 1 }, { i + 1, i + size, i + size + 1 } };
+            for (auto& corner : corners)
+            {
+                mesh.mFaces[f].mNumIndices = 3;
+                mesh.mFaces[f].mIndices = new unsigned int[3]{ corner[0], corner[1], corner[2] };
+                f++;
+            }
+        }
+    }
+}
+
+// processMesh's conversion of ASSIMP vertices and faces, on a synthetic mesh and on whole models from Resources
+void benchMeshes()
+{
+    aiMesh grid;
+    fillGridMesh(grid, 256);
+    measure("mesh/convert", grid.mNumVertices, [&] {
+        MeshData data;
+        convertGeometry(&grid, data);
+        return static_cast<double>(data.vertices.size() + data.indices.size());
+    });
+
+    for (const char* name : { "person1", "tree" })
+    {
+        std::string path = std::string("../Resources/") + name + "/" + (std::string(name) == "tree" ? "Tree.obj" : "model.obj");
+        std::string label = std::string("mesh/import-") + name;
+        if (!std::ifstream(path))
+        {
+            skipped(label, path);
+            continue;
+        }
+        size_t vertices = 0;
+        for (const MeshData& mesh : importModel(path).meshes)
+            vertices += mesh.vertices.size();
+        measure(label, static_cast<double>(vertices), [&] {
+            ModelData data = importModel(path);
+            return static_cast<double>(data.meshes.size() + data.images.size());
+        });
+    }
+}
+
+// Glyph rasterisation of initFreeType, and renderText's quads for the strings the control panel draws every frame
+void benchText()
+{
+    const char* fontPath = "../Projekat2D/Resources/font.ttf";
+    std::map<char, Character> characters;
+    bool fontFound = static_cast<bool>(std::ifstream(fontPath));
+    if (fontFound)
+    {
+        measure("text/rasterize", 96, [&] {
+            size_t pixels = 0;
+            rasterizeGlyphs(fontPath, 48, [&](unsigned char, FT_GlyphSlot glyph) { pixels += glyph->bitmap.width * glyph->bitmap.rows; });
+            return static_cast<double>(pixels);
+        });
+        rasterizeGlyphs(fontPath, 48, [&](unsigned char c, FT_GlyphSlot glyph) {
+            characters[c] = { 0, (int)glyph->bitmap.width, (int)glyph->bitmap.rows, glyph->bitmap_left, glyph->bitmap_top,
+                              (unsigned int)glyph->advance.x };
+        });
+    }
+    else
+    {
+        // made-up metrics of a 48 px monospace font, the layout cost does not depend on them
+        skipped("text/rasterize", fontPath);
+        for (unsigned char c = 32; c < 128; c++)
+            characters[c] = { 0, 26, 34, 2, 34, 28 << 6 };
+    }
+
+    std::vector<std::string> lines = { "Passengers: 37", "Tickets: 12" };
+    size_t glyphs = 0;
+    for (int i = 0; i < 10; i++)
+        lines.push_back(std::to_string(i));
+    for (const std::string& line : lines)
+        glyphs += line.size();
+    std::vector<float> buffer(glyphs * 24);
+    measure("text/layout", static_cast<double>(glyphs), [&] {
+        float* out = buffer.data();
+        for (const std::string& line : lines)
+        {
+            float x = 0.4f;
+            for (char c : line)
+            {
+                Character ch = characters[c];
+                float vertices[6][4];
+                glyphQuad(ch, x, 0.9f, 0.8f, 800.0f, 800.0f, vertices);
+                std::copy(&vertices[0][0], &vertices[0][0] + 24, out);
+                out += 24;
+                x += glyphAdvance(ch, 0.8f, 800.0f);
+            }
+        }
+        return static_cast<double>(buffer[glyphs * 24 - 1]);
+    });
+}
+
+// The per-passenger matrix and culling work of preparePassengerTransforms, on one thread
+void benchPassengerMatrices()
+{
+    PassengerLayout layout;
+    layout.outside = glm::vec3(3.5f, -1.0f, -4.0f);
+    layout.door = glm::vec3(2.0f, -1.0f, -4.0f);
+    layout.standing = glm::vec3(0.0f, -1.0f, 4.0f);
+    for (int i = 0; i < 50; i++)
+        layout.seats.push_back(glm::vec3(-1.6f + (i % 5) * 0.7f, -1.0f, -1.5f + (i / 5) * 0.6f));
+    PassengerSystem passengers(layout);
+    const int count = 1000;
+    for (int i = 0; i < count; i++)
+        passengers.spawnSeated(i % 15);
+
+    Frustum frustum = Frustum::fromMatrix(glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f) *
+                                          glm::lookAt(glm::vec3(-1.0f, 0.5f, -4.0f), glm::vec3(-1.0f, 0.5f, 4.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+    BoundingSphere personBounds = { glm::vec3(0.0f, 0.9f, 0.0f), 1.0f };
+    std::vector<glm::mat4> transforms(passengers.count());
+    std::vector<uint8_t> drawn(passengers.count());
+    measure("passengers/matrices", static_cast<double>(passengers.count()), [&] {
+        unsigned visible = 0;
+        for (size_t i = 0; i < passengers.count(); i++)
+        {
+            transforms[i] = placementMatrix(passengers.position[i], passengers.heading[i] + 90.0f, 0.9f);
+            drawn[i] = frustum.intersects(transformSphere(personBounds, transforms[i]));
+            visible += drawn[i];
+        }
+        return static_cast<double>(visible);
+    });
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        filter = argv[1];
+    benchRoute();
+    benchMeshes();
+    benchText();
+    benchPassengerMatrices();
+    return 0;
+}
@@ -0,0 +1,136 @@
+#ifndef BENCH_REPORT_H
+#define BENCH_REPORT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct BenchSummary {
+    double mean = 0.0, p50 = 0.0, p95 = 0.0, p99 = 0.0, max = 0.0;
+};
+
+// nearest-rank percentiles, values is sorted in place
+inline BenchSummary summarize(std::vector<double>& values)
+{
+    BenchSummary s;
+    if (values.empty())
+        return s;
+    std::sort(values.begin(), values.end());
+    auto rank = [&](double p) { return values[std::min(values.size() - 1, static_cast<size_t>(std::ceil(p * values.size())) - 1)]; };
+    double sum = 0.0;
+    for (double v : values) sum += v;
+    s.mean = sum / values.size();
+    s.p50 = rank(0.50);
+    s.p95 = rank(0.95);
+    s.p99 = rank(0.99);
+    s.max = values.back();
+    return s;
+}
+
+// One metric and statistic compared against the baseline, e.g. frame_ms p95
+struct BenchGate {
+    std::string metric, stat;
+};
+
+// Per-frame samples of a benchmark run and a few values taken once, written out as one flat JSON object per
+// metric. The baseline is a report of an earlier run read back with a minimal reader that only understands
+// this layout.
+class BenchReport
+{
+public:
+    void add(const std::string& metric, double value) { series(metric).push_back(value); }
+    void set(const std::string& metric, double value) { values.emplace_back(metric, value); }
+
+    size_t frames() const { return samples.empty() ? 0 : samples.front().second.size(); }
+
+    std::string toJson(const std::string& scenario, double simulatedSeconds)
+    {
+        std::ostringstream out;
+        out << "{\n  \"scenario\": \"" << scenario << "\",\n  \"simulated_seconds\": " << simulatedSeconds
+            << ",\n  \"frames\": " << frames();
+        for (auto& [metric, v] : samples)
+        {
+            BenchSummary s = summarize(v);
+            out << ",\n  \"" << metric << "\": { \"mean\": " << s.mean << ", \"p50\": " << s.p50 << ", \"p95\": " << s.p95
+                << ", \"p99\": " << s.p99 << ", \"max\": " << s.max << " }";
+        }
+        for (auto& [metric, v] : values)
+            out << ",\n  \"" << metric << "\": { \"value\": " << v << " }";
+        out << "\n}\n";
+        return out.str();
+    }
+
+    bool write(const std::string& path, const std::string& scenario, double simulatedSeconds)
+    {
+        std::error_code ec;
+        std::filesystem::path parent = std::filesystem::path(path).parent_path();
+        if (!parent.empty())
+            std::filesystem::create_directories(parent, ec);
+        std::ofstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::BENCH:: Could not write " << path << std::endl;
+            return false;
+        }
+        file << toJson(scenario, simulatedSeconds);
+        return true;
+    }
+
+    // Prints every gated statistic next to the baseline and returns how many grew by more than threshold
+    // (a fraction) plus slack (absolute, so metrics near zero do not fail on noise)
+    static int compare(const std::string& currentJson, const std::string& baselineJson, const std::vector<BenchGate>& gates,
+                       double threshold, double slack)
+    {
+        int regressions = 0;
+        for (const BenchGate& gate : gates)
+        {
+            double now = 0.0, before = 0.0;
+            if (!lookup(currentJson, gate.metric, gate.stat, now) || !lookup(baselineJson, gate.metric, gate.stat, before))
+            {
+                printf("  %-16s %-5s not in both reports, skipped\n", gate.metric.c_str(), gate.stat.c_str());
+                continue;
+            }
+            bool regressed = now > before * (1.0 + threshold) + slack;
+            regressions += regressed;
+            printf("  %-16s %-5s %10.3f, baseline %10.3f (%+.1f%%)%s\n", gate.metric.c_str(), gate.stat.c_str(), now, before,
+                   before > 0.0 ? (now / before - 1.0) * 100.0 : 0.0, regressed ? "  REGRESSION" : "");
+        }
+        return regressions;
+    }
+
+    // finds "metric": { ... "stat": number ... } in a report written by toJson
+    static bool lookup(const std::string& json, const std::string& metric, const std::string& stat, double& value)
+    {
+        size_t object = json.find("\"" + metric + "\":");
+        if (object == std::string::npos)
+            return false;
+        size_t end = json.find('}', object);
+        size_t key = json.find("\"" + stat + "\":", object);
+        if (key == std::string::npos || key > end)
+            return false;
+        value = strtod(json.c_str() + key + stat.size() + 3, nullptr);
+        return true;
+    }
+
+private:
+    std::vector<std::pair<std::string, std::vector<double>>> samples;   // in the order first added
+    std::vector<std::pair<std::string, double>> values;
+
+    std::vector<double>& series(const std::string& metric)
+    {
+        for (auto& [name, v] : samples)
+            if (name == metric)
+                return v;
+        samples.emplace_back(metric, std::vector<double>());
+        return samples.back().second;
+    }
+};
+#endif
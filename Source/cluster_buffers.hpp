@@ -0,0 +1,80 @@
+#ifndef CLUSTER_BUFFERS_H
+#define CLUSTER_BUFFERS_H
+
+#include <GL/glew.h>
+
+#include "gl_handles.hpp"
+#include "memory_tracker.hpp"
+#include "light_clusters.hpp"
+
+#include <vector>
+
+// Buffer textures holding the output of LightClusters for basic.frag. Every frame the arrays are streamed
+// into freshly orphaned stores, the texture views stay attached to the same buffers.
+class ClusterBuffers
+{
+public:
+    // texture units the shader's uClusterTable, uLightIndices and uLightData samplers read from,
+    // kept above the units bindMeshTextures hands out
+    static constexpr int TABLE_UNIT = 13, INDEX_UNIT = 14, LIGHT_UNIT = 15;
+
+    ClusterBuffers()
+    {
+        table = GLBuffer::create();
+        indices = GLBuffer::create();
+        lights = GLBuffer::create();
+        tableTexture = attach(table, GL_RG32UI);
+        indexTexture = attach(indices, GL_R32UI);
+        lightTexture = attach(lights, GL_RGBA32F);
+    }
+
+    void upload(const LightClusters& clusters)
+    {
+        stream(table, clusters.clusterTable.data(), clusters.clusterTable.size() * sizeof(uint32_t));
+        stream(indices, clusters.lightIndices.data(), clusters.lightIndices.size() * sizeof(uint32_t));
+        stream(lights, clusters.lightData.data(), clusters.lightData.size() * sizeof(glm::vec4));
+    }
+
+    void bind() const
+    {
+        glActiveTexture(GL_TEXTURE0 + TABLE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, tableTexture);
+        glActiveTexture(GL_TEXTURE0 + INDEX_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+        glActiveTexture(GL_TEXTURE0 + LIGHT_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    GLBuffer table, indices, lights;
+    GLTexture tableTexture, indexTexture, lightTexture;
+
+    static GLTexture attach(const GLBuffer& buffer, GLenum format)
+    {
+        // a store has to exist before the view is created
+        stream(buffer, nullptr, 0);
+        GLTexture texture = GLTexture::create();
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        return texture;
+    }
+
+    static void stream(const GLBuffer& buffer, const void* data, size_t bytes)
+    {
+        // never empty, a zero sized store is not a valid buffer texture everywhere
+        static const uint32_t zeros[4] = {};
+        if (bytes == 0)
+        {
+            data = zeros;
+            bytes = sizeof(zeros);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        memoryTracker.track(MemoryTracker::BUFFER, buffer, bytes, MemoryCategory::Streaming, "light clusters");
+    }
+};
+#endif
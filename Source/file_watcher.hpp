@@ -0,0 +1,178 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Watches directory trees on a background thread and reports files that were written. Uses inotify on Linux and
+// falls back to comparing modification times twice a second elsewhere. Editors save in bursts (temp file,
+// rename, attribute change), so changes are collected until the tree has been quiet for a moment and every
+// file is reported once.
+class FileWatcher
+{
+public:
+    using Callback = std::function<void(const std::vector<std::string>&)>;
+
+    FileWatcher() = default;
+    ~FileWatcher() { stop(); }
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // watches every directory below each root, onChange runs on the watcher thread
+    void start(const std::vector<std::string>& roots, Callback onChange)
+    {
+        stop();
+        callback = std::move(onChange);
+        running = true;
+        worker = std::thread([this, roots] { run(roots); });
+    }
+
+    void stop()
+    {
+        running = false;
+        if (worker.joinable())
+            worker.join();
+    }
+
+private:
+    static constexpr auto QUIET_PERIOD = std::chrono::milliseconds(150);
+
+    Callback callback;
+    std::atomic<bool> running{ false };
+    std::thread worker;
+
+    static std::vector<std::string> directoriesBelow(const std::vector<std::string>& roots)
+    {
+        std::vector<std::string> dirs;
+        for (const auto& root : roots)
+        {
+            std::error_code ec;
+            if (!std::filesystem::is_directory(root, ec))
+                continue;
+            dirs.push_back(root);
+            for (auto it = std::filesystem::recursive_directory_iterator(root, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+            {
+                if (it->is_directory(ec))
+                    dirs.push_back(it->path().string());
+            }
+        }
+        return dirs;
+    }
+
+    void report(std::set<std::string>& changed)
+    {
+        if (changed.empty())
+            return;
+        std::vector<std::string> files(changed.begin(), changed.end());
+        changed.clear();
+        callback(files);
+    }
+
+#ifdef __linux__
+    void run(const std::vector<std::string>& roots)
+    {
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0)
+        {
+            runPolling(roots);
+            return;
+        }
+        std::map<int, std::string> watches;
+        for (const auto& dir : directoriesBelow(roots))
+        {
+            int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+            if (wd >= 0)
+                watches[wd] = dir;
+        }
+
+        std::set<std::string> changed;
+        auto lastEvent = std::chrono::steady_clock::now();
+        alignas(inotify_event) char buffer[4096];
+        while (running)
+        {
+            pollfd p = { fd, POLLIN, 0 };
+            if (poll(&p, 1, 50) > 0)
+            {
+                ssize_t length;
+                while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+                {
+                    for (char* ptr = buffer; ptr < buffer + length;)
+                    {
+                        const inotify_event* e = reinterpret_cast<const inotify_event*>(ptr);
+                        ptr += sizeof(inotify_event) + e->len;
+                        if (e->len == 0 || watches.find(e->wd) == watches.end())
+                            continue;
+                        std::string path = watches[e->wd] + "/" + e->name;
+                        if (e->mask & IN_ISDIR)
+                        {
+                            // new folder, e.g. a model dropped into Resources
+                            int wd = inotify_add_watch(fd, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+                            if (wd >= 0)
+                                watches[wd] = path;
+                            continue;
+                        }
+                        changed.insert(path);
+                        lastEvent = std::chrono::steady_clock::now();
+                    }
+                }
+            }
+            if (!changed.empty() && std::chrono::steady_clock::now() - lastEvent >= QUIET_PERIOD)
+                report(changed);
+        }
+        close(fd);
+    }
+#else
+    void run(const std::vector<std::string>& roots)
+    {
+        runPolling(roots);
+    }
+#endif
+
+    void runPolling(const std::vector<std::string>& roots)
+    {
+        std::map<std::string, std::filesystem::file_time_type> times;
+        auto scan = [&](std::set<std::string>* changed) {
+            for (const auto& dir : directoriesBelow(roots))
+            {
+                std::error_code ec;
+                for (auto it = std::filesystem::directory_iterator(dir, ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec))
+                {
+                    if (!it->is_regular_file(ec))
+                        continue;
+                    std::string path = it->path().string();
+                    auto time = it->last_write_time(ec);
+                    auto known = times.find(path);
+                    if (changed && (known == times.end() || known->second != time))
+                        changed->insert(path);
+                    times[path] = time;
+                }
+            }
+        };
+
+        scan(nullptr);
+        std::set<std::string> changed;
+        while (running)
+        {
+            for (int i = 0; i < 10 && running; i++)
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            scan(&changed);
+            report(changed);
+        }
+    }
+};
+#endif
@@ -0,0 +1,244 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <glm/glm.hpp>
+
+#include "job_system.hpp"
+#include "route.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+struct FleetConfig {
+    float speed = 0.09f;          // route units per second, the speed the single bus always had
+    float stopDuration = 10.0f;   // seconds spent at every station
+    float minHeadway = 0.08f;     // closest a moving bus may get to the one ahead of it
+    int stationCapacity = 2;      // buses that can stand at one station at the same time
+    int maxPassengers = 50;
+};
+
+// All buses on the shared route, one entry per bus in contiguous columns. Each update sorts the moving buses
+// along the route to find who follows whom, advances every bus in parallel against that snapshot, and then
+// hands out station places serially, so the result does not depend on the number of threads.
+class Fleet
+{
+public:
+    std::vector<int>       currentStation;
+    std::vector<int>       nextStation;
+    std::vector<float>     distance;      // along the leg from currentStation to nextStation
+    std::vector<glm::vec2> position;      // on the control panel map
+    std::vector<uint8_t>   stopped;
+    std::vector<float>     stopTimer;     // seconds left at the station
+    std::vector<uint8_t>   arrived;       // reached a station during the last update
+    std::vector<uint8_t>   waiting;       // held back by the bus ahead or by a full station
+    std::vector<int>       passengers;
+    std::vector<int>       tickets;
+    std::vector<uint8_t>   controlInside;
+    std::vector<uint32_t>  rng;
+
+    // the bus whose passengers are simulated by the 3D scene instead of by the fleet
+    int driven = 0;
+
+    Fleet() = default;
+
+    // places `count` buses evenly around the route; the first one stands at station 0 like the single bus did
+    void reset(const Route& newRoute, FleetConfig newConfig, int count)
+    {
+        route = newRoute;
+        config = newConfig;
+        int n = std::max(count, 1);
+        for (auto* column : { &currentStation, &nextStation, &passengers, &tickets })
+            column->assign(n, 0);
+        for (auto* column : { &distance, &stopTimer })
+            column->assign(n, 0.0f);
+        for (auto* column : { &stopped, &arrived, &waiting, &controlInside })
+            column->assign(n, 0);
+        position.assign(n, glm::vec2(0.0f));
+        rng.resize(n);
+        routePos.assign(n, 0.0f);
+        gap.assign(n, 0.0f);
+        wantsStation.assign(n, 0);
+        occupancy.assign(route.stationCount(), 0);
+        driven = 0;
+
+        // buses cannot be closer than their even spacing, however many there are
+        headway = std::min(config.minHeadway, route.totalLength() / n * 0.5f);
+
+        int stations = route.stationCount();
+        for (int i = 0; i < n; i++)
+        {
+            float s = route.totalLength() * i / n;
+            int leg = 0;
+            while (leg < stations - 1 && route.routeDistance(leg + 1, 0.0f) <= s)
+                leg++;
+            currentStation[i] = leg;
+            nextStation[i] = (leg + 1) % stations;
+            distance[i] = s - route.routeDistance(leg, 0.0f);
+            position[i] = route.positionOnLeg(leg, distance[i]);
+            rng[i] = 0x9E3779B9u * (i + 1);
+        }
+        stopped[0] = 1;
+        stopTimer[0] = config.stopDuration;
+    }
+
+    int size() const { return static_cast<int>(distance.size()); }
+    const Route& getRoute() const { return route; }
+
+    // jobs is optional; without it, or for small fleets, everything runs on the calling thread
+    void update(float dt, JobSystem* jobs = nullptr)
+    {
+        int n = size();
+        findGaps();
+
+        // every bus only writes its own entries and reads the gap snapshot, so chunks are independent
+        if (jobs && n >= PARALLEL_THRESHOLD)
+            jobs->parallelFor(n, PARALLEL_GRAIN, [this, dt](size_t begin, size_t end) { advance(static_cast<int>(begin), static_cast<int>(end), dt); });
+        else
+            advance(0, n, dt);
+
+        assignStations();
+    }
+
+    // cyclic route distance from bus a forward to bus b
+    float routeGap(int a, int b) const
+    {
+        float d = routePos[b] - routePos[a];
+        return d < 0.0f ? d + route.totalLength() : d;
+    }
+
+private:
+    static const int PARALLEL_THRESHOLD = 2048;
+    static const int PARALLEL_GRAIN = 512;
+
+    Route route;
+    FleetConfig config;
+    float headway = 0.0f;
+
+    // per-update scratch
+    std::vector<float> routePos;
+    std::vector<float> gap;           // free road to the next moving bus
+    std::vector<uint8_t> wantsStation;
+    std::vector<int> order;
+    std::vector<int> occupancy;
+
+    uint32_t nextRandom(int i)
+    {
+        // xorshift, one stream per bus so the result does not depend on update order
+        uint32_t x = rng[i];
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        rng[i] = x;
+        return x;
+    }
+
+    // sorts the moving buses along the route; stopped buses stand in the station bay and do not block the lane
+    void findGaps()
+    {
+        int n = size();
+        order.clear();
+        for (int i = 0; i < n; i++)
+        {
+            routePos[i] = route.routeDistance(currentStation[i], distance[i]);
+            gap[i] = route.totalLength();
+            if (!stopped[i])
+                order.push_back(i);
+        }
+        std::sort(order.begin(), order.end(), [this](int a, int b) { return routePos[a] < routePos[b]; });
+        if (order.size() < 2)
+            return;
+        for (size_t k = 0; k < order.size(); k++)
+        {
+            int self = order[k];
+            int ahead = order[(k + 1) % order.size()];
+            gap[self] = routeGap(self, ahead);
+        }
+    }
+
+    void advance(int begin, int end, float dt)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            arrived[i] = 0;
+            wantsStation[i] = 0;
+            if (stopped[i])
+            {
+                stopTimer[i] -= dt;
+                if (stopTimer[i] <= 0.0f)
+                {
+                    stopped[i] = 0;
+                    stopTimer[i] = 0.0f;
+                }
+                position[i] = route.station(currentStation[i]);
+                continue;
+            }
+
+            float step = std::min(config.speed * dt, std::max(0.0f, gap[i] - headway));
+            waiting[i] = step < config.speed * dt;
+            float legLength = route.legLength(currentStation[i]);
+            distance[i] += step;
+            if (distance[i] >= legLength)
+            {
+                distance[i] = legLength;
+                wantsStation[i] = 1;
+            }
+            position[i] = route.positionOnLeg(currentStation[i], distance[i]);
+        }
+    }
+
+    // station contention: buses reaching a full station wait at the end of their leg until a place frees up
+    void assignStations()
+    {
+        int n = size();
+        std::fill(occupancy.begin(), occupancy.end(), 0);
+        for (int i = 0; i < n; i++)
+        {
+            if (stopped[i])
+                occupancy[currentStation[i]]++;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            if (!wantsStation[i])
+                continue;
+            int station = nextStation[i];
+            if (occupancy[station] >= config.stationCapacity)
+            {
+                waiting[i] = 1;
+                continue;
+            }
+            occupancy[station]++;
+            currentStation[i] = station;
+            nextStation[i] = (station + 1) % route.stationCount();
+            distance[i] = 0.0f;
+            stopped[i] = 1;
+            waiting[i] = 0;
+            stopTimer[i] = config.stopDuration;
+            arrived[i] = 1;
+            position[i] = route.station(station);
+            if (i != driven)
+                simulateStop(i);
+        }
+    }
+
+    // passengers of buses nobody is driving are only counted, not animated
+    void simulateStop(int i)
+    {
+        if (controlInside[i])
+        {
+            tickets[i] += passengers[i] > 1 ? static_cast<int>(nextRandom(i) % (passengers[i] - 1)) : 0;
+            controlInside[i] = 0;
+            passengers[i]--;
+        }
+        int change = static_cast<int>(nextRandom(i) % 11) - 5;
+        passengers[i] = std::clamp(passengers[i] + change, 0, config.maxPassengers);
+        if (passengers[i] < config.maxPassengers && nextRandom(i) % 10 == 0)
+        {
+            controlInside[i] = 1;
+            passengers[i]++;
+        }
+    }
+};
+#endif
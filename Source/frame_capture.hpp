@@ -0,0 +1,398 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <GL/glew.h>
+
+#include "gl_handles.hpp"
+#include "memory_tracker.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+// Where captured frames go, chosen from the path: "dir/" writes one PPM per frame into the directory, "*.y4m" a
+// raw 4:4:4 YUV4MPEG2 stream, anything else is piped to a local ffmpeg that encodes to that file.
+class CaptureWriter
+{
+public:
+    enum Format { PPM_SEQUENCE, Y4M, FFMPEG };
+
+    explicit CaptureWriter(const std::string& path, int fps = 75) : path(path), fps(fps)
+    {
+        if (!path.empty() && (path.back() == '/' || path.back() == '\\'))
+            format = PPM_SEQUENCE;
+        else if (path.size() > 4 && path.compare(path.size() - 4, 4, ".y4m") == 0)
+            format = Y4M;
+        else
+            format = FFMPEG;
+    }
+
+    ~CaptureWriter() { close(); }
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    // starts a stream of width x height frames; a later size starts a new numbered one ("a.y4m", "a_1.y4m" ...)
+    bool open(int newWidth, int newHeight)
+    {
+        close();
+        width = newWidth;
+        height = newHeight;
+        std::string target = segmentPath();
+        segment++;
+        if (format == Y4M)
+        {
+            file = fopen(target.c_str(), "wb");
+            if (file)
+                fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444 XCOLORRANGE=FULL\n", width, height, fps);
+        }
+        else if (format == FFMPEG)
+        {
+            std::string command = "ffmpeg -y -loglevel error -f rawvideo -pix_fmt rgba -s " + std::to_string(width) + "x" +
+                                  std::to_string(height) + " -r " + std::to_string(fps) + " -i - -c:v libx264 -pix_fmt yuv420p \"" + target + "\"";
+            file = popen(command.c_str(), "w");
+            piped = file != nullptr;
+        }
+        else
+        {
+            return true;   // one file per frame
+        }
+        if (!file)
+            std::cout << "ERROR::CAPTURE:: Could not open " << target << std::endl;
+        return file != nullptr;
+    }
+
+    // rgba is a bottom-up frame as glReadPixels returns it, rows are written top-down
+    bool write(const uint8_t* rgba)
+    {
+        size_t stride = static_cast<size_t>(width) * 4;
+        if (format == PPM_SEQUENCE)
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "%06llu.ppm", (unsigned long long)frames);
+            FILE* out = fopen((path + name).c_str(), "wb");
+            if (!out)
+                return false;
+            fprintf(out, "P6\n%d %d\n255\n", width, height);
+            row.resize(static_cast<size_t>(width) * 3);
+            for (int y = height - 1; y >= 0; y--)
+            {
+                const uint8_t* src = rgba + y * stride;
+                for (int x = 0; x < width; x++)
+                {
+                    row[x * 3 + 0] = src[x * 4 + 0];
+                    row[x * 3 + 1] = src[x * 4 + 1];
+                    row[x * 3 + 2] = src[x * 4 + 2];
+                }
+                fwrite(row.data(), 1, row.size(), out);
+            }
+            fclose(out);
+        }
+        else if (!file)
+        {
+            return false;
+        }
+        else if (format == Y4M)
+        {
+            // BT.601 full range, planes one after another
+            size_t pixels = static_cast<size_t>(width) * height;
+            planes.resize(pixels * 3);
+            uint8_t* yPlane = planes.data();
+            uint8_t* uPlane = yPlane + pixels;
+            uint8_t* vPlane = uPlane + pixels;
+            size_t i = 0;
+            for (int y = height - 1; y >= 0; y--)
+            {
+                const uint8_t* src = rgba + y * stride;
+                for (int x = 0; x < width; x++, i++)
+                {
+                    int r = src[x * 4 + 0], g = src[x * 4 + 1], b = src[x * 4 + 2];
+                    yPlane[i] = static_cast<uint8_t>((77 * r + 150 * g + 29 * b + 128) >> 8);
+                    uPlane[i] = static_cast<uint8_t>(std::clamp(((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128, 0, 255));
+                    vPlane[i] = static_cast<uint8_t>(std::clamp(((128 * r - 107 * g - 21 * b + 128) >> 8) + 128, 0, 255));
+                }
+            }
+            fputs("FRAME\n", file);
+            fwrite(planes.data(), 1, planes.size(), file);
+        }
+        else
+        {
+            for (int y = height - 1; y >= 0; y--)
+                fwrite(rgba + y * stride, 1, stride, file);
+        }
+        frames++;
+        return true;
+    }
+
+    void close()
+    {
+        if (!file)
+            return;
+        if (piped)
+            pclose(file);
+        else
+            fclose(file);
+        file = nullptr;
+        piped = false;
+    }
+
+    Format streamFormat() const { return format; }
+    uint64_t framesWritten() const { return frames; }
+
+private:
+    std::string path;
+    int fps;
+    Format format;
+    FILE* file = nullptr;
+    bool piped = false;
+    int width = 0, height = 0;
+    int segment = 0;
+    uint64_t frames = 0;
+    std::vector<uint8_t> row, planes;
+
+    std::string segmentPath() const
+    {
+        if (segment == 0 || format == PPM_SEQUENCE)
+            return path;
+        size_t dot = path.find_last_of('.');
+        size_t slash = path.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            dot = path.size();
+        return path.substr(0, dot) + "_" + std::to_string(segment) + path.substr(dot);
+    }
+};
+
+// Reads the finished frame back without stalling: glReadPixels goes into one of a ring of pixel buffers with a
+// fence behind it, and only a buffer whose fence has passed is mapped. The mapping is handed straight to the
+// encoder thread, which converts and writes from it, so the render thread never copies a frame; the buffer is
+// unmapped and reused once the encoder is done with it. When every buffer is busy (the GPU or the encoder is
+// behind) the frame is dropped and counted, so memory stays at the ring size. A frame whose fence or mapping
+// fails is dropped the same way instead of holding its buffer forever.
+class FrameCapture
+{
+public:
+    struct Stats {
+        uint64_t captured = 0;
+        uint64_t dropped = 0;      // every buffer of the ring was busy, or the readback failed
+        uint64_t written = 0;
+        double renderMs = 0.0;     // render thread time of the last capture() call
+        double maxRenderMs = 0.0;
+        int busySlots = 0;
+    };
+
+    explicit FrameCapture(const std::string& path, int ringSize = 4) : writer(path), slots(std::max(ringSize, 2))
+    {
+        encoder = std::thread([this] { encodeLoop(); });
+    }
+
+    ~FrameCapture()
+    {
+        finishSegment();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        wake.notify_all();
+        encoder.join();
+        for (Slot& slot : slots)
+            slot.buffer.reset();
+    }
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // after the frame is complete and before the swap, with the default framebuffer bound
+    void capture(int frameWidth, int frameHeight)
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (frameWidth != width || frameHeight != height)
+            resize(frameWidth, frameHeight);
+
+        collect(false);
+
+        Slot* target = nullptr;
+        for (int i = 0; i < static_cast<int>(slots.size()) && !target; i++)
+        {
+            Slot& slot = slots[(next + i) % slots.size()];
+            if (slot.state == FREE)
+            {
+                target = &slot;
+                next = (next + i + 1) % slots.size();
+            }
+        }
+        if (target)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, target->buffer);
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            target->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            target->sequence = issued++;
+            target->state = PENDING;
+            stats.captured++;
+        }
+        else
+        {
+            stats.dropped++;
+        }
+
+        stats.busySlots = 0;
+        for (const Slot& slot : slots)
+            stats.busySlots += slot.state != FREE;
+        stats.written = writtenFrames;
+        stats.renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        stats.maxRenderMs = std::max(stats.maxRenderMs, stats.renderMs);
+    }
+
+    const Stats& lastStats() const { return stats; }
+    int slotCount() const { return static_cast<int>(slots.size()); }
+    size_t bufferBytes() const { return slots.size() * static_cast<size_t>(width) * height * 4; }
+
+private:
+    enum SlotState { FREE, PENDING, MAPPED, DONE };
+
+    struct Slot {
+        GLBuffer buffer;
+        GLsync fence = 0;
+        uint64_t sequence = 0;
+        std::atomic<int> state{ FREE };
+        const uint8_t* data = nullptr;
+    };
+
+    CaptureWriter writer;
+    std::vector<Slot> slots;
+    int next = 0;
+    int width = 0, height = 0;
+    uint64_t issued = 0;
+    Stats stats;
+
+    std::thread encoder;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Slot*> queue;
+    bool running = true;
+    std::atomic<uint64_t> writtenFrames{ 0 };
+
+    // Unmaps what the encoder finished and hands over every pending frame whose fence has passed, oldest first.
+    // With wait it blocks until every buffer is free again, for a resize or the end.
+    void collect(bool wait)
+    {
+        for (;;)
+        {
+            for (Slot& slot : slots)
+                if (slot.state == DONE)
+                {
+                    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+                    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                    slot.data = nullptr;
+                    slot.state = FREE;
+                }
+
+            Slot* oldest = nullptr;
+            for (Slot& slot : slots)
+                if (slot.state == PENDING && (!oldest || slot.sequence < oldest->sequence))
+                    oldest = &slot;
+            if (oldest)
+            {
+                GLenum result = glClientWaitSync(oldest->fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000ull : 0);
+                if (result == GL_TIMEOUT_EXPIRED && !wait)
+                    return;
+                glDeleteSync(oldest->fence);
+                oldest->fence = 0;
+                const uint8_t* data = nullptr;
+                if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+                {
+                    glBindBuffer(GL_PIXEL_PACK_BUFFER, oldest->buffer);
+                    data = static_cast<const uint8_t*>(
+                        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(width) * height * 4, GL_MAP_READ_BIT));
+                    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                }
+                // a failed wait, a fence still not done after a second of waiting, or a failed map: the frame is
+                // dropped and the buffer, which is not mapped, goes straight back to the ring
+                if (!data)
+                {
+                    stats.dropped++;
+                    oldest->state = FREE;
+                    continue;
+                }
+                oldest->data = data;
+                oldest->state = MAPPED;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    queue.push_back(oldest);
+                }
+                wake.notify_one();
+                continue;
+            }
+            if (!wait)
+                return;
+            bool busy = false;
+            for (const Slot& slot : slots)
+                busy = busy || slot.state != FREE;
+            if (!busy)
+                return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    void finishSegment()
+    {
+        if (width == 0)
+            return;
+        collect(true);
+        std::lock_guard<std::mutex> lock(mutex);
+        writer.close();
+    }
+
+    void resize(int newWidth, int newHeight)
+    {
+        finishSegment();
+        width = std::max(newWidth, 1);
+        height = std::max(newHeight, 1);
+        for (Slot& slot : slots)
+        {
+            if (!slot.buffer)
+                slot.buffer = GLBuffer::create();
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(width) * height * 4, NULL, GL_STREAM_READ);
+            memoryTracker.track(MemoryTracker::BUFFER, slot.buffer, static_cast<size_t>(width) * height * 4, MemoryCategory::Streaming, "frame capture");
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        std::lock_guard<std::mutex> lock(mutex);
+        writer.open(width, height);
+    }
+
+    void encodeLoop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            wake.wait(lock, [this] { return !queue.empty() || !running; });
+            if (queue.empty())
+                return;
+            Slot* slot = queue.front();
+            queue.pop_front();
+            // the writer is only swapped with the queue empty and under this lock, so it can be used unlocked
+            lock.unlock();
+            if (slot->data && writer.write(slot->data))
+                writtenFrames++;
+            slot->state = DONE;
+            lock.lock();
+        }
+    }
+};
+#endif
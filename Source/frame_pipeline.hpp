@@ -0,0 +1,80 @@
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Window input recorded by the GLFW callbacks on the main thread and applied by the simulation.
+struct InputEvent {
+    enum class Type { Key, MouseButton, CursorMove };
+    Type type;
+    int code = 0;     // key or mouse button
+    int action = 0;   // GLFW_PRESS, GLFW_RELEASE, GLFW_REPEAT
+    double x = 0.0, y = 0.0;
+};
+
+class InputQueue
+{
+public:
+    void push(const InputEvent& e)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back(e);
+    }
+
+    // hands over everything queued so far; out is cleared first
+    void drain(std::vector<InputEvent>& out)
+    {
+        out.clear();
+        std::lock_guard<std::mutex> lock(mutex);
+        std::swap(out, events);
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<InputEvent> events;
+};
+
+// Three copies of T exchanged between one writer and one reader. The writer fills writeBuffer() and publishes it,
+// the reader takes the newest published copy; neither ever waits for the other to finish with its copy, and
+// published frames the reader was too slow for are simply replaced. The slots are reused, so vectors inside T
+// keep their capacity between frames.
+template <typename T>
+class TripleBuffer
+{
+public:
+    T& writeBuffer() { return slots[writeIndex]; }
+    const T& readBuffer() const { return slots[readIndex]; }
+
+    void publish()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::swap(writeIndex, readyIndex);
+            fresh = true;
+        }
+        ready.notify_one();
+    }
+
+    // moves the newest published copy into readBuffer(), false if nothing new came within the timeout
+    bool acquire(std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!ready.wait_for(lock, timeout, [this] { return fresh; }))
+            return false;
+        std::swap(readIndex, readyIndex);
+        fresh = false;
+        return true;
+    }
+
+private:
+    T slots[3];
+    int writeIndex = 0, readyIndex = 1, readIndex = 2;
+    bool fresh = false;
+    std::mutex mutex;
+    std::condition_variable ready;
+};
+#endif
@@ -0,0 +1,62 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+struct BoundingSphere {
+    glm::vec3 center;
+    float radius;
+};
+
+// View frustum as six inward facing planes (a, b, c, d with a*x + b*y + c*z + d >= 0 inside).
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // planes of a projection * view matrix (Gribb/Hartmann)
+    static Frustum fromMatrix(const glm::mat4& m)
+    {
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        Frustum f;
+        f.planes[0] = row3 + row0; // left
+        f.planes[1] = row3 - row0; // right
+        f.planes[2] = row3 + row1; // bottom
+        f.planes[3] = row3 - row1; // top
+        f.planes[4] = row3 + row2; // near
+        f.planes[5] = row3 - row2; // far
+        for (auto& p : f.planes)
+        {
+            float len = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+            if (len > 0.0f)
+                p = p / len;
+        }
+        return f;
+    }
+
+    bool intersects(const BoundingSphere& s) const
+    {
+        for (const auto& p : planes)
+        {
+            if (p.x * s.center.x + p.y * s.center.y + p.z * s.center.z + p.w < -s.radius)
+                return false;
+        }
+        return true;
+    }
+};
+
+// bounds of a model after it was placed with the given model matrix
+inline BoundingSphere transformSphere(const BoundingSphere& local, const glm::mat4& model)
+{
+    glm::vec4 c = model * glm::vec4(local.center, 1.0f);
+    float sx = glm::length(glm::vec3(model[0]));
+    float sy = glm::length(glm::vec3(model[1]));
+    float sz = glm::length(glm::vec3(model[2]));
+    return { glm::vec3(c), local.radius * std::max(sx, std::max(sy, sz)) };
+}
+#endif
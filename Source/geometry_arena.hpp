@@ -0,0 +1,344 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <GL/glew.h>
+
+#include "gl_handles.hpp"
+#include "memory_tracker.hpp"
+#include "render_stats.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+struct VertexAttribute {
+    GLuint location;
+    GLint size;
+    GLenum type;
+    size_t offset;
+};
+
+struct VertexFormat {
+    GLsizei stride;
+    std::vector<VertexAttribute> attributes;
+};
+
+// Same layout as glMultiDrawElementsIndirect expects, so a vector of these can be uploaded as is.
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
+// location of one mesh inside the arena buffers
+struct ArenaRange {
+    GLint  baseVertex = 0;
+    GLuint firstIndex = 0;
+    GLuint indexCount = 0;
+    GLuint vertexCount = 0;
+
+    DrawElementsIndirectCommand command(GLuint instances = 1, GLuint baseInstance = 0) const
+    {
+        return { indexCount, instances, firstIndex, baseVertex, baseInstance };
+    }
+};
+
+// Suballocates static meshes from one large vertex buffer and one large index buffer that share a single VAO.
+// All meshes of a vertex format are then drawn with one VAO bind, and batches of them with one multi-draw call.
+// Freed ranges go on a free list that later allocations take from first, so reloading a model reuses its space.
+class GeometryArena
+{
+public:
+    GeometryArena(VertexFormat format, size_t vertexCapacity = 1 << 18, size_t indexCapacity = 1 << 20)
+        : format(format), vertexCapacity(vertexCapacity), indexCapacity(indexCapacity)
+    {
+    }
+
+    GLuint vao() { ensureCreated(); return VAO; }
+
+    size_t vertexBytes() const { return vertexCount * format.stride; }
+    size_t indexBytes() const { return indexCount * sizeof(GLuint); }
+
+    // copies the mesh data into the shared buffers, into freed space when a free range is large enough and at
+    // the end otherwise, growing the buffers when they are full
+    ArenaRange allocate(const void* vertices, size_t numVertices, const GLuint* indices, size_t numIndices)
+    {
+        ensureCreated();
+        size_t firstVertex = 0, firstIndex = 0;
+        bool reuseVertices = takeSpan(freeVertices, numVertices, firstVertex);
+        bool reuseIndices = takeSpan(freeIndices, numIndices, firstIndex);
+        size_t vertexEnd = reuseVertices ? vertexCount : vertexCount + numVertices;
+        size_t indexEnd = reuseIndices ? indexCount : indexCount + numIndices;
+        if (vertexEnd > vertexCapacity || indexEnd > indexCapacity)
+            grow(std::max(vertexCapacity * 2, vertexEnd), std::max(indexCapacity * 2, indexEnd));
+        if (!reuseVertices)
+            firstVertex = vertexCount;
+        if (!reuseIndices)
+            firstIndex = indexCount;
+
+        ArenaRange range;
+        range.baseVertex = static_cast<GLint>(firstVertex);
+        range.firstIndex = static_cast<GLuint>(firstIndex);
+        range.indexCount = static_cast<GLuint>(numIndices);
+        range.vertexCount = static_cast<GLuint>(numVertices);
+
+        // uploads go through the copy target so they never disturb the element buffer of whatever VAO is bound
+        glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, firstVertex * format.stride, numVertices * format.stride, vertices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, firstIndex * sizeof(GLuint), numIndices * sizeof(GLuint), indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        vertexCount = vertexEnd;
+        indexCount = indexEnd;
+        return range;
+    }
+
+    // gives a range back for later allocations; the buffers themselves never shrink
+    void free(const ArenaRange& range)
+    {
+        if (!VAO)
+            return;   // the arena was released first, at shutdown
+        giveSpan(freeVertices, vertexCount, range.baseVertex, range.vertexCount);
+        giveSpan(freeIndices, indexCount, range.firstIndex, range.indexCount);
+    }
+
+    // draws a single range; the arena VAO must be bound
+    void draw(const ArenaRange& range)
+    {
+        glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+                                 (void*)(range.firstIndex * sizeof(GLuint)), range.baseVertex);
+        frameStats.drawCalls++;
+    }
+
+    // Per-instance attributes for instanced draws, read from another buffer with a divisor of 1. They stay on
+    // the arena VAO until detachInstances, so every instanced draw in between must bind a program that reads them.
+    void attachInstances(GLuint buffer, const VertexFormat& instanceFormat)
+    {
+        ensureCreated();
+        GLuint previous = boundVertexArray;
+        bindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        for (const auto& a : instanceFormat.attributes)
+        {
+            glEnableVertexAttribArray(a.location);
+            glVertexAttribPointer(a.location, a.size, a.type, GL_FALSE, instanceFormat.stride, (void*)a.offset);
+            glVertexAttribDivisor(a.location, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        bindVertexArray(previous);
+    }
+
+    void detachInstances(const VertexFormat& instanceFormat)
+    {
+        GLuint previous = boundVertexArray;
+        bindVertexArray(VAO);
+        for (const auto& a : instanceFormat.attributes)
+            glDisableVertexAttribArray(a.location);
+        bindVertexArray(previous);
+    }
+
+    // Submits a whole batch with one call, each command drawn `instances` times. Uses indirect draws where the
+    // driver has them (GL 4.3 or ARB_multi_draw_indirect) and glMultiDrawElementsBaseVertex on plain GL 3.3,
+    // where instanced commands go out one glDrawElementsInstancedBaseVertex each.
+    void multiDraw(const std::vector<DrawElementsIndirectCommand>& commands, GLuint instances = 1)
+    {
+        if (commands.empty() || instances == 0)
+            return;
+        bindVertexArray(VAO);
+
+        if (GLEW_ARB_multi_draw_indirect)
+        {
+            const std::vector<DrawElementsIndirectCommand>* submitted = &commands;
+            if (instances != 1)
+            {
+                instancedCommands = commands;
+                for (auto& c : instancedCommands)
+                    c.instanceCount = instances;
+                submitted = &instancedCommands;
+            }
+            if (!indirectBuffer)
+                indirectBuffer = GLBuffer::create();
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            size_t bytes = submitted->size() * sizeof(DrawElementsIndirectCommand);
+            if (bytes > indirectCapacity)
+            {
+                indirectCapacity = std::max(bytes, indirectCapacity * 2);
+                glBufferData(GL_DRAW_INDIRECT_BUFFER, indirectCapacity, NULL, GL_STREAM_DRAW);
+                memoryTracker.track(MemoryTracker::BUFFER, indirectBuffer, indirectCapacity, MemoryCategory::Streaming, "geometry arena");
+            }
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, bytes, submitted->data());
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, static_cast<GLsizei>(submitted->size()), 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+        else if (instances != 1)
+        {
+            for (const auto& c : commands)
+            {
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, c.count, GL_UNSIGNED_INT, (void*)(c.firstIndex * sizeof(GLuint)),
+                                                  instances, c.baseVertex);
+                frameStats.drawCalls++;
+            }
+            return;
+        }
+        else
+        {
+            counts.clear();
+            offsets.clear();
+            baseVertices.clear();
+            for (const auto& c : commands)
+            {
+                counts.push_back(static_cast<GLsizei>(c.count));
+                offsets.push_back((const void*)(c.firstIndex * sizeof(GLuint)));
+                baseVertices.push_back(c.baseVertex);
+            }
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(),
+                                          static_cast<GLsizei>(commands.size()), baseVertices.data());
+        }
+        frameStats.drawCalls++;
+    }
+
+    void release()
+    {
+        if (!VAO)
+            return;
+        if (boundVertexArray == VAO)
+            bindVertexArray(0);
+        VAO.reset();
+        VBO.reset();
+        EBO.reset();
+        indirectBuffer.reset();
+        indirectCapacity = 0;
+        vertexCount = indexCount = 0;
+        freeVertices.clear();
+        freeIndices.clear();
+    }
+
+private:
+    VertexFormat format;
+    size_t vertexCapacity, indexCapacity;
+    size_t vertexCount = 0, indexCount = 0;   // end of the used part of each buffer
+    GLVertexArray VAO;
+    GLBuffer VBO, EBO;
+    GLBuffer indirectBuffer;
+    size_t indirectCapacity = 0;
+
+    // scratch arrays for the GL 3.3 path, kept to avoid allocating every frame
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    std::vector<GLint> baseVertices;
+    std::vector<DrawElementsIndirectCommand> instancedCommands;
+
+    // freed vertices or indices below the end of the used part, sorted and merged with their neighbours
+    struct Span {
+        size_t first, count;
+    };
+    std::vector<Span> freeVertices, freeIndices;
+
+    // first fit
+    static bool takeSpan(std::vector<Span>& spans, size_t count, size_t& first)
+    {
+        for (auto it = spans.begin(); it != spans.end(); ++it)
+        {
+            if (it->count < count)
+                continue;
+            first = it->first;
+            it->first += count;
+            it->count -= count;
+            if (it->count == 0)
+                spans.erase(it);
+            return true;
+        }
+        return false;
+    }
+
+    // a span that ends up touching the end of the used part moves the end back instead of staying on the list
+    static void giveSpan(std::vector<Span>& spans, size_t& end, size_t first, size_t count)
+    {
+        if (count == 0)
+            return;
+        auto it = std::lower_bound(spans.begin(), spans.end(), first, [](const Span& s, size_t f) { return s.first < f; });
+        it = spans.insert(it, { first, count });
+        if (it + 1 != spans.end() && it->first + it->count == (it + 1)->first)
+        {
+            it->count += (it + 1)->count;
+            spans.erase(it + 1);
+        }
+        if (it != spans.begin() && (it - 1)->first + (it - 1)->count == it->first)
+        {
+            (it - 1)->count += it->count;
+            it = spans.erase(it) - 1;
+        }
+        if (it->first + it->count == end)
+        {
+            end = it->first;
+            spans.erase(it);
+        }
+    }
+
+    void ensureCreated()
+    {
+        if (VAO)
+            return;
+        VAO = GLVertexArray::create();
+        VBO = GLBuffer::create();
+        EBO = GLBuffer::create();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * format.stride, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        trackBuffers();
+        setupVertexArray();
+    }
+
+    void setupVertexArray()
+    {
+        GLuint previous = boundVertexArray;
+        bindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        for (const auto& a : format.attributes)
+        {
+            glEnableVertexAttribArray(a.location);
+            glVertexAttribPointer(a.location, a.size, a.type, GL_FALSE, format.stride, (void*)a.offset);
+        }
+        bindVertexArray(previous);
+    }
+
+    // reallocates both buffers with more room and copies the existing meshes over on the GPU
+    void grow(size_t newVertexCapacity, size_t newIndexCapacity)
+    {
+        GLBuffer newVBO = GLBuffer::create();
+        GLBuffer newEBO = GLBuffer::create();
+
+        glBindBuffer(GL_COPY_READ_BUFFER, VBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newVBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, newVertexCapacity * format.stride, NULL, GL_STATIC_DRAW);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, vertexCount * format.stride);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, EBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newEBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, newIndexCapacity * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, indexCount * sizeof(GLuint));
+
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        VBO = std::move(newVBO);
+        EBO = std::move(newEBO);
+        vertexCapacity = newVertexCapacity;
+        indexCapacity = newIndexCapacity;
+        trackBuffers();
+        setupVertexArray();
+    }
+
+    // the meshes inside count as shares of their models, see Mesh::setupMesh
+    void trackBuffers()
+    {
+        memoryTracker.track(MemoryTracker::BUFFER, VBO, vertexCapacity * format.stride, MemoryCategory::Mesh, "geometry arena");
+        memoryTracker.track(MemoryTracker::BUFFER, EBO, indexCapacity * sizeof(GLuint), MemoryCategory::Mesh, "geometry arena");
+    }
+};
+#endif
@@ -0,0 +1,135 @@
+#ifndef GL_HANDLES_H
+#define GL_HANDLES_H
+
+#include <GL/glew.h>
+
+#include "memory_tracker.hpp"
+#include "render_stats.hpp"
+
+#include <atomic>
+#include <iostream>
+#include <utility>
+
+enum class GLResourceKind {
+    Buffer,
+    VertexArray,
+    Texture,
+    Program,
+    Framebuffer,
+    Count
+};
+
+inline const char* glResourceKindName(GLResourceKind kind)
+{
+    switch (kind)
+    {
+    case GLResourceKind::Buffer:      return "buffer";
+    case GLResourceKind::VertexArray: return "vertex array";
+    case GLResourceKind::Texture:     return "texture";
+    case GLResourceKind::Program:     return "program";
+    case GLResourceKind::Framebuffer: return "framebuffer";
+    default:                          return "unknown";
+    }
+}
+
+// number of handles of each kind that currently own a GL object
+inline std::atomic<int> liveGLHandles[static_cast<int>(GLResourceKind::Count)];
+
+// Move-only owner of a single GL object name. The object is deleted when the handle is destroyed or reset,
+// so a handle must not outlive the context it was created in. Deleting a buffer or texture also drops it from
+// the memory tracker, deleting a vertex array drops it from the bindVertexArray cache.
+template <GLResourceKind Kind>
+class GLHandle
+{
+public:
+    GLHandle() = default;
+    explicit GLHandle(GLuint id) : id(id)
+    {
+        if (id != 0)
+            liveGLHandles[static_cast<int>(Kind)]++;
+    }
+    ~GLHandle() { reset(); }
+
+    GLHandle(const GLHandle&) = delete;
+    GLHandle& operator=(const GLHandle&) = delete;
+
+    GLHandle(GLHandle&& other) noexcept : id(std::exchange(other.id, 0)) {}
+    GLHandle& operator=(GLHandle&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            id = std::exchange(other.id, 0);
+        }
+        return *this;
+    }
+
+    // generates a fresh object of this kind
+    static GLHandle create()
+    {
+        GLuint name = 0;
+        if constexpr (Kind == GLResourceKind::Buffer) glGenBuffers(1, &name);
+        else if constexpr (Kind == GLResourceKind::VertexArray) glGenVertexArrays(1, &name);
+        else if constexpr (Kind == GLResourceKind::Texture) glGenTextures(1, &name);
+        else if constexpr (Kind == GLResourceKind::Program) name = glCreateProgram();
+        else if constexpr (Kind == GLResourceKind::Framebuffer) glGenFramebuffers(1, &name);
+        return GLHandle(name);
+    }
+
+    GLuint get() const { return id; }
+    operator GLuint() const { return id; }
+    explicit operator bool() const { return id != 0; }
+
+    // gives up ownership without deleting the object
+    GLuint release()
+    {
+        if (id != 0)
+            liveGLHandles[static_cast<int>(Kind)]--;
+        return std::exchange(id, 0);
+    }
+
+    void reset(GLuint newId = 0)
+    {
+        if (id != 0)
+        {
+            if constexpr (Kind == GLResourceKind::Buffer) { memoryTracker.release(MemoryTracker::BUFFER, id); glDeleteBuffers(1, &id); }
+            else if constexpr (Kind == GLResourceKind::VertexArray) deleteVertexArray(id);
+            else if constexpr (Kind == GLResourceKind::Texture) { memoryTracker.release(MemoryTracker::TEXTURE, id); glDeleteTextures(1, &id); }
+            else if constexpr (Kind == GLResourceKind::Program) glDeleteProgram(id);
+            else if constexpr (Kind == GLResourceKind::Framebuffer) glDeleteFramebuffers(1, &id);
+            liveGLHandles[static_cast<int>(Kind)]--;
+        }
+        id = newId;
+        if (id != 0)
+            liveGLHandles[static_cast<int>(Kind)]++;
+    }
+
+private:
+    GLuint id = 0;
+};
+
+using GLBuffer = GLHandle<GLResourceKind::Buffer>;
+using GLVertexArray = GLHandle<GLResourceKind::VertexArray>;
+using GLTexture = GLHandle<GLResourceKind::Texture>;
+using GLProgram = GLHandle<GLResourceKind::Program>;
+using GLFramebuffer = GLHandle<GLResourceKind::Framebuffer>;
+
+// Debug builds list every handle kind that still owns objects. Call it right before the context is destroyed.
+inline void reportLeakedGLHandles()
+{
+#ifndef NDEBUG
+    bool clean = true;
+    for (int i = 0; i < static_cast<int>(GLResourceKind::Count); i++)
+    {
+        int live = liveGLHandles[i].load();
+        if (live != 0)
+        {
+            std::cout << "LEAK::GL:: " << live << " " << glResourceKindName(static_cast<GLResourceKind>(i)) << " object(s) still alive at shutdown" << std::endl;
+            clean = false;
+        }
+    }
+    if (clean)
+        std::cout << "GL handles: no leaks at shutdown" << std::endl;
+#endif
+}
+#endif
@@ -0,0 +1,175 @@
+#ifndef HOT_RELOAD_H
+#define HOT_RELOAD_H
+
+#include "file_watcher.hpp"
+#include "gl_handles.hpp"
+#include "model.hpp"
+#include "program_cache.hpp"
+
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// Reloads shader programs and models while the simulator runs. Files are re-read and models re-imported on the
+// watcher thread; compiling and uploading needs the GL context, so the results wait until applyPending() is
+// called on the render thread between two frames. A version that fails to compile or import is reported and the
+// old one stays in use.
+class HotReloader
+{
+public:
+    using ProgramInstall = std::function<void(GLProgram)>;
+    using SourceInstall = std::function<bool(std::string, std::string)>;
+    using ModelInstall = std::function<void(ModelData&&)>;
+
+    ~HotReloader() { watcher.stop(); }
+
+    // install receives the newly linked program
+    void watchProgram(const std::string& vertexPath, const std::string& fragmentPath, ProgramInstall install)
+    {
+        programs.push_back({ vertexPath, fragmentPath, canonical(vertexPath), canonical(fragmentPath), std::move(install), nullptr });
+    }
+
+    // for programs built from the sources by the owner, e.g. ShaderVariants; install returns false to reject them
+    void watchSources(const std::string& vertexPath, const std::string& fragmentPath, SourceInstall install)
+    {
+        programs.push_back({ vertexPath, fragmentPath, canonical(vertexPath), canonical(fragmentPath), nullptr, std::move(install) });
+    }
+
+    // any file in the model's directory (textures, .mtl) triggers a re-import, install uploads the result
+    void watchModel(const std::string& path, ModelInstall install)
+    {
+        std::string dir = canonical(std::filesystem::path(path).parent_path().string());
+        models.push_back({ path, dir, std::move(install) });
+    }
+
+    void start(const std::vector<std::string>& roots)
+    {
+        watcher.start(roots, [this](const std::vector<std::string>& files) { onChange(files); });
+        std::cout << "Hot reload: watching " << programs.size() << " programs and " << models.size() << " models" << std::endl;
+    }
+
+    // compiles and uploads whatever was reloaded since the last call, render thread only
+    void applyPending()
+    {
+        std::vector<PendingProgram> readyPrograms;
+        std::vector<PendingModel> readyModels;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pendingPrograms.empty() && pendingModels.empty())
+                return;
+            readyPrograms.swap(pendingPrograms);
+            readyModels.swap(pendingModels);
+        }
+
+        for (auto& p : readyPrograms)
+        {
+            const WatchedProgram& w = programs[p.index];
+            bool installed = false;
+            if (w.installSources)
+                installed = w.installSources(std::move(p.vertexSource), std::move(p.fragmentSource));
+            else if (GLProgram program = ProgramCache::compile(w.vertexPath, w.fragmentPath, std::move(p.vertexSource), std::move(p.fragmentSource)))
+            {
+                w.install(std::move(program));
+                installed = true;
+            }
+            if (!installed)
+            {
+                std::cout << "Hot reload: " << w.fragmentPath << " failed, keeping the previous program" << std::endl;
+                continue;
+            }
+            std::cout << "Hot reload: " << w.vertexPath << " + " << w.fragmentPath << " reloaded" << std::endl;
+        }
+        for (auto& m : readyModels)
+        {
+            const WatchedModel& w = models[m.index];
+            w.install(std::move(m.data));
+            std::cout << "Hot reload: " << w.path << " reloaded" << std::endl;
+        }
+    }
+
+private:
+    struct WatchedProgram {
+        std::string vertexPath, fragmentPath;
+        std::string vertexKey, fragmentKey;
+        ProgramInstall install;
+        SourceInstall installSources;
+    };
+    struct WatchedModel {
+        std::string path;
+        std::string directoryKey;
+        ModelInstall install;
+    };
+    struct PendingProgram {
+        size_t index;
+        std::string vertexSource, fragmentSource;
+    };
+    struct PendingModel {
+        size_t index;
+        ModelData data;
+    };
+
+    FileWatcher watcher;
+    std::vector<WatchedProgram> programs;   // fixed once start() was called
+    std::vector<WatchedModel> models;
+    std::mutex mutex;
+    std::vector<PendingProgram> pendingPrograms;
+    std::vector<PendingModel> pendingModels;
+
+    static std::string canonical(const std::string& path)
+    {
+        std::error_code ec;
+        auto result = std::filesystem::weakly_canonical(path, ec);
+        return ec ? path : result.string();
+    }
+
+    // watcher thread
+    void onChange(const std::vector<std::string>& files)
+    {
+        std::vector<std::string> keys;
+        for (const auto& f : files)
+            keys.push_back(canonical(f));
+        auto changed = [&](const std::string& key) {
+            for (const auto& k : keys)
+                if (k == key)
+                    return true;
+            return false;
+        };
+        auto changedBelow = [&](const std::string& dir) {
+            for (const auto& k : keys)
+                if (k.size() > dir.size() && k.compare(0, dir.size(), dir) == 0 && k[dir.size()] == '/')
+                    return true;
+            return false;
+        };
+
+        for (size_t i = 0; i < programs.size(); i++)
+        {
+            const WatchedProgram& w = programs[i];
+            if (!changed(w.vertexKey) && !changed(w.fragmentKey))
+                continue;
+            PendingProgram p{ i, ProgramCache::readFile(w.vertexPath), ProgramCache::readFile(w.fragmentPath) };
+            if (p.vertexSource.empty() || p.fragmentSource.empty())
+                continue;   // unreadable, e.g. caught between delete and rename; the next write retries
+            std::lock_guard<std::mutex> lock(mutex);
+            pendingPrograms.push_back(std::move(p));
+        }
+        for (size_t i = 0; i < models.size(); i++)
+        {
+            const WatchedModel& w = models[i];
+            if (!changedBelow(w.directoryKey))
+                continue;
+            PendingModel m{ i, importModel(w.path) };
+            if (!m.data.loaded)
+            {
+                std::cout << "Hot reload: " << w.path << " failed to import, keeping the previous model" << std::endl;
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            pendingModels.push_back(std::move(m));
+        }
+    }
+};
+#endif
@@ -0,0 +1,297 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "trace.hpp"
+
+class JobSystem;
+
+// Counts unfinished jobs. Waiting on a counter or scheduling continuations after it expresses dependencies:
+// a job started with runAfter(counter, ...) only becomes runnable once every job tracked by counter is done.
+class JobCounter
+{
+public:
+    bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+    std::atomic<int> pending{ 0 };
+    std::mutex continuationMutex;
+    std::vector<std::function<void()>> continuations;
+};
+
+struct WorkerStats {
+    uint64_t jobs = 0;
+    uint64_t steals = 0;
+    double busyMs = 0.0;
+};
+
+// Work-stealing scheduler. Every worker owns a deque: it pushes and pops its own jobs at the back and, when it
+// runs dry, steals from the front of another worker's deque. The thread that created the system is worker 0
+// and runs jobs while it waits, so a system with one worker runs everything inline on the caller.
+class JobSystem
+{
+public:
+    explicit JobSystem(unsigned workerCount = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        workerCount = std::max(1u, workerCount);
+        for (unsigned i = 0; i < workerCount; i++)
+            workers.push_back(std::make_unique<Worker>());
+        currentWorker() = 0;
+        for (unsigned i = 1; i < workerCount; i++)
+            threads.emplace_back([this, i] { workerLoop(i); });
+        windowStart = std::chrono::steady_clock::now();
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : threads)
+            t.join();
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    unsigned workerCount() const { return static_cast<unsigned>(workers.size()); }
+
+    // queues a job, counter (if any) is decremented once it finished
+    void run(std::function<void()> fn, JobCounter* counter = nullptr)
+    {
+        if (counter)
+            counter->pending.fetch_add(1, std::memory_order_relaxed);
+        push(Job{ std::move(fn), counter });
+    }
+
+    // queues a job that starts only when dependency has reached zero
+    void runAfter(JobCounter& dependency, std::function<void()> fn, JobCounter* counter = nullptr)
+    {
+        if (counter)
+            counter->pending.fetch_add(1, std::memory_order_relaxed);
+        Job job{ std::move(fn), counter };
+        std::unique_lock<std::mutex> lock(dependency.continuationMutex);
+        if (dependency.done())
+        {
+            lock.unlock();
+            push(std::move(job));
+            return;
+        }
+        auto shared = std::make_shared<Job>(std::move(job));
+        dependency.continuations.push_back([this, shared] { push(std::move(*shared)); });
+    }
+
+    // runs jobs until the counter reaches zero, the caller never just blocks
+    void wait(JobCounter& counter)
+    {
+        unsigned self = currentWorker();
+        while (!counter.done())
+        {
+            Job job;
+            if (findJob(self, job))
+                execute(self, job);
+            else
+                std::this_thread::yield();
+        }
+        // the last finish() may still hold the counter; once it let go the counter can be destroyed
+        { std::lock_guard<std::mutex> lock(counter.continuationMutex); }
+    }
+
+    // Calls fn(begin, end) over [0, count) in chunks of at least grain items and returns when all are done.
+    template <typename F>
+    void parallelFor(size_t count, size_t grain, F&& fn)
+    {
+        if (count == 0)
+            return;
+        grain = std::max<size_t>(grain, 1);
+        size_t chunks = std::min((count + grain - 1) / grain, static_cast<size_t>(workers.size()) * 4);
+        if (chunks <= 1)
+        {
+            fn(size_t(0), count);
+            return;
+        }
+        size_t chunkSize = (count + chunks - 1) / chunks;
+        JobCounter counter;
+        for (size_t begin = chunkSize; begin < count; begin += chunkSize)
+        {
+            size_t end = std::min(count, begin + chunkSize);
+            run([&fn, begin, end] { fn(begin, end); }, &counter);
+        }
+        // the caller takes the first chunk itself instead of idling
+        auto start = std::chrono::steady_clock::now();
+        fn(size_t(0), std::min(count, chunkSize));
+        Worker& self = *workers[currentWorker()];
+        self.busyNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+        wait(counter);
+    }
+
+    // Per-worker counters since the last call, with the busy fraction of the elapsed wall time.
+    std::vector<WorkerStats> takeStats(double* elapsedMs = nullptr)
+    {
+        auto now = std::chrono::steady_clock::now();
+        double window = std::chrono::duration<double, std::milli>(now - windowStart).count();
+        windowStart = now;
+        if (elapsedMs)
+            *elapsedMs = window;
+
+        std::vector<WorkerStats> result;
+        for (auto& w : workers)
+        {
+            WorkerStats s;
+            s.jobs = w->jobs.exchange(0);
+            s.steals = w->steals.exchange(0);
+            s.busyMs = w->busyNs.exchange(0) / 1e6;
+            result.push_back(s);
+        }
+        return result;
+    }
+
+private:
+    struct Job {
+        std::function<void()> fn;
+        JobCounter* counter = nullptr;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Job> jobs_;
+        std::atomic<uint64_t> jobs{ 0 };
+        std::atomic<uint64_t> steals{ 0 };
+        std::atomic<uint64_t> busyNs{ 0 };
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<int> queued{ 0 };
+    bool stopping = false;
+    std::chrono::steady_clock::time_point windowStart;
+
+    // index of the worker running on this thread; threads outside the system share worker 0's deque
+    static unsigned& currentWorker()
+    {
+        thread_local unsigned index = 0;
+        return index;
+    }
+
+    void push(Job job)
+    {
+        Worker& w = *workers[currentWorker()];
+        {
+            std::lock_guard<std::mutex> lock(w.mutex);
+            w.jobs_.push_back(std::move(job));
+        }
+        queued.fetch_add(1, std::memory_order_release);
+        // taking the lock orders the increment against a worker that is just about to sleep
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        wake.notify_one();
+    }
+
+    bool findJob(unsigned self, Job& out)
+    {
+        if (queued.load(std::memory_order_acquire) == 0)
+            return false;
+        {
+            Worker& own = *workers[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs_.empty())
+            {
+                out = std::move(own.jobs_.back());
+                own.jobs_.pop_back();
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        unsigned n = static_cast<unsigned>(workers.size());
+        for (unsigned k = 1; k < n; k++)
+        {
+            Worker& victim = *workers[(self + k) % n];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs_.empty())
+            {
+                out = std::move(victim.jobs_.front());
+                victim.jobs_.pop_front();
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                workers[self]->steals.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void execute(unsigned self, Job& job)
+    {
+        TRACE_ZONE("job");
+        auto start = std::chrono::steady_clock::now();
+        job.fn();
+        auto end = std::chrono::steady_clock::now();
+        Worker& w = *workers[self];
+        w.jobs.fetch_add(1, std::memory_order_relaxed);
+        w.busyNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), std::memory_order_relaxed);
+        if (job.counter)
+            finish(*job.counter);
+    }
+
+    // The decrement happens under the continuation mutex, so wait() cannot return and let the counter go out of
+    // scope while this still touches it. The continuations run after the lock is released, on the local copy.
+    void finish(JobCounter& counter)
+    {
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock(counter.continuationMutex);
+            if (counter.pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+            ready.swap(counter.continuations);
+        }
+        for (auto& c : ready)
+            c();
+    }
+
+    void workerLoop(unsigned index)
+    {
+        currentWorker() = index;
+        TRACE_THREAD("worker " + std::to_string(index));
+        while (true)
+        {
+            Job job;
+            if (findJob(index, job))
+            {
+                execute(index, job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) > 0; });
+            if (stopping)
+                return;
+        }
+    }
+};
+
+inline void printWorkerStats(JobSystem& jobs)
+{
+    double elapsed = 0.0;
+    std::vector<WorkerStats> stats = jobs.takeStats(&elapsed);
+    for (size_t i = 0; i < stats.size(); i++)
+    {
+        double utilization = elapsed > 0.0 ? 100.0 * stats[i].busyMs / elapsed : 0.0;
+        printf("  worker %zu: %llu jobs, %llu steals, %.1f%% busy\n", i,
+               (unsigned long long)stats[i].jobs, (unsigned long long)stats[i].steals, utilization);
+    }
+}
+#endif
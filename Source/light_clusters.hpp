@@ -0,0 +1,219 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LIGHT_CLUSTERS_SSE 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LIGHT_CLUSTERS_NEON 1
+#endif
+
+// A point light with a hard range. Past radius it adds nothing, which is what lets it be culled.
+struct PointLight {
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+    float intensity;
+};
+
+// Bins point lights into a grid of view-space clusters: screen tiles times exponentially spaced depth slices.
+// The result is flat arrays ready for buffer textures: per cluster an (offset, count) pair into one shared
+// list of light indices, and per light two vec4s. A fragment looks up its cluster and loops only over that
+// cluster's lights. Pure CPU code, the renderer uploads the arrays.
+class LightClusters
+{
+public:
+    static constexpr int GRID_X = 16, GRID_Y = 9, GRID_Z = 24;
+    static constexpr int CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+
+    std::vector<uint32_t> clusterTable;   // offset, count per cluster, x fastest, then y, then depth slice
+    std::vector<uint32_t> lightIndices;
+    std::vector<glm::vec4> lightData;     // position + radius, color * intensity per light
+
+    // view and projection as used for rendering; projection must be a symmetric perspective
+    void build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection)
+    {
+        updateGrid(projection);
+
+        lightData.resize(lights.size() * 2);
+        pairs.clear();
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            const PointLight& light = lights[i];
+            lightData[i * 2] = glm::vec4(light.position, light.radius);
+            lightData[i * 2 + 1] = glm::vec4(light.color * light.intensity, 0.0f);
+            glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+            binLight(static_cast<uint32_t>(i), center, light.radius);
+        }
+
+        // counting sort of the (cluster, light) pairs into one index list
+        clusterTable.assign(CLUSTER_COUNT * 2, 0);
+        for (const auto& p : pairs)
+            clusterTable[p.first * 2 + 1]++;
+        uint32_t offset = 0;
+        for (int c = 0; c < CLUSTER_COUNT; c++)
+        {
+            clusterTable[c * 2] = offset;
+            offset += clusterTable[c * 2 + 1];
+        }
+        lightIndices.resize(pairs.size());
+        scratch.assign(CLUSTER_COUNT, 0);
+        for (const auto& p : pairs)
+            lightIndices[clusterTable[p.first * 2] + scratch[p.first]++] = p.second;
+    }
+
+    // log(depth) * x + y gives the depth slice, shared with basic.frag
+    glm::vec2 sliceParams() const
+    {
+        float scale = GRID_Z / std::log(farPlane / nearPlane);
+        return glm::vec2(scale, -std::log(nearPlane) * scale);
+    }
+
+    size_t assignmentCount() const { return lightIndices.size(); }
+
+    unsigned maxLightsPerCluster() const
+    {
+        uint32_t most = 0;
+        for (int c = 0; c < CLUSTER_COUNT; c++)
+            most = std::max(most, clusterTable[c * 2 + 1]);
+        return most;
+    }
+
+private:
+    float nearPlane = 0.0f, farPlane = 0.0f, tanX = 0.0f, tanY = 0.0f;
+    std::vector<float> sliceDepth;   // GRID_Z + 1 boundaries, positive distances
+    // view-space AABB of every cluster, structure of arrays so four neighbouring tiles test at once
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    std::vector<uint32_t> scratch;
+
+    void updateGrid(const glm::mat4& projection)
+    {
+        float n = projection[3][2] / (projection[2][2] - 1.0f);
+        float f = projection[3][2] / (projection[2][2] + 1.0f);
+        float ty = 1.0f / projection[1][1];
+        float tx = 1.0f / projection[0][0];
+        if (n == nearPlane && f == farPlane && tx == tanX && ty == tanY)
+            return;
+        nearPlane = n;
+        farPlane = f;
+        tanX = tx;
+        tanY = ty;
+
+        sliceDepth.resize(GRID_Z + 1);
+        for (int k = 0; k <= GRID_Z; k++)
+            sliceDepth[k] = nearPlane * std::pow(farPlane / nearPlane, static_cast<float>(k) / GRID_Z);
+
+        for (auto* v : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ })
+            v->resize(CLUSTER_COUNT);
+        for (int k = 0; k < GRID_Z; k++)
+        {
+            float dn = sliceDepth[k], df = sliceDepth[k + 1];
+            for (int y = 0; y < GRID_Y; y++)
+            {
+                float y0 = -1.0f + 2.0f * y / GRID_Y, y1 = -1.0f + 2.0f * (y + 1) / GRID_Y;
+                for (int x = 0; x < GRID_X; x++)
+                {
+                    float x0 = -1.0f + 2.0f * x / GRID_X, x1 = -1.0f + 2.0f * (x + 1) / GRID_X;
+                    int c = (k * GRID_Y + y) * GRID_X + x;
+                    minX[c] = std::min(x0 * dn, x0 * df) * tanX;
+                    maxX[c] = std::max(x1 * dn, x1 * df) * tanX;
+                    minY[c] = std::min(y0 * dn, y0 * df) * tanY;
+                    maxY[c] = std::max(y1 * dn, y1 * df) * tanY;
+                    minZ[c] = -df;
+                    maxZ[c] = -dn;
+                }
+            }
+        }
+    }
+
+    int sliceOf(float depth) const
+    {
+        int k = static_cast<int>(std::upper_bound(sliceDepth.begin(), sliceDepth.end(), depth) - sliceDepth.begin()) - 1;
+        return std::clamp(k, 0, GRID_Z - 1);
+    }
+
+    // tile range covered by [lo, hi] in view units over depths [dn, df], conservative
+    static void tileRange(float lo, float hi, float dn, float df, float tanHalf, int tiles, int& first, int& last)
+    {
+        float a = lo / (dn * tanHalf), b = lo / (df * tanHalf);
+        float c = hi / (dn * tanHalf), d = hi / (df * tanHalf);
+        float ndcLo = std::min(a, b), ndcHi = std::max(c, d);
+        first = std::clamp(static_cast<int>(std::floor((ndcLo * 0.5f + 0.5f) * tiles)), 0, tiles - 1);
+        last = std::clamp(static_cast<int>(std::floor((ndcHi * 0.5f + 0.5f) * tiles)), 0, tiles - 1);
+    }
+
+    void binLight(uint32_t light, const glm::vec3& center, float radius)
+    {
+        float depth = -center.z;
+        if (depth + radius < nearPlane || depth - radius > farPlane)
+            return;
+        float dn = std::max(depth - radius, nearPlane), df = std::min(depth + radius, farPlane);
+        int k0 = sliceOf(dn), k1 = sliceOf(df);
+        int x0, x1, y0, y1;
+        tileRange(center.x - radius, center.x + radius, dn, df, tanX, GRID_X, x0, x1);
+        tileRange(center.y - radius, center.y + radius, dn, df, tanY, GRID_Y, y0, y1);
+
+        float r2 = radius * radius;
+        for (int k = k0; k <= k1; k++)
+        {
+            for (int y = y0; y <= y1; y++)
+            {
+                int row = (k * GRID_Y + y) * GRID_X;
+                int x = x0;
+#if defined(LIGHT_CLUSTERS_SSE)
+                __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+                __m128 zero = _mm_setzero_ps(), limit = _mm_set1_ps(r2);
+                for (; x + 3 <= x1; x += 4)
+                {
+                    int c = row + x;
+                    // distance from the center to each box, per axis: max(min - p, 0, p - max)
+                    __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minX[c]), cx), zero), _mm_sub_ps(cx, _mm_loadu_ps(&maxX[c])));
+                    __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minY[c]), cy), zero), _mm_sub_ps(cy, _mm_loadu_ps(&maxY[c])));
+                    __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minZ[c]), cz), zero), _mm_sub_ps(cz, _mm_loadu_ps(&maxZ[c])));
+                    __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                    int mask = _mm_movemask_ps(_mm_cmple_ps(d2, limit));
+                    for (int i = 0; i < 4; i++)
+                        if (mask & (1 << i))
+                            pairs.emplace_back(c + i, light);
+                }
+#elif defined(LIGHT_CLUSTERS_NEON)
+                float32x4_t cx = vdupq_n_f32(center.x), cy = vdupq_n_f32(center.y), cz = vdupq_n_f32(center.z);
+                float32x4_t zero = vdupq_n_f32(0.0f), limit = vdupq_n_f32(r2);
+                for (; x + 3 <= x1; x += 4)
+                {
+                    int c = row + x;
+                    float32x4_t dx = vmaxq_f32(vmaxq_f32(vsubq_f32(vld1q_f32(&minX[c]), cx), zero), vsubq_f32(cx, vld1q_f32(&maxX[c])));
+                    float32x4_t dy = vmaxq_f32(vmaxq_f32(vsubq_f32(vld1q_f32(&minY[c]), cy), zero), vsubq_f32(cy, vld1q_f32(&maxY[c])));
+                    float32x4_t dz = vmaxq_f32(vmaxq_f32(vsubq_f32(vld1q_f32(&minZ[c]), cz), zero), vsubq_f32(cz, vld1q_f32(&maxZ[c])));
+                    float32x4_t d2 = vaddq_f32(vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy)), vmulq_f32(dz, dz));
+                    uint32_t inside[4];
+                    vst1q_u32(inside, vcleq_f32(d2, limit));
+                    for (int i = 0; i < 4; i++)
+                        if (inside[i])
+                            pairs.emplace_back(c + i, light);
+                }
+#endif
+                for (; x <= x1; x++)
+                {
+                    int c = row + x;
+                    float dx = std::max(std::max(minX[c] - center.x, 0.0f), center.x - maxX[c]);
+                    float dy = std::max(std::max(minY[c] - center.y, 0.0f), center.y - maxY[c]);
+                    float dz = std::max(std::max(minZ[c] - center.z, 0.0f), center.z - maxZ[c]);
+                    if (dx * dx + dy * dy + dz * dz <= r2)
+                        pairs.emplace_back(c, light);
+                }
+            }
+        }
+    }
+};
+#endif
@@ -0,0 +1,113 @@
+#ifndef MATERIAL_REQUIREMENTS_H
+#define MATERIAL_REQUIREMENTS_H
+
+#include <assimp/scene.h>
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <string>
+
+// A material texture type and the sampler the shaders read it through, numbered from 1: uDiffMap1, uDiffMap2 ...
+struct MaterialTextureSlot {
+    aiTextureType type;
+    const char* sampler;
+    const char* name;
+};
+
+inline const MaterialTextureSlot materialTextureSlots[] = {
+    { aiTextureType_DIFFUSE,           "uDiffMap",     "diffuse" },
+    { aiTextureType_SPECULAR,          "uSpecMap",     "specular" },
+    { aiTextureType_NORMALS,           "uNormalMap",   "normal" },
+    { aiTextureType_METALNESS,         "uMetalMap",    "metalness" },
+    { aiTextureType_DIFFUSE_ROUGHNESS, "uRoughMap",    "roughness" },
+    { aiTextureType_EMISSIVE,          "uEmissiveMap", "emissive" },
+};
+
+// The material texture types model import decodes and uploads. Textures of every other type are left on disk,
+// so a new kind of map costs nothing until a shader declares a sampler for it.
+class MaterialRequirements
+{
+public:
+    static MaterialRequirements all()
+    {
+        MaterialRequirements r;
+        for (const auto& slot : materialTextureSlots)
+            r.mask |= bit(slot.type);
+        return r;
+    }
+
+    // the types whose samplers the shader declares, in any of its variants
+    static MaterialRequirements fromShader(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::MATERIAL:: Could not read " << path << ", every texture type is loaded" << std::endl;
+            return all();
+        }
+        std::stringstream source;
+        source << file.rdbuf();
+        return fromSource(source.str());
+    }
+
+    static MaterialRequirements fromSource(const std::string& source)
+    {
+        MaterialRequirements r;
+        static const std::regex declaration(R"(uniform\s+sampler2D\s+([A-Za-z_]+)[0-9]+\s*;)");
+        for (std::sregex_iterator it(source.begin(), source.end(), declaration), end; it != end; ++it)
+            for (const auto& slot : materialTextureSlots)
+                if ((*it)[1] == slot.sampler)
+                    r.mask |= bit(slot.type);
+        return r;
+    }
+
+    // a comma separated list of slot names, such as "diffuse,specular"; false when a name is unknown
+    static bool fromList(const std::string& list, MaterialRequirements& out)
+    {
+        MaterialRequirements r;
+        std::stringstream names(list);
+        std::string name;
+        while (std::getline(names, name, ','))
+        {
+            bool known = false;
+            for (const auto& slot : materialTextureSlots)
+            {
+                if (name == slot.name)
+                {
+                    r.mask |= bit(slot.type);
+                    known = true;
+                }
+            }
+            if (!known)
+            {
+                std::cout << "ERROR::MATERIAL:: Unknown texture type " << name << std::endl;
+                return false;
+            }
+        }
+        out = r;
+        return true;
+    }
+
+    bool samples(aiTextureType type) const { return (mask & bit(type)) != 0; }
+
+    std::string describe() const
+    {
+        std::string text;
+        for (const auto& slot : materialTextureSlots)
+            if (samples(slot.type))
+                text += (text.empty() ? "" : ", ") + std::string(slot.name);
+        return text.empty() ? "none" : text;
+    }
+
+private:
+    uint32_t mask = 0;
+
+    static uint32_t bit(aiTextureType type) { return 1u << static_cast<unsigned>(type); }
+};
+
+// What importModel loads unless told otherwise. Set once in main, before the first model is read.
+inline MaterialRequirements modelMaterialRequirements = MaterialRequirements::all();
+#endif
@@ -0,0 +1,319 @@
+#ifndef MEMORY_TRACKER_H
+#define MEMORY_TRACKER_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+enum class MemoryCategory {
+    Mesh,           // static vertex and index data
+    Texture,        // material and UI images
+    RenderTarget,   // framebuffer attachments and shadow maps
+    Font,           // glyph textures and the text quad buffer
+    Streaming,      // buffers refilled every frame: instances, light clusters, capture read back
+    Count
+};
+
+inline const char* memoryCategoryName(MemoryCategory category)
+{
+    switch (category)
+    {
+    case MemoryCategory::Mesh:         return "meshes";
+    case MemoryCategory::Texture:      return "textures";
+    case MemoryCategory::RenderTarget: return "render targets";
+    case MemoryCategory::Font:         return "fonts";
+    case MemoryCategory::Streaming:    return "streaming";
+    default:                           return "unknown";
+    }
+}
+
+// Size of a 2D texture of the given internal format as drivers tend to store it, RGB padded to four bytes.
+// A mip chain adds a third; layers counts cube faces.
+inline size_t textureBytes(GLenum internalFormat, int width, int height, bool mipmaps = false, int layers = 1)
+{
+    size_t texel = 4;
+    switch (internalFormat)
+    {
+    case GL_RED: case GL_R8:                  texel = 1; break;
+    case GL_RG: case GL_RG8:                  texel = 2; break;
+    case GL_RGBA16F: case GL_RG32UI:          texel = 8; break;
+    case GL_RGBA32F:                          texel = 16; break;
+    default:                                  texel = 4; break;   // RGB(A)8, depth 24 and 32
+    }
+    size_t bytes = texel * static_cast<size_t>(std::max(width, 0)) * static_cast<size_t>(std::max(height, 0)) * layers;
+    return mipmaps ? bytes + bytes / 3 : bytes;
+}
+
+// Names the asset that allocations on this thread belong to while it is in scope, so a model can tag the
+// buffers and textures its meshes create without passing its name down.
+class MemoryOwner
+{
+public:
+    explicit MemoryOwner(std::string name) : previous(std::exchange(current(), std::move(name))) {}
+    ~MemoryOwner() { current() = std::move(previous); }
+
+    MemoryOwner(const MemoryOwner&) = delete;
+    MemoryOwner& operator=(const MemoryOwner&) = delete;
+
+    static std::string& current()
+    {
+        thread_local std::string owner = "other";
+        return owner;
+    }
+
+private:
+    std::string previous;
+};
+
+// GPU and CPU memory per asset and category. GPU memory is recorded per GL object when its storage is specified
+// and dropped when a GLHandle deletes it; specifying it again replaces the old size. CPU memory is set per asset.
+// Keeps high-water marks and warns once each time a total goes over its budget.
+class MemoryTracker
+{
+public:
+    enum Object : uint64_t { BUFFER, TEXTURE };
+
+    void track(Object object, GLuint id, size_t bytes, MemoryCategory category, const std::string& owner = MemoryOwner::current())
+    {
+        if (id == 0)
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto [it, added] = objects.try_emplace(key(object, id));
+        if (!added)
+            remove(it->second);
+        it->second = { owner, category, bytes };
+        Usage& usage = owners[owner];
+        usage.gpu[index(category)] += bytes;
+        usage.peak = std::max(usage.peak, usage.total());
+        categoryBytes[index(category)] += bytes;
+        categoryPeak[index(category)] = std::max(categoryPeak[index(category)], categoryBytes[index(category)]);
+        gpuTotal += bytes;
+        gpuPeak = std::max(gpuPeak, gpuTotal);
+        checkBudget("GPU", gpuTotal, gpuBudget, gpuOver, owner, category);
+    }
+
+    void release(Object object, GLuint id)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = objects.find(key(object, id));
+        if (it == objects.end())
+            return;
+        remove(it->second);
+        objects.erase(it);
+    }
+
+    // The current owner's part of a buffer another owner holds, like a mesh in the geometry arena. Shown with
+    // the owner but not added to the totals, the holder already counts it.
+    void share(MemoryCategory category, size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Usage& usage = owners[MemoryOwner::current()];
+        usage.shared[index(category)] += bytes;
+        usage.peak = std::max(usage.peak, usage.total());
+    }
+
+    // gives back a share taken with share(), by the owner that took it
+    void unshare(const std::string& owner, MemoryCategory category, size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = owners.find(owner);
+        if (it == owners.end())
+            return;
+        size_t& shared = it->second.shared[index(category)];
+        shared -= std::min(shared, bytes);
+    }
+
+    // RAM an asset keeps after loading, replacing what was set for it before
+    void setCpu(const std::string& owner, MemoryCategory category, size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Usage& usage = owners[owner];
+        cpuTotal = cpuTotal - usage.cpu[index(category)] + bytes;
+        cpuPeak = std::max(cpuPeak, cpuTotal);
+        usage.cpu[index(category)] = bytes;
+        usage.peak = std::max(usage.peak, usage.total());
+        checkBudget("CPU", cpuTotal, cpuBudget, cpuOver, owner, category);
+    }
+
+    // zero for no budget
+    void setBudget(size_t gpuBytes, size_t cpuBytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        gpuBudget = gpuBytes;
+        cpuBudget = cpuBytes;
+    }
+
+    size_t gpuBytes() const { std::lock_guard<std::mutex> lock(mutex); return gpuTotal; }
+    size_t gpuPeakBytes() const { std::lock_guard<std::mutex> lock(mutex); return gpuPeak; }
+    size_t cpuBytes() const { std::lock_guard<std::mutex> lock(mutex); return cpuTotal; }
+    size_t cpuPeakBytes() const { std::lock_guard<std::mutex> lock(mutex); return cpuPeak; }
+
+    // totals, then the owners costing the most, for the stats output and the on-screen overlay
+    std::vector<std::string> summaryLines(size_t maxOwners) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::string> lines;
+        char line[256];
+        snprintf(line, sizeof(line), "GPU %.1f MB (peak %.1f%s), RAM %.1f MB (peak %.1f%s)", mb(gpuTotal), mb(gpuPeak),
+                 budgetText(gpuBudget).c_str(), mb(cpuTotal), mb(cpuPeak), budgetText(cpuBudget).c_str());
+        lines.push_back(line);
+        std::string categories;
+        for (int c = 0; c < static_cast<int>(MemoryCategory::Count); c++)
+        {
+            snprintf(line, sizeof(line), "%s%s %.1f", c ? ", " : "", memoryCategoryName(static_cast<MemoryCategory>(c)), mb(categoryBytes[c]));
+            categories += line;
+        }
+        lines.push_back(categories + " MB");
+        for (const auto& [owner, usage] : sortedOwners(maxOwners))
+        {
+            snprintf(line, sizeof(line), "%-28.28s %7.2f MB GPU %7.2f MB RAM", displayName(*owner).c_str(), mb(usage->gpuTotal()),
+                     mb(usage->cpuTotal()));
+            lines.push_back(line);
+        }
+        return lines;
+    }
+
+    // every owner with its bytes per category, plus totals and high-water marks
+    bool writeJson(const std::string& path) const
+    {
+        FILE* file = fopen(path.c_str(), "w");
+        if (!file)
+        {
+            printf("ERROR::MEMORY:: Could not write %s\n", path.c_str());
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        fprintf(file, "{\n  \"gpu_bytes\": %zu, \"gpu_peak_bytes\": %zu, \"gpu_budget_bytes\": %zu,\n", gpuTotal, gpuPeak, gpuBudget);
+        fprintf(file, "  \"cpu_bytes\": %zu, \"cpu_peak_bytes\": %zu, \"cpu_budget_bytes\": %zu,\n", cpuTotal, cpuPeak, cpuBudget);
+        fprintf(file, "  \"categories\": {");
+        for (int c = 0; c < static_cast<int>(MemoryCategory::Count); c++)
+            fprintf(file, "%s\n    \"%s\": { \"gpu_bytes\": %zu, \"gpu_peak_bytes\": %zu }", c ? "," : "",
+                    memoryCategoryName(static_cast<MemoryCategory>(c)), categoryBytes[c], categoryPeak[c]);
+        fprintf(file, "\n  },\n  \"owners\": [");
+        bool first = true;
+        for (const auto& [owner, usage] : sortedOwners(owners.size()))
+        {
+            fprintf(file, "%s\n    { \"owner\": \"%s\", \"peak_bytes\": %zu", first ? "" : ",", owner->c_str(), usage->peak);
+            for (int c = 0; c < static_cast<int>(MemoryCategory::Count); c++)
+            {
+                if (usage->gpu[c] + usage->shared[c] + usage->cpu[c] == 0)
+                    continue;
+                fprintf(file, ", \"%s\": { \"gpu_bytes\": %zu, \"shared_gpu_bytes\": %zu, \"cpu_bytes\": %zu }",
+                        memoryCategoryName(static_cast<MemoryCategory>(c)), usage->gpu[c], usage->shared[c], usage->cpu[c]);
+            }
+            fprintf(file, " }");
+            first = false;
+        }
+        fprintf(file, "\n  ]\n}\n");
+        fclose(file);
+        return true;
+    }
+
+private:
+    static const int CATEGORIES = static_cast<int>(MemoryCategory::Count);
+
+    struct Allocation {
+        std::string owner;
+        MemoryCategory category = MemoryCategory::Mesh;
+        size_t bytes = 0;
+    };
+
+    struct Usage {
+        size_t gpu[CATEGORIES] = {};
+        size_t shared[CATEGORIES] = {};
+        size_t cpu[CATEGORIES] = {};
+        size_t peak = 0;
+
+        size_t gpuTotal() const
+        {
+            size_t sum = 0;
+            for (int c = 0; c < CATEGORIES; c++) sum += gpu[c] + shared[c];
+            return sum;
+        }
+        size_t cpuTotal() const
+        {
+            size_t sum = 0;
+            for (int c = 0; c < CATEGORIES; c++) sum += cpu[c];
+            return sum;
+        }
+        size_t total() const { return gpuTotal() + cpuTotal(); }
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, Allocation> objects;
+    std::map<std::string, Usage> owners;
+    size_t categoryBytes[CATEGORIES] = {};
+    size_t categoryPeak[CATEGORIES] = {};
+    size_t gpuTotal = 0, gpuPeak = 0, gpuBudget = 0;
+    size_t cpuTotal = 0, cpuPeak = 0, cpuBudget = 0;
+    bool gpuOver = false, cpuOver = false;
+
+    static uint64_t key(Object object, GLuint id) { return (static_cast<uint64_t>(object) << 32) | id; }
+    static int index(MemoryCategory category) { return static_cast<int>(category); }
+    static double mb(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+    static std::string budgetText(size_t budget)
+    {
+        if (budget == 0)
+            return "";
+        char text[32];
+        snprintf(text, sizeof(text), ", budget %.0f", mb(budget));
+        return text;
+    }
+
+    // paths of assets without the leading ../
+    static std::string displayName(const std::string& owner)
+    {
+        size_t start = 0;
+        while (owner.compare(start, 3, "../") == 0)
+            start += 3;
+        return owner.substr(start);
+    }
+
+    void remove(const Allocation& a)
+    {
+        Usage& usage = owners[a.owner];
+        usage.gpu[index(a.category)] -= a.bytes;
+        categoryBytes[index(a.category)] -= a.bytes;
+        gpuTotal -= a.bytes;
+        if (gpuBudget && gpuTotal <= gpuBudget)
+            gpuOver = false;
+    }
+
+    void checkBudget(const char* kind, size_t total, size_t budget, bool& over, const std::string& owner, MemoryCategory category)
+    {
+        if (budget == 0 || total <= budget)
+        {
+            over = false;
+            return;
+        }
+        if (over)
+            return;
+        over = true;
+        printf("WARNING::MEMORY:: %s memory %.1f MB is over the %.1f MB budget, last allocation: %s %s\n", kind, mb(total), mb(budget),
+               displayName(owner).c_str(), memoryCategoryName(category));
+    }
+
+    std::vector<std::pair<const std::string*, const Usage*>> sortedOwners(size_t count) const
+    {
+        std::vector<std::pair<const std::string*, const Usage*>> sorted;
+        for (const auto& [owner, usage] : owners)
+            if (usage.total() > 0)
+                sorted.push_back({ &owner, &usage });
+        std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second->total() > b.second->total(); });
+        if (sorted.size() > count)
+            sorted.resize(count);
+        return sorted;
+    }
+};
+
+inline MemoryTracker memoryTracker;
+#endif
@@ -9,91 +9,174 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shader.hpp"
+#include "geometry_arena.hpp"
+#include "gl_handles.hpp"
+#include "memory_tracker.hpp"
+#include "render_stats.hpp"
+#include "vertex.hpp"
 
 #include <string>
+#include <utility>
 #include <vector>
 using namespace std;
 
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-};
-
 struct Texture {
     unsigned int id;
     string type;
     string path;
 };
 
+// every static mesh with the standard Vertex layout is suballocated from this arena
+inline GeometryArena& staticMeshArena()
+{
+    static GeometryArena arena(VertexFormat{ sizeof(Vertex), {
+        { 0, 3, GL_FLOAT, offsetof(Vertex, Position) },
+        { 1, 3, GL_FLOAT, offsetof(Vertex, Normal) },
+        { 2, 2, GL_FLOAT, offsetof(Vertex, TexCoords) }
+    } });
+    return arena;
+}
+
+// binds the textures of a mesh to consecutive units and points the uDiffMapN/uSpecMapN samplers at them
+inline void bindMeshTextures(Shader& shader, const vector<Texture>& textures)
+{
+    for (unsigned int i = 0; i < textures.size(); i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
+        // retrieve texture number (the N in uDiffMapN), counted per sampler prefix
+        const string& name = textures[i].type;
+        unsigned int n = 1;
+        for (unsigned int j = 0; j < i; j++)
+            if (textures[j].type == name)
+                n++;
+        string number = std::to_string(n);
+
+        // now set the sampler to the correct texture unit
+        glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+        // and finally bind the texture
+        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+    }
+}
+
 class Mesh {
 public:
     // mesh Data
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
-    unsigned int VAO;
-
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    unsigned int VAO = 0;
+    unsigned int indexCount = 0;
+    // where the mesh lives when it was suballocated from a shared arena (arena == nullptr otherwise)
+    GeometryArena* arena = nullptr;
+    ArenaRange range;
+
+    // constructor, takes the mesh data over without copying it
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, GeometryArena* arena = nullptr)
+        : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)), arena(arena)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        indexCount = static_cast<unsigned int>(this->indices.size());
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
     }
 
+    // meshes own GL objects or an arena range, so they can only be moved
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    Mesh(Mesh&& other) noexcept { *this = std::move(other); }
+    Mesh& operator=(Mesh&& other) noexcept
+    {
+        if (this == &other)
+            return *this;
+        releaseRange();
+        vertices = std::move(other.vertices);
+        indices = std::move(other.indices);
+        textures = std::move(other.textures);
+        VAO = other.VAO;
+        indexCount = other.indexCount;
+        arena = std::exchange(other.arena, nullptr);
+        range = other.range;
+        memoryOwner = std::move(other.memoryOwner);
+        ownVAO = std::move(other.ownVAO);
+        VBO = std::move(other.VBO);
+        EBO = std::move(other.EBO);
+        return *this;
+    }
+
+    ~Mesh() { releaseRange(); }
+
+    // frees the CPU copies of the vertex and index data once they live on the GPU
+    void releaseCpuData()
+    {
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+    }
+
     // render the mesh
     void Draw(Shader& shader)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr = 1;
-        for (unsigned int i = 0; i < textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if (name == "uDiffMap")
-                number = std::to_string(diffuseNr++);
-            else
-                number = std::to_string(specularNr++); // transfer unsigned int to string
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
-        }
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        bindMeshTextures(shader, textures);
+        DrawGeometry();
 
         // always good practice to set everything back to defaults once configured.
         glActiveTexture(GL_TEXTURE0);
     }
 
+    // vertices only, for depth passes that bind no textures
+    void DrawGeometry()
+    {
+        if (arena)
+        {
+            bindVertexArray(arena->vao());
+            arena->draw(range);
+        }
+        else
+        {
+            bindVertexArray(VAO);
+            glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+            frameStats.drawCalls++;
+        }
+        frameStats.meshesSubmitted++;
+    }
+
 private:
-    // render data 
-    unsigned int VBO, EBO;
+    // render data, only owned when the mesh is not in an arena
+    GLVertexArray ownVAO;
+    GLBuffer VBO, EBO;
+    // who the arena range is accounted to as a share
+    string memoryOwner;
+
+    size_t sharedBytes() const { return range.vertexCount * sizeof(Vertex) + range.indexCount * sizeof(unsigned int); }
+
+    // gives the arena range back, so a reloaded model does not strand the space of the one it replaces
+    void releaseRange()
+    {
+        if (!arena)
+            return;
+        arena->free(range);
+        memoryTracker.unshare(memoryOwner, MemoryCategory::Mesh, sharedBytes());
+        arena = nullptr;
+    }
 
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
+        if (arena)
+        {
+            range = arena->allocate(vertices.data(), vertices.size(), indices.data(), indices.size());
+            VAO = arena->vao();
+            memoryOwner = MemoryOwner::current();
+            memoryTracker.share(MemoryCategory::Mesh, sharedBytes());
+            return;
+        }
+
         // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        ownVAO = GLVertexArray::create();
+        VBO = GLBuffer::create();
+        EBO = GLBuffer::create();
+        VAO = ownVAO;
 
-        glBindVertexArray(VAO);
+        bindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
@@ -103,6 +186,8 @@ private:
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        memoryTracker.track(MemoryTracker::BUFFER, VBO, vertices.size() * sizeof(Vertex), MemoryCategory::Mesh);
+        memoryTracker.track(MemoryTracker::BUFFER, EBO, indices.size() * sizeof(unsigned int), MemoryCategory::Mesh);
 
         // set the vertex attribute pointers
         // vertex Positions
@@ -1,29 +1,43 @@
 #ifndef MODEL_H
 #define MODEL_H
-#include "../Header/stb_image.h"
-
 #include <GL/glew.h> 
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
-
+#include "frustum.hpp"
+#include "memory_tracker.hpp"
 #include "mesh.hpp"
+#include "model_import.hpp"
 #include "shader.hpp"
+#include "shader_variants.hpp"
+#include "trace.hpp"
 
+#include <algorithm>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <vector>
+#include <cfloat>
 
 using namespace std;
 
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
+unsigned int uploadTexture(const ImageData& image, bool gamma = false);
+
+// the GL format of an image layout
+inline GLenum glImageFormat(ImageFormat format)
+{
+    switch (format)
+    {
+    case ImageFormat::Red:  return GL_RED;
+    case ImageFormat::RGBA: return GL_RGBA;
+    default:                return GL_RGB;
+    }
+}
 
 class Model
 {
@@ -33,199 +47,290 @@ public:
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    GeometryArena* arena;
+    BoundingSphere bounds;  // in model space, encloses every vertex
+
+    // constructor, expects a filepath to a 3D model. Meshes are suballocated from the given arena
+    // (pass nullptr to give every mesh its own VAO). With keepCpuData set to false the vertex and
+    // index arrays are dropped as soon as they are uploaded.
+    Model(string const& path, bool gamma = false, GeometryArena* arena = &staticMeshArena(), bool keepCpuData = true)
+        : Model(importModel(path, modelMaterialRequirements, false), gamma, arena, keepCpuData)
+    {
+    }
 
-    // constructor, expects a filepath to a 3D model.
-    Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
+    // uploads a model that was already read with importModel; its GL objects and kept CPU copies are
+    // accounted to the model's path in the memory tracker
+    Model(ModelData data, bool gamma = false, GeometryArena* arena = &staticMeshArena(), bool keepCpuData = true)
+        : directory(data.directory), gammaCorrection(gamma), arena(arena)
     {
-        loadModel(path);
+        if (!data.skippedTextures.empty())
+        {
+            string types;
+            for (const auto& t : data.skippedTextures)
+                if (types.find(t.type) == string::npos)
+                    types += (types.empty() ? "" : ", ") + t.type;
+            printf("%s: %zu unsampled textures skipped (%s), %.1f MB decoded and %.1f MB GPU saved\n", data.path.c_str(),
+                   data.skippedTextures.size(), types.c_str(), data.skippedDecodedBytes() / (1024.0 * 1024.0),
+                   data.skippedGpuBytes() / (1024.0 * 1024.0));
+        }
+        MemoryOwner owner(data.path);
+        upload(data);
+        computeBounds();
+        buildBatches();
+        if (!keepCpuData)
+        {
+            for (auto& mesh : meshes)
+                mesh.releaseCpuData();
+        }
+        size_t cpuBytes = 0;
+        for (const auto& mesh : meshes)
+            cpuBytes += mesh.vertices.capacity() * sizeof(Vertex) + mesh.indices.capacity() * sizeof(unsigned int);
+        memoryTracker.setCpu(data.path, MemoryCategory::Mesh, cpuBytes);
     }
 
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+    Model(Model&&) noexcept = default;
+    Model& operator=(Model&&) noexcept = default;
+
     // draws the model, and thus all its meshes
     void Draw(Shader& shader)
     {
-        for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        if (!arena)
+        {
+            for (unsigned int i = 0; i < meshes.size(); i++)
+                meshes[i].Draw(shader);
+            return;
+        }
+
+        // meshes sharing a texture set go out as one multi-draw from the shared arena VAO
+        for (auto& batch : batches)
+        {
+            bindMeshTextures(shader, batch.textures);
+            arena->multiDraw(batch.commands);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        frameStats.meshesSubmitted += static_cast<unsigned int>(meshes.size());
     }
 
-private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const& path)
+    // depth passes: the geometry alone, whatever program is bound
+    void DrawGeometry()
     {
-        // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        // check for errors
-        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+        if (!arena)
         {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            for (auto& mesh : meshes)
+                mesh.DrawGeometry();
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        for (auto& batch : batches)
+            arena->multiDraw(batch.commands);
+        frameStats.meshesSubmitted += static_cast<unsigned int>(meshes.size());
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode* node, const aiScene* scene)
+    // `instances` copies of every batch in one submission each. The per-instance attributes have to be attached
+    // to the arena (GeometryArena::attachInstances); models with their own VAOs draw nothing.
+    void DrawInstanced(ShaderVariants& variants, unsigned features, GLuint instances)
     {
-        // process each mesh located at the current node
-        for (unsigned int i = 0; i < node->mNumMeshes; i++)
+        if (!arena || instances == 0)
+            return;
+        for (auto& batch : batches)
         {
-            // the node object only contains indices to index the actual objects in the scene. 
-            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            Shader& shader = variants.use(features | batch.features);
+            bindMeshTextures(shader, batch.textures);
+            arena->multiDraw(batch.commands, instances);
         }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
-        for (unsigned int i = 0; i < node->mNumChildren; i++)
+        glActiveTexture(GL_TEXTURE0);
+        frameStats.meshesSubmitted += static_cast<unsigned int>(meshes.size());
+    }
+
+    // Draws every batch with the cheapest variant for its textures: meshes without a diffuse map take albedo
+    // as a constant instead of sampling, and only textures with real transparency keep their alpha.
+    void Draw(ShaderVariants& variants, const glm::vec4& albedo = glm::vec4(1.0f), unsigned features = 0)
+    {
+        variants.setVec4("uAlbedo", albedo);
+        if (!arena)
         {
-            processNode(node->mChildren[i], scene);
+            for (auto& mesh : meshes)
+                mesh.Draw(variants.use(features | materialFeatures(mesh.textures)));
+            return;
         }
 
+        for (auto& batch : batches)
+        {
+            Shader& shader = variants.use(features | batch.features);
+            bindMeshTextures(shader, batch.textures);
+            arena->multiDraw(batch.commands);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        frameStats.meshesSubmitted += static_cast<unsigned int>(meshes.size());
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    // the variant features Draw and DrawInstanced use for this model when called with `features`
+    vector<unsigned> shaderFeatureSets(unsigned features = 0) const
     {
-        // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
+        vector<unsigned> sets;
+        if (arena)
+            for (const auto& batch : batches)
+                sets.push_back(features | batch.features);
+        else
+            for (const auto& mesh : meshes)
+                sets.push_back(features | materialFeatures(mesh.textures));
+        return sets;
+    }
+
+private:
+    // owns every texture in textures_loaded, the Texture structs only carry the raw ids
+    vector<GLTexture> ownedTextures;
+    // diffuse textures with at least one pixel that is not fully opaque
+    vector<unsigned int> translucentTextures;
+
+    struct DrawBatch {
         vector<Texture> textures;
+        unsigned features;  // ShaderFeature bits the textures need
+        vector<DrawElementsIndirectCommand> commands;
+    };
+    vector<DrawBatch> batches;
+
+    static bool sameTextures(const vector<Texture>& a, const vector<Texture>& b)
+    {
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); i++)
+            if (a[i].id != b[i].id || a[i].type != b[i].type)
+                return false;
+        return true;
+    }
 
-        // walk through each of the mesh's vertices
-        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+    unsigned materialFeatures(const vector<Texture>& textures) const
+    {
+        unsigned features = 0;
+        for (const auto& t : textures)
         {
-            Vertex vertex;
-            glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-            // positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
-            // normals
-            if (mesh->HasNormals())
+            if (t.type == "uDiffMap")
             {
-                vector.x = mesh->mNormals[i].x;
-                vector.y = mesh->mNormals[i].y;
-                vector.z = mesh->mNormals[i].z;
-                vertex.Normal = vector;
+                features |= FEATURE_DIFFUSE_MAP;
+                if (std::find(translucentTextures.begin(), translucentTextures.end(), t.id) != translucentTextures.end())
+                    features |= FEATURE_ALPHA_BLEND;
             }
-            // texture coordinates
-            if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+            else if (t.type == "uSpecMap")
+                features |= FEATURE_SPECULAR_MAP;
+        }
+        return features;
+    }
+
+    // sphere around the axis aligned box of all vertices, taken while the CPU copies still exist
+    void computeBounds()
+    {
+        glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+        for (const auto& mesh : meshes)
+        {
+            for (const auto& v : mesh.vertices)
             {
-                glm::vec2 vec;
-                // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
-                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x;
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
+                lo = glm::min(lo, v.Position);
+                hi = glm::max(hi, v.Position);
             }
-            else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-            vertices.push_back(vertex);
         }
-        // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
-        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+        if (lo.x > hi.x)
         {
-            aiFace face = mesh->mFaces[i];
-            // retrieve all indices of the face and store them in the indices vector
-            for (unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
+            bounds = { glm::vec3(0.0f), 0.0f };
+            return;
         }
-        // process materials
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-        // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
-        // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
-        // Same applies to other texture as the following list summarizes:
-        // diffuse: texture_diffuseN
-
-        // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "uDiffMap");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "uSpecMap");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        bounds.center = (lo + hi) * 0.5f;
+        bounds.radius = glm::length(hi - bounds.center);
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+    // groups the meshes by texture set, since textures are the only state that changes between meshes of a model
+    void buildBatches()
     {
-        vector<Texture> textures;
-        for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+        if (!arena)
+            return;
+        for (auto& mesh : meshes)
         {
-            aiString str;
-            mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for (unsigned int j = 0; j < textures_loaded.size(); j++)
+            DrawBatch* batch = nullptr;
+            for (auto& b : batches)
             {
-                if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
+                if (sameTextures(b.textures, mesh.textures))
                 {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
+                    batch = &b;
                     break;
                 }
             }
-            if (!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
+            if (!batch)
+            {
+                batches.push_back({ mesh.textures, materialFeatures(mesh.textures), {} });
+                batch = &batches.back();
             }
+            batch->commands.push_back(mesh.range.command());
         }
-        return textures;
     }
-};
 
+    // creates the GL objects: one texture per image, then the meshes. The pixels of each image are freed as
+    // soon as its texture holds them.
+    void upload(ModelData& data)
+    {
+        TRACE_ZONE("Model::upload");
+        vector<unsigned int> imageIds;
+        for (auto& image : data.images)
+        {
+            if (data.imagesDeferred)
+                decodeImage(image, data.directory);
+            unsigned int id = uploadTexture(image, gammaCorrection);
+            ownedTextures.emplace_back(id);
+            imageIds.push_back(id);
+            if (image.components == 4)
+            {
+                const unsigned char* pixels = image.pixels.get();
+                for (size_t i = 3; i < image.byteCount(); i += 4)
+                {
+                    if (pixels[i] != 255)
+                    {
+                        translucentTextures.push_back(id);
+                        break;
+                    }
+                }
+            }
+            textures_loaded.push_back({ id, image.type, image.path });
+            image.pixels.reset();
+        }
 
+        meshes.reserve(data.meshes.size());
+        for (auto& m : data.meshes)
+        {
+            vector<Texture> textures;
+            textures.reserve(m.textures.size());
+            for (const auto& ref : m.textures)
+                textures.push_back({ imageIds[ref.image], ref.type, data.images[ref.image].path });
+            meshes.emplace_back(std::move(m.vertices), std::move(m.indices), std::move(textures), arena);
+        }
+    }
+};
 
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
+unsigned int uploadTexture(const ImageData& image, bool gamma)
 {
-    string filename = string(path);
-    filename = directory + '/' + filename;
-
     unsigned int textureID;
     glGenTextures(1, &textureID);
+    if (!image.pixels)
+        return textureID;
 
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
+    GLenum format = glImageFormat(imageFormat(image.components));
+
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get());
+    glGenerateMipmap(GL_TEXTURE_2D);
+    memoryTracker.track(MemoryTracker::TEXTURE, textureID, textureBytes(format, image.width, image.height, true), MemoryCategory::Texture);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     return textureID;
 }
+
+unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
+{
+    return uploadTexture(loadImage(path, directory), gamma);
+}
 #endif
 
@@ -0,0 +1,301 @@
+#ifndef MODEL_IMPORT_H
+#define MODEL_IMPORT_H
+#include "../Header/stb_image.h"
+
+#include <glm/glm.hpp>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include "material_requirements.hpp"
+#include "trace.hpp"
+#include "vertex.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Reading models and decoding their images, without any GL. The simulator uploads what this produces through
+// model.hpp; the asset audit and the microbenchmarks use it as is and link no GL at all.
+
+// hands a buffer from stbi_load back to stb_image
+struct StbiImageFree {
+    void operator()(unsigned char* pixels) const { stbi_image_free(pixels); }
+};
+
+// texture pixels decoded on the CPU, ready for glTexImage2D; the buffer stbi_load returned is kept as is
+struct ImageData {
+    string path;    // as the material references it, relative to the model directory
+    string type;    // sampler name prefix of its first use, uDiffMap or uSpecMap
+    int width = 0, height = 0, components = 0;
+    unique_ptr<unsigned char, StbiImageFree> pixels;   // null when not decoded (yet) or when decoding failed
+
+    size_t byteCount() const { return pixels ? static_cast<size_t>(width) * height * components : 0; }
+};
+
+ImageData loadImage(const char* path, const string& directory);
+// decodes the file an image only knows the path of
+bool decodeImage(ImageData& image, const string& directory);
+
+// texel layout uploadTexture stores an image with this many components in
+enum class ImageFormat { Red, RGB, RGBA };
+
+inline ImageFormat imageFormat(int components)
+{
+    if (components == 1)
+        return ImageFormat::Red;
+    if (components == 4)
+        return ImageFormat::RGBA;
+    return ImageFormat::RGB;
+}
+
+// GPU bytes of the uploaded texture with its mip chain, counted like textureBytes counts the GL formats: red
+// is one byte per texel, RGB is padded to four
+inline size_t imageGpuBytes(int components, int width, int height)
+{
+    size_t texel = imageFormat(components) == ImageFormat::Red ? 1 : 4;
+    size_t bytes = texel * static_cast<size_t>(std::max(width, 0)) * static_cast<size_t>(std::max(height, 0));
+    return bytes + bytes / 3;
+}
+
+struct MeshData {
+    struct TextureRef {
+        int image;      // index into ModelData::images
+        string type;
+    };
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<TextureRef> textures;
+};
+
+// a material texture of a type no shader samples, left undecoded; the size is read from the file header
+struct SkippedTexture {
+    string path;
+    string type;
+    int width = 0, height = 0, components = 0;
+};
+
+// Everything read from disk for one model and no GL objects, so it can be produced on any thread
+// and turned into a Model later on the thread that owns the context.
+struct ModelData {
+    string path;
+    string directory;
+    vector<MeshData> meshes;
+    vector<ImageData> images;
+    unsigned materialCount = 0;
+    vector<SkippedTexture> skippedTextures;
+    bool imagesDeferred = false;   // images are listed by path only and decoded one at a time by the upload
+    bool loaded = false;
+
+    // what decoding and uploading the skipped textures would have cost
+    size_t skippedDecodedBytes() const
+    {
+        size_t bytes = 0;
+        for (const auto& t : skippedTextures)
+            bytes += static_cast<size_t>(t.width) * t.height * t.components;
+        return bytes;
+    }
+    size_t skippedGpuBytes() const
+    {
+        size_t bytes = 0;
+        for (const auto& t : skippedTextures)
+            bytes += imageGpuBytes(t.components, t.width, t.height);
+        return bytes;
+    }
+};
+
+// copies the vertices and triangle indices of an ASSIMP mesh into our own layout
+inline void convertGeometry(const aiMesh* mesh, MeshData& result)
+{
+    vector<Vertex>& vertices = result.vertices;
+    vector<unsigned int>& indices = result.indices;
+    vertices.reserve(mesh->mNumVertices);
+    indices.reserve(mesh->mNumFaces * 3);
+
+    // walk through each of the mesh's vertices
+    for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+    {
+        Vertex vertex;
+        glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
+        // positions
+        vector.x = mesh->mVertices[i].x;
+        vector.y = mesh->mVertices[i].y;
+        vector.z = mesh->mVertices[i].z;
+        vertex.Position = vector;
+        // normals
+        if (mesh->HasNormals())
+        {
+            vector.x = mesh->mNormals[i].x;
+            vector.y = mesh->mNormals[i].y;
+            vector.z = mesh->mNormals[i].z;
+            vertex.Normal = vector;
+        }
+        // texture coordinates
+        if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+        {
+            glm::vec2 vec;
+            // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
+            // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
+            vec.x = mesh->mTextureCoords[0][i].x;
+            vec.y = mesh->mTextureCoords[0][i].y;
+            vertex.TexCoords = vec;
+        }
+        else
+            vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+
+        vertices.push_back(vertex);
+    }
+    // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+    {
+        aiFace face = mesh->mFaces[i];
+        // retrieve all indices of the face and store them in the indices vector
+        for (unsigned int j = 0; j < face.mNumIndices; j++)
+            indices.push_back(face.mIndices[j]);
+    }
+}
+
+// checks all material textures of a given type and decodes the images that are not loaded yet.
+inline void loadMaterialTextures(aiMaterial* mat, aiTextureType type, const string& typeName, ModelData& data, vector<MeshData::TextureRef>& textures)
+{
+    for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+    {
+        aiString str;
+        mat->GetTexture(type, i, &str);
+        // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
+        int image = -1;
+        for (unsigned int j = 0; j < data.images.size(); j++)
+        {
+            if (std::strcmp(data.images[j].path.data(), str.C_Str()) == 0)
+            {
+                image = static_cast<int>(j); // a texture with the same filepath has already been loaded (optimization)
+                break;
+            }
+        }
+        if (image < 0)
+        {   // if texture hasn't been loaded already, load it (or only note it, for the upload to decode)
+            if (data.imagesDeferred)
+                data.images.emplace_back().path = str.C_Str();
+            else
+                data.images.push_back(loadImage(str.C_Str(), data.directory));
+            data.images.back().type = typeName;
+            image = static_cast<int>(data.images.size()) - 1;
+        }
+        textures.push_back({ image, typeName });
+    }
+}
+
+inline void noteSkippedTextures(aiMaterial* mat, aiTextureType type, ModelData& data)
+{
+    for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+    {
+        aiString str;
+        mat->GetTexture(type, i, &str);
+        string path = str.C_Str();
+        auto same = [&path](const SkippedTexture& t) { return t.path == path; };
+        if (std::any_of(data.skippedTextures.begin(), data.skippedTextures.end(), same))
+            continue;
+        SkippedTexture skipped;
+        skipped.path = path;
+        skipped.type = aiTextureTypeToString(type);
+        stbi_info((data.directory + '/' + path).c_str(), &skipped.width, &skipped.height, &skipped.components);
+        data.skippedTextures.push_back(skipped);
+    }
+}
+
+inline MeshData processMesh(aiMesh* mesh, const aiScene* scene, const MaterialRequirements& requirements, ModelData& data)
+{
+    // data to fill
+    MeshData result;
+    convertGeometry(mesh, result);
+
+    // process materials
+    aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+    // we assume a convention for sampler names in the shaders: each texture type has its sampler prefix in
+    // materialTextureSlots, numbered from 1 (uDiffMap1, uDiffMap2 ...). Only the types the requirements
+    // name are decoded, the others are noted with their size.
+    for (const auto& slot : materialTextureSlots)
+        if (requirements.samples(slot.type))
+            loadMaterialTextures(material, slot.type, slot.sampler, data, result.textures);
+    for (int t = aiTextureType_NONE + 1; t <= AI_TEXTURE_TYPE_MAX; t++)
+        if (!requirements.samples(static_cast<aiTextureType>(t)))
+            noteSkippedTextures(material, static_cast<aiTextureType>(t), data);
+
+    return result;
+}
+
+// processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
+inline void processNode(aiNode* node, const aiScene* scene, const MaterialRequirements& requirements, ModelData& data)
+{
+    // process each mesh located at the current node
+    for (unsigned int i = 0; i < node->mNumMeshes; i++)
+    {
+        // the node object only contains indices to index the actual objects in the scene. 
+        // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
+        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+        data.meshes.push_back(processMesh(mesh, scene, requirements, data));
+    }
+    // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
+    {
+        processNode(node->mChildren[i], scene, requirements, data);
+    }
+
+}
+
+// Reads a model with supported ASSIMP extensions and decodes the textures of the types the requirements
+// name. Touches no GL state. Without decodeImages the textures are only listed, and the upload decodes each
+// right before its texture is created, so no more than one decoded image is held at a time.
+inline ModelData importModel(string const& path, const MaterialRequirements& requirements = modelMaterialRequirements,
+                             bool decodeImages = true)
+{
+    TRACE_ZONE("importModel");
+    ModelData data;
+    data.path = path;
+    data.imagesDeferred = !decodeImages;
+    // read file via ASSIMP
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    // check for errors
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+    {
+        cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+        return data;
+    }
+    // retrieve the directory path of the filepath
+    data.directory = path.substr(0, path.find_last_of('/'));
+    data.materialCount = scene->mNumMaterials;
+
+    // process ASSIMP's root node recursively
+    processNode(scene->mRootNode, scene, requirements, data);
+    // a file that some other material samples is decoded anyway
+    auto decoded = [&data](const SkippedTexture& t) {
+        return std::any_of(data.images.begin(), data.images.end(), [&t](const ImageData& image) { return image.path == t.path; });
+    };
+    data.skippedTextures.erase(std::remove_if(data.skippedTextures.begin(), data.skippedTextures.end(), decoded), data.skippedTextures.end());
+    data.loaded = true;
+    return data;
+}
+
+ImageData loadImage(const char* path, const string& directory)
+{
+    ImageData image;
+    image.path = path;
+    decodeImage(image, directory);
+    return image;
+}
+
+bool decodeImage(ImageData& image, const string& directory)
+{
+    string filename = directory + '/' + image.path;
+    image.pixels.reset(stbi_load(filename.c_str(), &image.width, &image.height, &image.components, 0));
+    if (!image.pixels)
+        std::cout << "Texture failed to load at path: " << image.path << std::endl;
+    return image.pixels != nullptr;
+}
+#endif
@@ -0,0 +1,134 @@
+#ifndef PANEL_TARGET_H
+#define PANEL_TARGET_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "gl_handles.hpp"
+#include "memory_tracker.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Square render target for a screen inside the scene (the control panel). Its size follows how many pixels the
+// screen covers: a power of two between minSize and maxSize, grown as soon as the screen needs more and shrunk
+// only when it needs well under half, so small camera moves never reallocate. Mips are rebuilt after every
+// update, and a screen that covers few pixels (or none) is updated less often.
+class PanelRenderTarget
+{
+public:
+    PanelRenderTarget(int minSize = 128, int maxSize = 1024) : minSize(minSize), maxSize(maxSize)
+    {
+        fbo = GLFramebuffer::create();
+        allocate(maxSize);
+    }
+
+    // Edge length in window pixels of the unit quad (x, y in [-0.5, 0.5]) placed by model, the longer of its two
+    // sides; 0 when it is completely off screen. Corners behind the eye count as the largest size.
+    static float projectedSize(const glm::mat4& viewProjection, const glm::mat4& model, int width, int height)
+    {
+        static const glm::vec2 corners[4] = { { -0.5f, -0.5f }, { 0.5f, -0.5f }, { 0.5f, 0.5f }, { -0.5f, 0.5f } };
+        glm::vec2 screen[4];
+        int behind = 0;
+        float loX = 1.0f, loY = 1.0f, hiX = -1.0f, hiY = -1.0f;
+        for (int i = 0; i < 4; i++)
+        {
+            glm::vec4 clip = viewProjection * model * glm::vec4(corners[i].x, corners[i].y, 0.0f, 1.0f);
+            if (clip.w <= 1e-4f)
+            {
+                behind++;
+                continue;
+            }
+            glm::vec2 ndc(clip.x / clip.w, clip.y / clip.w);
+            screen[i] = glm::vec2((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height);
+            loX = std::min(loX, ndc.x); loY = std::min(loY, ndc.y);
+            hiX = std::max(hiX, ndc.x); hiY = std::max(hiY, ndc.y);
+        }
+        if (behind == 4)
+            return 0.0f;
+        if (behind > 0)
+            return static_cast<float>(std::max(width, height));
+        if (hiX < -1.0f || hiY < -1.0f || loX > 1.0f || loY > 1.0f)
+            return 0.0f;
+        auto length = [&](int a, int b) { return glm::length(screen[b] - screen[a]); };
+        return std::max({ length(0, 1), length(3, 2), length(0, 3), length(1, 2) });
+    }
+
+    // Binds the target for drawing and returns true when the screen should be redrawn this frame
+    bool beginUpdate(float screenPixels)
+    {
+        pixels = 0;
+        framesSinceUpdate++;
+        if (screenPixels <= 0.0f)
+            return false;
+
+        int wanted = minSize;
+        while (wanted < screenPixels && wanted < maxSize)
+            wanted *= 2;
+        bool resized = false;
+        if (wanted > size || (wanted < size && screenPixels < size * 0.4f))
+        {
+            allocate(wanted);
+            resized = true;
+        }
+
+        // a screen a few dozen pixels across changes too little to be worth redrawing every frame
+        interval = screenPixels < 96.0f ? 4 : screenPixels < 192.0f ? 2 : 1;
+        if (!resized && framesSinceUpdate < interval)
+            return false;
+
+        framesSinceUpdate = 0;
+        pixels = static_cast<unsigned>(size) * static_cast<unsigned>(size);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, size, size);
+        return true;
+    }
+
+    void endUpdate()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, color);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    GLuint texture() const { return color; }
+    int currentSize() const { return size; }
+    int updateInterval() const { return interval; }
+    unsigned pixelsShaded() const { return pixels; }   // this frame, 0 when it was not redrawn
+    unsigned reallocations() const { return allocations - 1; }
+
+private:
+    int minSize, maxSize;
+    int size = 0;
+    int interval = 1;
+    int framesSinceUpdate = 0;
+    unsigned pixels = 0;
+    unsigned allocations = 0;
+    GLFramebuffer fbo;
+    GLTexture color;
+
+    void allocate(int newSize)
+    {
+        size = newSize;
+        allocations++;
+        color = GLTexture::create();
+        glBindTexture(GL_TEXTURE_2D, color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glGenerateMipmap(GL_TEXTURE_2D);   // allocates the mip chain
+        glBindTexture(GL_TEXTURE_2D, 0);
+        memoryTracker.track(MemoryTracker::TEXTURE, color, textureBytes(GL_RGB8, size, size, true), MemoryCategory::RenderTarget, "control panel");
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: Panel framebuffer is not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+};
+#endif
@@ -0,0 +1,421 @@
+#ifndef PASSENGER_SYSTEM_H
+#define PASSENGER_SYSTEM_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+enum class PassengerState : uint8_t {
+    WaitingToBoard,   // outside, queued at the door
+    Boarding,         // outside -> door -> seat
+    Seated,
+    WaitingToAlight,  // in the seat, queued at the door
+    Alighting         // seat -> door -> outside
+};
+
+// Stable reference to a passenger. It stays valid while other passengers are added and removed,
+// and stops resolving once its own passenger is removed.
+struct PassengerHandle {
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+};
+
+// Where passengers walk. The door is a shared resource: one passenger per direction passes it every
+// doorInterval seconds, but any number of them can be on their way at once.
+struct PassengerLayout {
+    glm::vec3 outside;
+    glm::vec3 door;
+    glm::vec3 standing;           // used when every seat is taken
+    std::vector<glm::vec3> seats;
+    float walkDuration = 1.0f;    // seconds from outside to the seat
+    float doorInterval = 0.35f;   // seconds between two passengers going through the door in the same direction
+};
+
+// World matrix of a person standing at position, turned yawDegrees about the vertical axis, scaled uniformly
+inline glm::mat4 placementMatrix(glm::vec3 position, float yawDegrees, float scale)
+{
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+    model = glm::rotate(model, glm::radians(yawDegrees), glm::vec3(0.0f, 1.0f, 0.0f));
+    return glm::scale(model, glm::vec3(scale));
+}
+
+struct PassengerUpdateResult {
+    int boarded = 0;
+    int alighted = 0;
+};
+
+// Pooled structure-of-arrays passenger store. Live passengers are packed densely in the columns below,
+// removal swaps the last passenger into the hole, and handles go through a slot table so they survive that.
+class PassengerSystem
+{
+public:
+    // dense columns, all of size count()
+    std::vector<PassengerState> state;
+    std::vector<float>          progress;    // 0.0 to 1.0 along the current walk
+    std::vector<uint8_t>        modelIndex;  // 0-14 for person1-15
+    std::vector<int>            seat;        // index into layout.seats, -1 when standing
+    std::vector<glm::vec3>      position;
+    std::vector<float>          heading;     // degrees around +y
+
+    explicit PassengerSystem(PassengerLayout layout) : layout(std::move(layout))
+    {
+        for (int i = static_cast<int>(this->layout.seats.size()) - 1; i >= 0; i--)
+            freeSeats.push_back(i);
+    }
+
+    size_t count() const { return state.size(); }
+    int walkingCount() const { return walking; }
+    int seatedCount() const { return seated; }
+    int boardingCount() const { return queuedToBoard + boardingWalkers; }
+    // somebody is walking through or queued at the door
+    bool doorBusy() const { return walking + queuedToBoard + queuedToAlight > 0; }
+    const PassengerLayout& getLayout() const { return layout; }
+
+    void reserve(size_t n)
+    {
+        state.reserve(n); progress.reserve(n); modelIndex.reserve(n);
+        seat.reserve(n); position.reserve(n); heading.reserve(n);
+        denseToSlot.reserve(n); slotToDense.reserve(n); generations.reserve(n);
+    }
+
+    // queues a new passenger outside the door
+    PassengerHandle spawnBoarding(int model)
+    {
+        return add(PassengerState::WaitingToBoard, model, -1, layout.outside, -90.0f);
+    }
+
+    // adds a passenger that is already in a seat, e.g. when switching to a bus that is carrying people
+    PassengerHandle spawnSeated(int model)
+    {
+        int s = takeSeat();
+        return add(PassengerState::Seated, model, s, seatPosition(s), -90.0f);
+    }
+
+    bool valid(PassengerHandle h) const
+    {
+        return h.slot < generations.size() && generations[h.slot] == h.generation && slotToDense[h.slot] != UINT32_MAX;
+    }
+
+    PassengerHandle handleAt(size_t dense) const
+    {
+        uint32_t slot = denseToSlot[dense];
+        return { slot, generations[slot] };
+    }
+
+    // queues a seated passenger for leaving, returns false if the passenger is not sitting
+    bool requestAlight(PassengerHandle h)
+    {
+        if (!valid(h))
+            return false;
+        uint32_t i = slotToDense[h.slot];
+        if (state[i] != PassengerState::Seated)
+            return false;
+        state[i] = PassengerState::WaitingToAlight;
+        seated--;
+        queuedToAlight++;
+        return true;
+    }
+
+    // picks the n-th seated passenger in storage order (n < seatedCount())
+    PassengerHandle seatedPassenger(int n) const
+    {
+        for (size_t i = 0; i < state.size(); i++)
+        {
+            if (state[i] == PassengerState::Seated && n-- == 0)
+                return handleAt(i);
+        }
+        return {};
+    }
+
+    void remove(PassengerHandle h)
+    {
+        if (valid(h))
+            removeDense(slotToDense[h.slot]);
+    }
+
+    void clear()
+    {
+        while (!state.empty())
+            removeDense(state.size() - 1);
+    }
+
+    // Admits queued passengers through the door and advances everyone who is walking. With a job system
+    // large crowds are advanced in parallel chunks; admitting and removing stay serial.
+    PassengerUpdateResult update(float dt, JobSystem* jobs = nullptr)
+    {
+        admitThroughDoor(dt);
+        std::vector<uint32_t>& finished = finishedScratch;
+        finished.clear();
+        PassengerUpdateResult result;
+        if (!jobs || state.size() < 2 * PARALLEL_GRAIN)
+        {
+            result = updateRange(0, state.size(), dt, finished);
+        }
+        else
+        {
+            std::mutex merge;
+            jobs->parallelFor(state.size(), PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+                std::vector<uint32_t> chunkFinished;
+                PassengerUpdateResult r = updateRange(begin, end, dt, chunkFinished);
+                std::lock_guard<std::mutex> lock(merge);
+                result.boarded += r.boarded;
+                result.alighted += r.alighted;
+                finished.insert(finished.end(), chunkFinished.begin(), chunkFinished.end());
+            });
+        }
+        applyResult(result);
+        removeFinished(finished);
+        return result;
+    }
+
+    // Advances the passengers in [begin, end). Passengers who have walked out are appended to finished
+    // instead of being removed, so disjoint ranges can be updated independently.
+    PassengerUpdateResult updateRange(size_t begin, size_t end, float dt, std::vector<uint32_t>& finished)
+    {
+        PassengerUpdateResult result;
+        const float step = dt / layout.walkDuration;
+        for (size_t i = begin; i < end; i++)
+        {
+            PassengerState s = state[i];
+            if (s == PassengerState::Boarding)
+            {
+                float p = progress[i] + step;
+                if (p >= 1.0f)
+                {
+                    state[i] = PassengerState::Seated;
+                    progress[i] = 0.0f;
+                    position[i] = seatPosition(seat[i]);
+                    heading[i] = -90.0f;
+                    result.boarded++;
+                    continue;
+                }
+                progress[i] = p;
+                if (p < 0.5f)
+                {
+                    position[i] = glm::mix(layout.outside, layout.door, p * 2.0f);
+                    heading[i] = -90.0f;
+                }
+                else
+                {
+                    position[i] = glm::mix(layout.door, seatPosition(seat[i]), (p - 0.5f) * 2.0f);
+                    heading[i] = 180.0f;
+                }
+            }
+            else if (s == PassengerState::Alighting)
+            {
+                float p = progress[i] + step;
+                if (p >= 1.0f)
+                {
+                    progress[i] = 1.0f;
+                    position[i] = layout.outside;
+                    finished.push_back(static_cast<uint32_t>(i));
+                    result.alighted++;
+                    continue;
+                }
+                progress[i] = p;
+                if (p < 0.5f)
+                {
+                    position[i] = glm::mix(seatPosition(seat[i]), layout.door, p * 2.0f);
+                    heading[i] = 0.0f;
+                }
+                else
+                {
+                    position[i] = glm::mix(layout.door, layout.outside, (p - 0.5f) * 2.0f);
+                    heading[i] = 90.0f;
+                }
+            }
+        }
+        return result;
+    }
+
+    // removes passengers reported by updateRange and keeps the counters in sync with the applied result
+    void removeFinished(std::vector<uint32_t>& finished)
+    {
+        // descending order: the passenger swapped into a hole always comes from past every index still to remove
+        std::sort(finished.begin(), finished.end(), std::greater<uint32_t>());
+        for (uint32_t i : finished)
+            removeDense(i);
+    }
+
+    // bookkeeping for results produced by updateRange
+    void applyResult(const PassengerUpdateResult& r)
+    {
+        walking -= r.boarded;
+        boardingWalkers -= r.boarded;
+        seated += r.boarded;
+    }
+
+    // inside the bus, so it moves with the bus jog
+    bool isInside(size_t i) const
+    {
+        switch (state[i])
+        {
+        case PassengerState::Seated:
+        case PassengerState::WaitingToAlight:
+            return true;
+        case PassengerState::Boarding:
+            return progress[i] >= 0.5f;
+        case PassengerState::Alighting:
+            return progress[i] < 0.5f;
+        default:
+            return false;
+        }
+    }
+
+    bool isVisible(size_t i) const
+    {
+        return state[i] != PassengerState::WaitingToBoard;
+    }
+
+    // lets queued passengers through the door, one per direction every doorInterval seconds
+    void admitThroughDoor(float dt)
+    {
+        boardTimer -= dt;
+        alightTimer -= dt;
+        if ((queuedToBoard == 0 || boardTimer > 0.0f) && (queuedToAlight == 0 || alightTimer > 0.0f))
+            return;
+
+        for (size_t i = 0; i < state.size(); i++)
+        {
+            if (state[i] == PassengerState::WaitingToBoard && boardTimer <= 0.0f)
+            {
+                state[i] = PassengerState::Boarding;
+                progress[i] = 0.0f;
+                seat[i] = takeSeat();
+                queuedToBoard--;
+                boardingWalkers++;
+                walking++;
+                boardTimer += layout.doorInterval;
+                if (boardTimer < 0.0f && layout.doorInterval > 0.0f)
+                    boardTimer = 0.0f;
+            }
+            else if (state[i] == PassengerState::WaitingToAlight && alightTimer <= 0.0f)
+            {
+                state[i] = PassengerState::Alighting;
+                progress[i] = 0.0f;
+                queuedToAlight--;
+                walking++;
+                alightTimer += layout.doorInterval;
+                if (alightTimer < 0.0f && layout.doorInterval > 0.0f)
+                    alightTimer = 0.0f;
+            }
+            if ((queuedToBoard == 0 || boardTimer > 0.0f) && (queuedToAlight == 0 || alightTimer > 0.0f))
+                break;
+        }
+        if (boardTimer < 0.0f) boardTimer = 0.0f;
+        if (alightTimer < 0.0f) alightTimer = 0.0f;
+    }
+
+private:
+    static const size_t PARALLEL_GRAIN = 4096;
+
+    PassengerLayout layout;
+
+    // slot table for stable handles
+    std::vector<uint32_t> denseToSlot;
+    std::vector<uint32_t> slotToDense;
+    std::vector<uint32_t> generations;
+    std::vector<uint32_t> freeSlots;
+    std::vector<int> freeSeats;
+    std::vector<uint32_t> finishedScratch;
+
+    int walking = 0;
+    int seated = 0;
+    int queuedToBoard = 0;
+    int queuedToAlight = 0;
+    int boardingWalkers = 0;
+    float boardTimer = 0.0f;
+    float alightTimer = 0.0f;
+
+    glm::vec3 seatPosition(int s) const
+    {
+        return s >= 0 ? layout.seats[s] : layout.standing;
+    }
+
+    int takeSeat()
+    {
+        if (freeSeats.empty())
+            return -1;
+        int s = freeSeats.back();
+        freeSeats.pop_back();
+        return s;
+    }
+
+    PassengerHandle add(PassengerState s, int model, int seatIndex, glm::vec3 pos, float angle)
+    {
+        uint32_t slot;
+        if (!freeSlots.empty())
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            slot = static_cast<uint32_t>(generations.size());
+            generations.push_back(0);
+            slotToDense.push_back(UINT32_MAX);
+        }
+
+        slotToDense[slot] = static_cast<uint32_t>(state.size());
+        denseToSlot.push_back(slot);
+        state.push_back(s);
+        progress.push_back(0.0f);
+        modelIndex.push_back(static_cast<uint8_t>(model));
+        seat.push_back(seatIndex);
+        position.push_back(pos);
+        heading.push_back(angle);
+
+        if (s == PassengerState::WaitingToBoard) queuedToBoard++;
+        else if (s == PassengerState::Seated) seated++;
+        return { slot, generations[slot] };
+    }
+
+    // O(1): the last passenger takes the place of the removed one
+    void removeDense(size_t i)
+    {
+        switch (state[i])
+        {
+        case PassengerState::WaitingToBoard:  queuedToBoard--; break;
+        case PassengerState::Boarding:        walking--; boardingWalkers--; break;
+        case PassengerState::Seated:          seated--; break;
+        case PassengerState::WaitingToAlight: queuedToAlight--; break;
+        case PassengerState::Alighting:       walking--; break;
+        }
+        if (seat[i] >= 0)
+            freeSeats.push_back(seat[i]);
+
+        uint32_t slot = denseToSlot[i];
+        size_t last = state.size() - 1;
+        if (i != last)
+        {
+            state[i] = state[last];
+            progress[i] = progress[last];
+            modelIndex[i] = modelIndex[last];
+            seat[i] = seat[last];
+            position[i] = position[last];
+            heading[i] = heading[last];
+            denseToSlot[i] = denseToSlot[last];
+            slotToDense[denseToSlot[i]] = static_cast<uint32_t>(i);
+        }
+        state.pop_back();
+        progress.pop_back();
+        modelIndex.pop_back();
+        seat.pop_back();
+        position.pop_back();
+        heading.pop_back();
+        denseToSlot.pop_back();
+
+        slotToDense[slot] = UINT32_MAX;
+        generations[slot]++;
+        freeSlots.push_back(slot);
+    }
+};
+#endif
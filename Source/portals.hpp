@@ -0,0 +1,120 @@
+#ifndef PORTALS_H
+#define PORTALS_H
+
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+
+#include <algorithm>
+#include <vector>
+
+// Visibility of the outside world from inside a closed room (the bus). The room is a box in its own space and
+// the openings in its walls are portals, rectangles given by four corners in the same space. Every frame each
+// portal is projected to the screen, its rectangle narrows the camera frustum, and an outside object is only
+// drawn when it touches one of the narrowed frusta. From outside the room the plain camera frustum is used.
+class PortalVisibility
+{
+public:
+    PortalVisibility(const glm::vec3& roomMin, const glm::vec3& roomMax) : roomMin(roomMin), roomMax(roomMax) {}
+
+    // corners in order around the rectangle
+    void addPortal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& d)
+    {
+        portals.push_back({ { a, b, c, d } });
+    }
+
+    // roomToWorld places the room, cameraPosition is in world space
+    void update(const glm::mat4& roomToWorld, const glm::mat4& projection, const glm::mat4& view, const glm::vec3& cameraPosition)
+    {
+        glm::mat4 viewProjection = projection * view;
+        frusta.clear();
+        worldToRoom = glm::inverse(roomToWorld);
+        inside = contains(cameraPosition);
+        if (!inside)
+        {
+            frusta.push_back(Frustum::fromMatrix(viewProjection));
+            return;
+        }
+
+        glm::mat4 roomToClip = viewProjection * roomToWorld;
+        for (const Portal& portal : portals)
+        {
+            glm::vec2 lo, hi;
+            if (!screenRect(portal, roomToClip, lo, hi))
+                continue;
+            // squeezes the rectangle to the whole clip space, so the frustum planes run through its edges
+            glm::mat4 narrow(1.0f);
+            narrow[0][0] = 2.0f / (hi.x - lo.x);
+            narrow[3][0] = -(hi.x + lo.x) / (hi.x - lo.x);
+            narrow[1][1] = 2.0f / (hi.y - lo.y);
+            narrow[3][1] = -(hi.y + lo.y) / (hi.y - lo.y);
+            frusta.push_back(Frustum::fromMatrix(narrow * viewProjection));
+        }
+    }
+
+    // world space bounds of an object outside the room
+    bool visible(const BoundingSphere& bounds) const
+    {
+        for (const Frustum& f : frusta)
+            if (f.intersects(bounds))
+                return true;
+        return false;
+    }
+
+    // world point inside the room, as of the last update
+    bool contains(const glm::vec3& point) const
+    {
+        glm::vec3 p = glm::vec3(worldToRoom * glm::vec4(point, 1.0f));
+        return p.x > roomMin.x && p.y > roomMin.y && p.z > roomMin.z && p.x < roomMax.x && p.y < roomMax.y && p.z < roomMax.z;
+    }
+
+    bool cameraInside() const { return inside; }
+    size_t openPortals() const { return inside ? frusta.size() : 0; }
+    size_t portalCount() const { return portals.size(); }
+
+private:
+    struct Portal {
+        glm::vec3 corners[4];
+    };
+
+    glm::vec3 roomMin, roomMax;
+    std::vector<Portal> portals;
+    std::vector<Frustum> frusta;
+    glm::mat4 worldToRoom = glm::mat4(1.0f);
+    bool inside = false;
+
+    // NDC rectangle the portal covers on screen, false when it is behind the camera or off screen
+    static bool screenRect(const Portal& portal, const glm::mat4& roomToClip, glm::vec2& lo, glm::vec2& hi)
+    {
+        glm::vec4 clip[4];
+        for (int i = 0; i < 4; i++)
+            clip[i] = roomToClip * glm::vec4(portal.corners[i], 1.0f);
+
+        // clipped against the near plane (z + w >= 0) so corners behind the eye do not flip across the screen
+        lo = glm::vec2(1.0f);
+        hi = glm::vec2(-1.0f);
+        bool any = false;
+        auto extend = [&](const glm::vec4& p) {
+            float x = p.x / p.w, y = p.y / p.w;
+            lo = glm::vec2(std::min(lo.x, x), std::min(lo.y, y));
+            hi = glm::vec2(std::max(hi.x, x), std::max(hi.y, y));
+            any = true;
+        };
+        for (int i = 0; i < 4; i++)
+        {
+            const glm::vec4& a = clip[i];
+            const glm::vec4& b = clip[(i + 1) % 4];
+            float da = a.z + a.w, db = b.z + b.w;
+            if (da >= 0.0f)
+                extend(a);
+            if ((da >= 0.0f) != (db >= 0.0f))
+                extend(a + (b - a) * (da / (da - db)));
+        }
+        if (!any)
+            return false;
+        lo = glm::vec2(std::max(lo.x, -1.0f), std::max(lo.y, -1.0f));
+        hi = glm::vec2(std::min(hi.x, 1.0f), std::min(hi.y, 1.0f));
+        return lo.x < hi.x && lo.y < hi.y;
+    }
+};
+#endif
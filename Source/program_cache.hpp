@@ -0,0 +1,327 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <GL/glew.h>
+
+#include "gl_handles.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Builds every shader program of the application in one go. Programs linked on an earlier run are loaded from
+// their stored binaries (glGetProgramBinary), keyed by a hash of the sources with their defines and the driver
+// string, so an edited shader or a driver update falls back to compiling the source. Sources are compiled with all
+// compiles and links issued before any status is read, which lets drivers with KHR_parallel_shader_compile spread
+// them over their compiler threads.
+class ProgramCache
+{
+public:
+    struct Entry {
+        std::string vertexPath, fragmentPath;
+        std::string defines;   // inserted after the #version line of both stages
+        std::string vertexSource, fragmentSource;
+        uint64_t key = 0;
+        GLProgram program;
+        GLuint vertexShader = 0, fragmentShader = 0;
+        bool fromBinary = false;
+        bool linked = false;
+        double ms = 0.0;   // binary load, or compile + link until the status was known
+    };
+
+    explicit ProgramCache(std::string directory = "../ShaderCache") : directory(std::move(directory)) {}
+
+    // queues a program, the returned index is passed to take() after build()
+    size_t add(const std::string& vertexPath, const std::string& fragmentPath, std::string defines = "")
+    {
+        Entry e;
+        e.vertexPath = vertexPath;
+        e.fragmentPath = fragmentPath;
+        e.defines = std::move(defines);
+        entries.push_back(std::move(e));
+        return entries.size() - 1;
+    }
+
+    void build()
+    {
+        auto start = std::chrono::steady_clock::now();
+        bool binaries = binariesSupported();
+        bool parallel = GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+        if (GLEW_KHR_parallel_shader_compile)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        else if (GLEW_ARB_parallel_shader_compile)
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+        std::string driver = driverString();
+        std::vector<Entry*> pending;
+        for (auto& e : entries)
+        {
+            e.vertexSource = withDefines(readFile(e.vertexPath), e.defines);
+            e.fragmentSource = withDefines(readFile(e.fragmentPath), e.defines);
+            e.key = hash(e.vertexSource + '\0' + e.fragmentSource + '\0' + driver);
+            if (binaries && loadBinary(e))
+                continue;
+            startCompile(e, binaries);
+            pending.push_back(&e);
+        }
+
+        // with parallel compile, poll so every program gets its own completion time; otherwise the first
+        // status query blocks on that program and the rest follow in order
+        while (!pending.empty())
+        {
+            for (size_t i = 0; i < pending.size();)
+            {
+                Entry& e = *pending[i];
+                GLint done = GL_TRUE;
+                if (parallel)
+                    glGetProgramiv(e.program, GL_COMPLETION_STATUS_KHR, &done);
+                if (!done)
+                {
+                    i++;
+                    continue;
+                }
+                finishCompile(e, start, binaries);
+                pending[i] = pending.back();
+                pending.pop_back();
+            }
+        }
+        totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    GLProgram take(size_t index) { return std::move(entries[index].program); }
+
+    // Builds one program on the spot from sources that were already read, such as a shader variant first needed
+    // after build() or a hot reload of one. It is looked up in and stored to the binary cache like the rest.
+    GLProgram load(const std::string& vertexPath, const std::string& fragmentPath,
+                   const std::string& vertexSource, const std::string& fragmentSource, const std::string& defines = "")
+    {
+        auto start = std::chrono::steady_clock::now();
+        bool binaries = binariesSupported();
+        Entry e;
+        e.vertexPath = vertexPath;
+        e.fragmentPath = fragmentPath;
+        e.defines = defines;
+        e.vertexSource = withDefines(vertexSource, defines);
+        e.fragmentSource = withDefines(fragmentSource, defines);
+        e.key = hash(e.vertexSource + '\0' + e.fragmentSource + '\0' + driverString());
+        if (binaries && loadBinary(e))
+            return std::move(e.program);
+        startCompile(e, binaries);
+        finishCompile(e, start, binaries);
+        return e.linked ? std::move(e.program) : GLProgram();
+    }
+
+    // Compiles one program from sources that were already read, e.g. by a hot reload. Errors are logged and an
+    // empty program is returned, so the caller can keep whatever it had.
+    static GLProgram compile(const std::string& vertexPath, const std::string& fragmentPath,
+                             std::string vertexSource, std::string fragmentSource)
+    {
+        Entry e;
+        e.vertexPath = vertexPath;
+        e.fragmentPath = fragmentPath;
+        e.vertexSource = std::move(vertexSource);
+        e.fragmentSource = std::move(fragmentSource);
+        startCompile(e, false);
+        resolve(e);
+        return e.linked ? std::move(e.program) : GLProgram();
+    }
+
+    static std::string readFile(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file.is_open())
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return "";
+        }
+        std::stringstream ss;
+        ss << file.rdbuf();
+        return ss.str();
+    }
+
+    // the defines have to follow the #version line
+    static std::string withDefines(const std::string& source, const std::string& defines)
+    {
+        if (defines.empty())
+            return source;
+        size_t lineEnd = source.find('\n');
+        if (source.compare(0, 8, "#version") != 0 || lineEnd == std::string::npos)
+            return defines + source;
+        return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+    }
+
+    void printReport() const
+    {
+        for (const auto& e : entries)
+        {
+            std::string name = e.vertexPath + " + " + std::filesystem::path(e.fragmentPath).filename().string();
+            // a variant is told apart by its defines, "#define A\n#define B\n" is listed as "A B"
+            std::stringstream defines(e.defines);
+            std::string word;
+            while (defines >> word)
+                if (word != "#define")
+                    name += " " + word;
+            printf("  %-40s %s %7.2f ms%s\n", name.c_str(), e.fromBinary ? "binary " : "compile", e.ms, e.linked ? "" : "  FAILED");
+        }
+        printf("  %zu programs in %.2f ms\n", entries.size(), totalMs);
+    }
+
+private:
+    std::string directory;
+    std::vector<Entry> entries;
+    double totalMs = 0.0;
+
+    static bool binariesSupported()
+    {
+        if (!GLEW_ARB_get_program_binary)
+            return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    static std::string driverString()
+    {
+        std::string s;
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+        {
+            const GLubyte* v = glGetString(name);
+            s += v ? reinterpret_cast<const char*>(v) : "";
+            s += '\n';
+        }
+        return s;
+    }
+
+    // FNV-1a, 64 bit
+    static uint64_t hash(const std::string& data)
+    {
+        uint64_t h = 14695981039346656037ull;
+        for (unsigned char c : data)
+        {
+            h ^= c;
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    std::string binaryPath(const Entry& e) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)e.key);
+        return directory + "/" + name;
+    }
+
+    // stored as: binary format (GLenum), then the binary itself
+    bool loadBinary(Entry& e)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::ifstream file(binaryPath(e), std::ios::binary);
+        if (!file.is_open())
+            return false;
+        GLenum format = 0;
+        file.read(reinterpret_cast<char*>(&format), sizeof(format));
+        std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (!file.good() && !file.eof())
+            return false;
+
+        GLProgram program = GLProgram::create();
+        glProgramBinary(program, format, data.data(), static_cast<GLsizei>(data.size()));
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+            return false;   // the driver refused it, compile from source and overwrite the file
+
+        e.program = std::move(program);
+        e.fromBinary = true;
+        e.linked = true;
+        e.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    static void startCompile(Entry& e, bool retrievable)
+    {
+        const char* vs = e.vertexSource.c_str();
+        const char* fs = e.fragmentSource.c_str();
+        e.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(e.vertexShader, 1, &vs, NULL);
+        glCompileShader(e.vertexShader);
+        e.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(e.fragmentShader, 1, &fs, NULL);
+        glCompileShader(e.fragmentShader);
+
+        e.program = GLProgram::create();
+        if (retrievable)
+            glProgramParameteri(e.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glAttachShader(e.program, e.vertexShader);
+        glAttachShader(e.program, e.fragmentShader);
+        glLinkProgram(e.program);
+    }
+
+    void finishCompile(Entry& e, std::chrono::steady_clock::time_point start, bool binaries)
+    {
+        resolve(e);
+        e.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (e.linked && binaries)
+            storeBinary(e);
+    }
+
+    // reads the compile and link status and releases the shader objects
+    static void resolve(Entry& e)
+    {
+        checkShader(e.vertexShader, e.vertexPath);
+        checkShader(e.fragmentShader, e.fragmentPath);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(e.program, GL_LINK_STATUS, &linked);
+        e.linked = linked == GL_TRUE;
+        if (!e.linked)
+        {
+            char infoLog[1024];
+            glGetProgramInfoLog(e.program, sizeof(infoLog), NULL, infoLog);
+            std::cout << "ERROR::PROGRAM_LINKING_ERROR: " << e.vertexPath << " + " << e.fragmentPath << "\n" << infoLog << std::endl;
+        }
+
+        glDetachShader(e.program, e.vertexShader);
+        glDetachShader(e.program, e.fragmentShader);
+        glDeleteShader(e.vertexShader);
+        glDeleteShader(e.fragmentShader);
+        e.vertexShader = e.fragmentShader = 0;
+    }
+
+    static void checkShader(GLuint shader, const std::string& path)
+    {
+        GLint success = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            char infoLog[1024];
+            glGetShaderInfoLog(shader, sizeof(infoLog), NULL, infoLog);
+            std::cout << "ERROR::SHADER_COMPILATION_ERROR: " << path << "\n" << infoLog << std::endl;
+        }
+    }
+
+    void storeBinary(const Entry& e)
+    {
+        GLint length = 0;
+        glGetProgramiv(e.program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> data(length);
+        GLenum format = 0;
+        glGetProgramBinary(e.program, length, NULL, &format, data.data());
+
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        std::ofstream file(binaryPath(e), std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+            return;
+        file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+        file.write(data.data(), data.size());
+    }
+};
+#endif
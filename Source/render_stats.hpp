@@ -0,0 +1,67 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <GL/glew.h>
+
+#include <iostream>
+
+// Per-frame submission counters. Every VAO bind and draw call in the renderer goes through the helpers below,
+// so the numbers reported here are the real submission cost of a frame.
+struct RenderStats {
+    unsigned int vaoBinds = 0;
+    unsigned int drawCalls = 0;
+    unsigned int meshesSubmitted = 0;
+};
+
+inline RenderStats frameStats;
+inline RenderStats lastFrameStats;
+inline GLuint boundVertexArray = 0;
+
+// binds a VAO, skipping the call when it is already bound
+inline void bindVertexArray(GLuint vao)
+{
+    if (boundVertexArray == vao)
+        return;
+    glBindVertexArray(vao);
+    boundVertexArray = vao;
+    if (vao != 0)
+        frameStats.vaoBinds++;
+}
+
+// deletes a VAO and forgets it when it is the cached binding, so a new VAO that gets the same name is still bound
+inline void deleteVertexArray(GLuint& vao)
+{
+    if (vao == 0)
+        return;
+    if (boundVertexArray == vao)
+        boundVertexArray = 0;
+    glDeleteVertexArrays(1, &vao);
+    vao = 0;
+}
+
+inline void drawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    glDrawArrays(mode, first, count);
+    frameStats.drawCalls++;
+}
+
+inline void drawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instances)
+{
+    glDrawArraysInstanced(mode, first, count, instances);
+    frameStats.drawCalls++;
+}
+
+// closes the current frame; the finished counters stay readable in lastFrameStats
+inline void endFrameStats()
+{
+    lastFrameStats = frameStats;
+    frameStats = RenderStats();
+}
+
+inline void printFrameStats()
+{
+    std::cout << "Frame stats: VAO binds " << lastFrameStats.vaoBinds
+              << ", draw calls " << lastFrameStats.drawCalls
+              << ", meshes " << lastFrameStats.meshesSubmitted << std::endl;
+}
+#endif
@@ -0,0 +1,205 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "frame_pipeline.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// 64-bit FNV-1a over the raw bytes of simulation state. Only for plain values and vectors of them, padding
+// included, so hashed structs must be fully initialised.
+class StateHash
+{
+public:
+    void bytes(const void* data, size_t size)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++)
+            value = (value ^ p[i]) * 0x100000001b3ull;
+    }
+
+    template <typename T>
+    void add(const T& v)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        bytes(&v, sizeof(T));
+    }
+
+    template <typename T>
+    void add(const std::vector<T>& v)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        add(v.size());
+        bytes(v.data(), v.size() * sizeof(T));
+    }
+
+    uint64_t result() const { return value; }
+
+private:
+    uint64_t value = 0xcbf29ce484222325ull;
+};
+
+// Everything a run needs besides its input to come out the same
+struct ReplayHeader {
+    uint32_t magic = 0x4c505242;   // "BRPL"
+    uint32_t version = 1;
+    uint32_t seed = 0;             // of rand()
+    int32_t fleetSize = 1;
+    int32_t trafficCount = 0;
+    float stepSeconds = 1.0f / 75.0f;
+};
+
+// A recorded session, in one binary file: the header, then for every simulation step the input events applied
+// in it followed by the hash of the state it left. Each event is 26 bytes, each step end 12.
+class ReplayRecorder
+{
+public:
+    ~ReplayRecorder() { close(); }
+
+    bool open(const std::string& path, const ReplayHeader& header)
+    {
+        file = fopen(path.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "ERROR::REPLAY:: Could not create " << path << std::endl;
+            return false;
+        }
+        fwrite(&header, sizeof(header), 1, file);
+        return true;
+    }
+
+    void event(const InputEvent& e)
+    {
+        if (!file)
+            return;
+        uint8_t tag = EVENT;
+        uint8_t type = static_cast<uint8_t>(e.type);
+        int32_t code = e.code, action = e.action;
+        fwrite(&tag, 1, 1, file);
+        fwrite(&type, 1, 1, file);
+        fwrite(&code, 4, 1, file);
+        fwrite(&action, 4, 1, file);
+        fwrite(&e.x, 8, 1, file);
+        fwrite(&e.y, 8, 1, file);
+    }
+
+    void endStep(uint32_t step, uint64_t hash)
+    {
+        if (!file)
+            return;
+        uint8_t tag = STEP;
+        fwrite(&tag, 1, 1, file);
+        fwrite(&step, 4, 1, file);
+        fwrite(&hash, 8, 1, file);
+    }
+
+    void close()
+    {
+        if (file)
+            fclose(file);
+        file = nullptr;
+    }
+
+    bool recording() const { return file != nullptr; }
+
+    enum : uint8_t { EVENT = 'E', STEP = 'S' };
+
+private:
+    FILE* file = nullptr;
+};
+
+// A recording loaded for replay, split into steps
+class ReplayLog
+{
+public:
+    struct Step {
+        size_t firstEvent = 0, eventCount = 0;
+        uint64_t hash = 0;
+    };
+
+    ReplayHeader header;
+    std::vector<InputEvent> events;
+    std::vector<Step> steps;
+
+    bool load(const std::string& path)
+    {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file)
+        {
+            std::cout << "ERROR::REPLAY:: Could not open " << path << std::endl;
+            return false;
+        }
+        ReplayHeader expected;
+        bool ok = fread(&header, sizeof(header), 1, file) == 1 && header.magic == expected.magic && header.version == expected.version;
+        Step current;
+        current.firstEvent = 0;
+        uint8_t tag = 0;
+        while (ok && fread(&tag, 1, 1, file) == 1)
+        {
+            if (tag == ReplayRecorder::EVENT)
+            {
+                uint8_t type = 0;
+                int32_t code = 0, action = 0;
+                InputEvent e{ InputEvent::Type::Key };
+                ok = fread(&type, 1, 1, file) == 1 && fread(&code, 4, 1, file) == 1 && fread(&action, 4, 1, file) == 1 &&
+                     fread(&e.x, 8, 1, file) == 1 && fread(&e.y, 8, 1, file) == 1;
+                e.type = static_cast<InputEvent::Type>(type);
+                e.code = code;
+                e.action = action;
+                events.push_back(e);
+                current.eventCount++;
+            }
+            else if (tag == ReplayRecorder::STEP)
+            {
+                uint32_t step = 0;
+                ok = fread(&step, 4, 1, file) == 1 && fread(&current.hash, 8, 1, file) == 1 && step == steps.size();
+                steps.push_back(current);
+                current = Step();
+                current.firstEvent = events.size();
+            }
+            else
+            {
+                ok = false;
+            }
+        }
+        fclose(file);
+        if (!ok)
+            std::cout << "ERROR::REPLAY:: " << path << " is not a complete recording, using its first " << steps.size() << " steps" << std::endl;
+        return !steps.empty();
+    }
+};
+
+// Compares the replayed run against the recorded hashes step by step
+struct ReplayCheck {
+    uint64_t checked = 0;
+    uint64_t mismatches = 0;
+    int64_t firstMismatch = -1;
+
+    void verify(uint32_t step, uint64_t expected, uint64_t actual)
+    {
+        checked++;
+        if (expected == actual)
+            return;
+        if (mismatches++ == 0)
+        {
+            firstMismatch = step;
+            printf("Replay diverged at step %u: state hash %016llx, recorded %016llx\n", step, (unsigned long long)actual,
+                   (unsigned long long)expected);
+        }
+    }
+
+    void report() const
+    {
+        if (mismatches == 0)
+            printf("Replay matched: %llu steps, identical state hash after each\n", (unsigned long long)checked);
+        else
+            printf("Replay mismatched: %llu of %llu steps differ, first at step %lld\n", (unsigned long long)mismatches,
+                   (unsigned long long)checked, (long long)firstMismatch);
+    }
+};
+#endif
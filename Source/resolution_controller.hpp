@@ -0,0 +1,99 @@
+#ifndef RESOLUTION_CONTROLLER_H
+#define RESOLUTION_CONTROLLER_H
+
+#include <algorithm>
+#include <cmath>
+
+struct ResolutionControllerConfig {
+    float targetMs = 1000.0f / 75.0f;
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+    float lowerAbove = 0.95f;   // of targetMs: a smoothed frame above this lowers the scale at once
+    float raiseBelow = 0.7f;    // and one below this, raiseAfter frames in a row, raises it a step
+    int raiseAfter = 60;
+    int settleFrames = 8;       // no decisions after a change, the timings still lag behind it
+    float raiseStep = 0.05f;
+    float maxLowerStep = 0.15f;
+    float smoothing = 0.2f;     // weight of the newest frame in the moving average
+};
+
+// Chooses the render scale (of each axis) from measured frame times. Falling behind is fixed at once, aiming at the
+// middle of the band between the two thresholds, while going up waits for a long calm stretch and takes small
+// steps. Inside the band nothing changes, so the scale does not oscillate around the target. Pure CPU work.
+class ResolutionController
+{
+public:
+    enum State {
+        HOLDING,      // inside the band
+        SETTLING,     // just changed, waiting for the timings to catch up
+        RECOVERING,   // below the band, counting calm frames toward a raise
+    };
+
+    explicit ResolutionController(ResolutionControllerConfig config = ResolutionControllerConfig())
+        : config(config), currentScale(config.maxScale) {}
+
+    // takes the time of the newest measured frame, returns the scale for the next one
+    float update(float frameMs)
+    {
+        smoothedMs = measured ? smoothedMs + (frameMs - smoothedMs) * config.smoothing : frameMs;
+        measured = true;
+        if (settle > 0)
+        {
+            settle--;
+            state = SETTLING;
+            return currentScale;
+        }
+
+        if (smoothedMs > config.targetMs * config.lowerAbove && currentScale > config.minScale)
+        {
+            // the cost follows the pixel count, the square of the scale
+            float aim = config.targetMs * (config.lowerAbove + config.raiseBelow) * 0.5f;
+            float next = currentScale * std::sqrt(aim / smoothedMs);
+            change(std::max({ next, currentScale - config.maxLowerStep, config.minScale }));
+        }
+        else if (smoothedMs < config.targetMs * config.raiseBelow && currentScale < config.maxScale)
+        {
+            state = RECOVERING;
+            if (++calmFrames >= config.raiseAfter)
+                change(std::min(currentScale + config.raiseStep, config.maxScale));
+        }
+        else
+        {
+            state = HOLDING;
+            calmFrames = 0;
+        }
+        return currentScale;
+    }
+
+    float scale() const { return currentScale; }
+    float averageMs() const { return smoothedMs; }
+    float targetMs() const { return config.targetMs; }
+    State currentState() const { return state; }
+    unsigned changeCount() const { return changes; }
+
+    static const char* stateName(State s)
+    {
+        static const char* names[] = { "holding", "settling", "recovering" };
+        return names[s];
+    }
+
+private:
+    ResolutionControllerConfig config;
+    float currentScale;
+    float smoothedMs = 0.0f;
+    bool measured = false;
+    int settle = 0;
+    int calmFrames = 0;
+    unsigned changes = 0;
+    State state = HOLDING;
+
+    void change(float next)
+    {
+        currentScale = next;
+        settle = config.settleFrames;
+        calmFrames = 0;
+        changes++;
+        state = SETTLING;
+    }
+};
+#endif
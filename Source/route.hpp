@@ -0,0 +1,143 @@
+#ifndef ROUTE_H
+#define ROUTE_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// The bus route on the control panel map: a closed loop of quadratic Bezier legs between consecutive stations,
+// each bent sideways by the same offset the panel uses to draw the paths. Every leg is flattened once into a
+// polyline with its cumulative arc length, so placing a bus at a distance is a binary search instead of a walk.
+class Route
+{
+public:
+    static const int SEGMENTS_PER_LEG = 100;
+
+    Route() = default;
+
+    explicit Route(const std::vector<glm::vec2>& stationPositions)
+    {
+        build(stationPositions);
+    }
+
+    void build(const std::vector<glm::vec2>& stationPositions)
+    {
+        stations = stationPositions;
+        int n = static_cast<int>(stations.size());
+        legs.assign(n, Leg());
+        legStart.assign(n + 1, 0.0f);
+        for (int i = 0; i < n; i++)
+        {
+            Leg& leg = legs[i];
+            glm::vec2 a = stations[i];
+            glm::vec2 b = stations[(i + 1) % n];
+            leg.control = controlPoint(a, b);
+            leg.points.resize(SEGMENTS_PER_LEG + 1);
+            leg.cumulative.resize(SEGMENTS_PER_LEG + 1);
+            leg.points[0] = a;
+            leg.cumulative[0] = 0.0f;
+            for (int j = 1; j <= SEGMENTS_PER_LEG; j++)
+            {
+                float t = (float)j / SEGMENTS_PER_LEG;
+                leg.points[j] = bezier(a, leg.control, b, t);
+                glm::vec2 d = leg.points[j] - leg.points[j - 1];
+                leg.cumulative[j] = leg.cumulative[j - 1] + std::sqrt(d.x * d.x + d.y * d.y);
+            }
+            legStart[i + 1] = legStart[i] + leg.cumulative.back();
+        }
+    }
+
+    int stationCount() const { return static_cast<int>(stations.size()); }
+    glm::vec2 station(int i) const { return stations[i]; }
+    float legLength(int leg) const { return legs[leg].cumulative.back(); }
+    float totalLength() const { return legStart.back(); }
+
+    // distance from station 0 along the route to a point `distance` into leg `leg`
+    float routeDistance(int leg, float distance) const { return legStart[leg] + distance; }
+
+    // point `distance` along leg `leg` (from station leg to station leg + 1)
+    glm::vec2 positionOnLeg(int leg, float distance) const
+    {
+        const Leg& l = legs[leg];
+        if (distance <= 0.0f)
+            return l.points.front();
+        if (distance >= l.cumulative.back())
+            return l.points.back();
+        int j = static_cast<int>(std::upper_bound(l.cumulative.begin(), l.cumulative.end(), distance) - l.cumulative.begin());
+        float d = l.cumulative[j] - l.cumulative[j - 1];
+        float ratio = (d > 0.0f) ? (distance - l.cumulative[j - 1]) / d : 0.0f;
+        return l.points[j - 1] + (l.points[j] - l.points[j - 1]) * ratio;
+    }
+
+    // direction of travel at a point of a leg
+    glm::vec2 tangentOnLeg(int leg, float distance) const
+    {
+        glm::vec2 a = positionOnLeg(leg, distance - 0.005f);
+        glm::vec2 b = positionOnLeg(leg, distance + 0.005f);
+        glm::vec2 d = b - a;
+        float len = std::sqrt(d.x * d.x + d.y * d.y);
+        return len > 0.0f ? d * (1.0f / len) : glm::vec2(1.0f, 0.0f);
+    }
+
+    // point at a distance from station 0, wrapping around the loop
+    glm::vec2 positionAt(float routeDistance) const
+    {
+        int leg;
+        float distance;
+        locate(routeDistance, leg, distance);
+        return positionOnLeg(leg, distance);
+    }
+
+    // direction of travel at a distance from station 0, also across the station at the end of a leg
+    glm::vec2 tangentAt(float routeDistance) const
+    {
+        glm::vec2 d = positionAt(routeDistance + 0.005f) - positionAt(routeDistance - 0.005f);
+        float len = std::sqrt(d.x * d.x + d.y * d.y);
+        return len > 0.0f ? d * (1.0f / len) : glm::vec2(1.0f, 0.0f);
+    }
+
+    // leg and distance into it for a distance from station 0
+    void locate(float routeDistance, int& leg, float& distance) const
+    {
+        float total = totalLength();
+        routeDistance = std::fmod(routeDistance, total);
+        if (routeDistance < 0.0f)
+            routeDistance += total;
+        leg = static_cast<int>(std::upper_bound(legStart.begin(), legStart.end(), routeDistance) - legStart.begin()) - 1;
+        leg = std::clamp(leg, 0, stationCount() - 1);
+        distance = routeDistance - legStart[leg];
+    }
+
+    // the same bend the control panel path uses
+    static glm::vec2 controlPoint(glm::vec2 a, glm::vec2 b)
+    {
+        float dx = b.x - a.x;
+        float dy = b.y - a.y;
+        glm::vec2 c((a.x + b.x) / 2.0f, (a.y + b.y) / 2.0f);
+        float length_dir = std::sqrt(dx * dx + dy * dy);
+        if (length_dir > 0.0f) {
+            c.x += -dy / length_dir * 0.35f;
+            c.y += dx / length_dir * 0.35f;
+        }
+        return c;
+    }
+
+    static glm::vec2 bezier(glm::vec2 a, glm::vec2 c, glm::vec2 b, float t)
+    {
+        float u = 1.0f - t;
+        return a * (u * u) + c * (2 * u * t) + b * (t * t);
+    }
+
+private:
+    struct Leg {
+        glm::vec2 control;
+        std::vector<glm::vec2> points;
+        std::vector<float> cumulative;
+    };
+    std::vector<glm::vec2> stations;
+    std::vector<Leg> legs;
+    std::vector<float> legStart;
+};
+#endif
@@ -0,0 +1,135 @@
+#ifndef SCALED_RENDER_TARGET_H
+#define SCALED_RENDER_TARGET_H
+
+#include <GL/glew.h>
+
+#include "gl_handles.hpp"
+#include "memory_tracker.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+// Offscreen colour and depth target for the 3D scene at a fraction of the window size. The attachments are
+// allocated at full window size and only a corner of them is drawn to, so changing the scale every frame costs
+// nothing; they are reallocated only when the window itself is resized. resolve() stretches that corner over
+// the whole backbuffer with linear filtering.
+class ScaledRenderTarget
+{
+public:
+    ScaledRenderTarget() { fbo = GLFramebuffer::create(); }
+
+    // binds the target with a viewport of scale times the window size, returns false when it is incomplete
+    bool begin(int windowWidth, int windowHeight, float scale)
+    {
+        if (windowWidth != width || windowHeight != height)
+            allocate(windowWidth, windowHeight);
+        renderWidth = std::clamp(static_cast<int>(width * scale + 0.5f), 1, width);
+        renderHeight = std::clamp(static_cast<int>(height * scale + 0.5f), 1, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        if (!complete)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            return false;
+        }
+        glViewport(0, 0, renderWidth, renderHeight);
+        return true;
+    }
+
+    // upscales the drawn corner into the default framebuffer and leaves it bound with a full window viewport
+    void resolve()
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        GLenum filter = renderWidth == width && renderHeight == height ? GL_NEAREST : GL_LINEAR;
+        glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, width, height, GL_COLOR_BUFFER_BIT, filter);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, width, height);
+    }
+
+    int drawnWidth() const { return renderWidth; }
+    int drawnHeight() const { return renderHeight; }
+
+private:
+    GLFramebuffer fbo;
+    GLTexture color, depth;
+    int width = 0, height = 0;
+    int renderWidth = 1, renderHeight = 1;
+    bool complete = false;
+
+    void allocate(int newWidth, int newHeight)
+    {
+        width = std::max(newWidth, 1);
+        height = std::max(newHeight, 1);
+        color = GLTexture::create();
+        glBindTexture(GL_TEXTURE_2D, color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        depth = GLTexture::create();
+        glBindTexture(GL_TEXTURE_2D, depth);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        memoryTracker.track(MemoryTracker::TEXTURE, color, textureBytes(GL_RGBA8, width, height), MemoryCategory::RenderTarget, "scene target");
+        memoryTracker.track(MemoryTracker::TEXTURE, depth, textureBytes(GL_DEPTH_COMPONENT24, width, height), MemoryCategory::RenderTarget, "scene target");
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        if (!complete)
+            std::cout << "ERROR::FRAMEBUFFER:: Scaled render target is not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+};
+
+// GPU time of whole frames from timestamp queries, which unlike GL_TIME_ELAPSED may enclose other timed
+// passes. Results are read a few frames late and never waited for.
+class GpuFrameTimer
+{
+public:
+    GpuFrameTimer() { glGenQueries(FRAMES * 2, queries); }
+    ~GpuFrameTimer() { glDeleteQueries(FRAMES * 2, queries); }
+
+    GpuFrameTimer(const GpuFrameTimer&) = delete;
+    GpuFrameTimer& operator=(const GpuFrameTimer&) = delete;
+
+    void begin() { glQueryCounter(queries[(frame % FRAMES) * 2], GL_TIMESTAMP); }
+
+    void end()
+    {
+        glQueryCounter(queries[(frame % FRAMES) * 2 + 1], GL_TIMESTAMP);
+        issued[frame % FRAMES] = true;
+        frame++;
+    }
+
+    // true when the oldest pending frame has finished, its time is then in lastMs()
+    bool collect()
+    {
+        int slot = frame % FRAMES;   // the one begin() reuses next
+        if (!issued[slot])
+            return false;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[slot * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+        GLuint64 start = 0, end = 0;
+        glGetQueryObjectui64v(queries[slot * 2], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(queries[slot * 2 + 1], GL_QUERY_RESULT, &end);
+        ms = (end - start) / 1e6f;
+        issued[slot] = false;
+        return true;
+    }
+
+    float lastMs() const { return ms; }
+
+private:
+    static const int FRAMES = 3;
+    GLuint queries[FRAMES * 2] = {};
+    bool issued[FRAMES] = {};
+    uint64_t frame = 0;
+    float ms = 0.0f;
+};
+#endif
@@ -0,0 +1,359 @@
+#ifndef SCENERY_STREAM_H
+#define SCENERY_STREAM_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "frustum.hpp"
+#include "route.hpp"
+#include "vegetation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum SceneryKind : uint8_t {
+    SCENERY_CAR_A,
+    SCENERY_CAR_B,
+};
+
+struct SceneryItem {
+    glm::mat4 transform;
+    SceneryKind kind;
+};
+
+// One stretch of the route and everything standing along it, in scenery space: the route map scaled up to
+// world units, map x along x, map y along -z, y up.
+struct SceneryChunk {
+    static constexpr int ROAD_SAMPLES = 8;
+    static constexpr int ROAD_VERTICES = ROAD_SAMPLES * 6;   // position, normal, uv like formVAO3D
+    static constexpr int MAX_ITEMS = 2;
+    static constexpr int MAX_TREES = 24;
+    static constexpr int MAX_LAMPS = 1;
+    static constexpr size_t BYTES = ROAD_VERTICES * 8 * sizeof(float) + MAX_ITEMS * sizeof(SceneryItem) +
+                                    MAX_TREES * sizeof(VegetationInstance) + MAX_LAMPS * sizeof(glm::vec3);
+
+    int index = -1;   // position along the route, chunk 0 starts at station 0
+    int slot = 0;     // place in the pool, and the chunk's range in a road buffer of pool size
+    std::vector<float> road;
+    std::vector<SceneryItem> items;
+    std::vector<VegetationInstance> trees;   // all share one mesh, drawn by VegetationRenderer
+    std::vector<glm::vec3> lamps;
+    BoundingSphere bounds = { glm::vec3(0.0f), 0.0f };
+};
+
+struct SceneryConfig {
+    float worldScale = 150.0f;     // scenery units per route unit
+    float chunkLength = 15.0f;     // of road, rounded so the loop divides evenly
+    float roadWidth = 19.0f;       // the bus in the middle, two traffic lanes each side
+    float roadHeight = -1.1f;      // just under the bus floor
+    int chunksAhead = 8;
+    int chunksBehind = 2;
+    size_t memoryBudget = 128 * 1024;   // for every chunk in the pool, resident or being built
+    int activationsPerFrame = 2;   // finished chunks handed to the renderer per update
+};
+
+inline glm::vec3 sceneryPoint(const glm::vec2& mapPoint, float worldScale)
+{
+    return glm::vec3(mapPoint.x * worldScale, 0.0f, -mapPoint.y * worldScale);
+}
+
+// Scenery space as seen from a bus at routeDistance: the bus stands still facing -z and the world moves past.
+inline glm::mat4 sceneryToBus(const Route& route, float routeDistance, float worldScale)
+{
+    glm::vec3 position = sceneryPoint(route.positionAt(routeDistance), worldScale);
+    glm::vec2 t = route.tangentAt(routeDistance);
+    return glm::lookAt(position, position + glm::vec3(t.x, 0.0f, -t.y), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+// Streams the scenery along the route. The loop is cut into chunks; a background thread builds the ones in a
+// window around the bus, nearest first, into chunk objects taken from a fixed pool, and chunks that fall behind
+// the window go back to the pool. The pool is sized from the memory budget once, so however long the bus
+// drives, the resident set, the memory and the work per frame stay the same. A budget smaller than the
+// window shortens how far ahead the scenery reaches.
+class SceneryStreamer
+{
+public:
+    struct Stats {
+        size_t resident = 0;
+        size_t poolSize = 0;
+        uint64_t built = 0;
+        uint64_t recycled = 0;
+        double buildMs = 0.0;   // mean per chunk
+    };
+
+    SceneryStreamer(const Route& route, SceneryConfig config = SceneryConfig()) : route(route), config(config)
+    {
+        chunkCount = std::max(1, static_cast<int>(std::round(route.totalLength() * config.worldScale / config.chunkLength)));
+        chunkRouteLength = route.totalLength() / chunkCount;
+        ahead = std::min(config.chunksAhead, chunkCount - 1);
+        behind = std::min(config.chunksBehind, chunkCount - 1 - ahead);
+
+        size_t window = static_cast<size_t>(ahead + behind + 1);
+        pool.resize(std::clamp<size_t>(config.memoryBudget / SceneryChunk::BYTES, 1, window));
+        for (size_t i = 0; i < pool.size(); i++)
+        {
+            SceneryChunk& chunk = pool[i];
+            chunk.slot = static_cast<int>(i);
+            chunk.road.reserve(SceneryChunk::ROAD_VERTICES * 8);
+            chunk.items.reserve(SceneryChunk::MAX_ITEMS);
+            chunk.trees.reserve(SceneryChunk::MAX_TREES);
+            chunk.lamps.reserve(SceneryChunk::MAX_LAMPS);
+            available.push_back(&chunk);
+        }
+        resident.reserve(pool.size());
+        ready.reserve(pool.size());
+        activated.reserve(pool.size());
+        state.assign(chunkCount, Absent);
+    }
+
+    ~SceneryStreamer() { stop(); }
+
+    SceneryStreamer(const SceneryStreamer&) = delete;
+    SceneryStreamer& operator=(const SceneryStreamer&) = delete;
+
+    void start()
+    {
+        stop();
+        running = true;
+        worker = std::thread([this] { run(); });
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        wake.notify_all();
+        if (worker.joinable())
+            worker.join();
+    }
+
+    // Once per frame on the thread that draws: moves the window to the bus, recycles what fell out of it and
+    // takes up to activationsPerFrame finished chunks. Never waits for the builder.
+    void update(float routeDistance)
+    {
+        int center = chunkOf(routeDistance);
+        activated.clear();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            focus = center;
+            for (size_t i = resident.size(); i-- > 0;)
+            {
+                if (inWindow(resident[i]->index, center))
+                    continue;
+                release(resident[i]);
+                resident[i] = resident.back();
+                resident.pop_back();
+                stats.recycled++;
+            }
+            size_t taken = 0;
+            for (; taken < ready.size() && static_cast<int>(activated.size()) < config.activationsPerFrame; taken++)
+            {
+                SceneryChunk* chunk = ready[taken];
+                if (!inWindow(chunk->index, center))
+                {
+                    release(chunk);
+                    continue;
+                }
+                state[chunk->index] = Resident;
+                resident.push_back(chunk);
+                activated.push_back(chunk);
+            }
+            ready.erase(ready.begin(), ready.begin() + taken);
+            stats.resident = resident.size();
+        }
+        wake.notify_one();
+    }
+
+    // drawn this frame; only update() changes them, so the drawing thread reads them without a lock
+    const std::vector<SceneryChunk*>& residentChunks() const { return resident; }
+    // became resident in the last update, their road still has to be uploaded
+    const std::vector<SceneryChunk*>& activatedChunks() const { return activated; }
+
+    size_t poolSize() const { return pool.size(); }
+    int chunks() const { return chunkCount; }
+
+    Stats lastStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Stats result = stats;
+        result.poolSize = pool.size();
+        result.buildMs = stats.built ? buildMsTotal / stats.built : 0.0;
+        return result;
+    }
+
+private:
+    enum ChunkState : uint8_t { Absent, Building, Resident };
+
+    Route route;
+    SceneryConfig config;
+    int chunkCount = 1;
+    float chunkRouteLength = 1.0f;
+    int ahead = 0, behind = 0;
+
+    std::vector<SceneryChunk> pool;   // never resized after construction, chunks are handed out by pointer
+    std::vector<SceneryChunk*> resident, activated;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread worker;
+    bool running = false;
+    int focus = -1;
+    std::vector<ChunkState> state;
+    std::vector<SceneryChunk*> available, ready;
+    Stats stats;
+    double buildMsTotal = 0.0;
+
+    int chunkOf(float routeDistance) const
+    {
+        float total = route.totalLength();
+        float d = std::fmod(routeDistance, total);
+        if (d < 0.0f)
+            d += total;
+        return std::min(static_cast<int>(d / chunkRouteLength), chunkCount - 1);
+    }
+
+    bool inWindow(int index, int center) const
+    {
+        int forward = (index - center + chunkCount) % chunkCount;
+        return forward <= ahead || chunkCount - forward <= behind;
+    }
+
+    void release(SceneryChunk* chunk)
+    {
+        state[chunk->index] = Absent;
+        available.push_back(chunk);
+    }
+
+    // the closest chunk of the window that is not there yet, ahead of the bus before behind it
+    int nextMissing() const
+    {
+        for (int o = 0; o <= ahead + behind; o++)
+        {
+            int offset = o <= ahead ? o : ahead - o;
+            int index = ((focus + offset) % chunkCount + chunkCount) % chunkCount;
+            if (state[index] == Absent)
+                return index;
+        }
+        return -1;
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (running)
+        {
+            int index = (focus >= 0 && !available.empty()) ? nextMissing() : -1;
+            if (index < 0)
+            {
+                wake.wait(lock);
+                continue;
+            }
+            SceneryChunk* chunk = available.back();
+            available.pop_back();
+            state[index] = Building;
+
+            lock.unlock();
+            auto start = std::chrono::steady_clock::now();
+            build(index, *chunk);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            lock.lock();
+
+            ready.push_back(chunk);
+            stats.built++;
+            buildMsTotal += ms;
+        }
+    }
+
+    // Everything about a chunk follows from its index, so a chunk that comes back looks the same.
+    void build(int index, SceneryChunk& chunk) const
+    {
+        uint32_t seed = static_cast<uint32_t>(index) * 2654435761u + 0x9e3779b9u;
+        auto random = [&seed]() {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            return (seed & 0xffffff) / float(0x1000000);
+        };
+
+        chunk.index = index;
+        chunk.road.clear();
+        chunk.items.clear();
+        chunk.trees.clear();
+        chunk.lamps.clear();
+
+        float start = index * chunkRouteLength;
+        float step = chunkRouteLength / SceneryChunk::ROAD_SAMPLES;
+        float halfWidth = config.roadWidth * 0.5f;
+        auto frame = [&](float along, glm::vec3& position, glm::vec3& right) {
+            position = sceneryPoint(route.positionAt(along), config.worldScale);
+            glm::vec2 t = route.tangentAt(along);
+            right = glm::vec3(t.y, 0.0f, t.x);
+        };
+
+        glm::vec3 lo(1e30f), hi(-1e30f);
+        auto grow = [&](const glm::vec3& p, float margin) {
+            lo = glm::vec3(std::min(lo.x, p.x - margin), std::min(lo.y, p.y - margin), std::min(lo.z, p.z - margin));
+            hi = glm::vec3(std::max(hi.x, p.x + margin), std::max(hi.y, p.y + margin), std::max(hi.z, p.z + margin));
+        };
+        auto vertex = [&](const glm::vec3& p, float u, float v) {
+            chunk.road.insert(chunk.road.end(), { p.x, p.y, p.z, 0.0f, 1.0f, 0.0f, u, v });
+            grow(p, 0.0f);
+        };
+        for (int i = 0; i < SceneryChunk::ROAD_SAMPLES; i++)
+        {
+            glm::vec3 p0, r0, p1, r1;
+            frame(start + i * step, p0, r0);
+            frame(start + (i + 1) * step, p1, r1);
+            glm::vec3 up(0.0f, config.roadHeight, 0.0f);
+            glm::vec3 a = p0 - r0 * halfWidth + up, b = p0 + r0 * halfWidth + up;
+            glm::vec3 c = p1 + r1 * halfWidth + up, d = p1 - r1 * halfWidth + up;
+            float v0 = static_cast<float>(i) / SceneryChunk::ROAD_SAMPLES, v1 = static_cast<float>(i + 1) / SceneryChunk::ROAD_SAMPLES;
+            // counter-clockwise seen from above
+            vertex(a, 0.0f, v0); vertex(d, 0.0f, v1); vertex(c, 1.0f, v1);
+            vertex(c, 1.0f, v1); vertex(b, 1.0f, v0); vertex(a, 0.0f, v0);
+        }
+
+        auto place = [&](float along, float side, float height, float yaw, float scale) {
+            glm::vec3 p, right;
+            frame(start + along * chunkRouteLength, p, right);
+            p += right * side + glm::vec3(0.0f, height, 0.0f);
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), p);
+            model = glm::rotate(model, yaw, glm::vec3(0.0f, 1.0f, 0.0f));
+            grow(p, 6.0f * scale);
+            return glm::scale(model, glm::vec3(scale));
+        };
+        for (float side : { -1.0f, 1.0f })
+        {
+            int trees = 6 + static_cast<int>(random() * (SceneryChunk::MAX_TREES / 2 - 6 + 1));
+            for (int t = 0; t < trees; t++)
+            {
+                glm::mat4 model = place(random(), side * (halfWidth + 3.0f + random() * 14.0f), -1.0f, random() * 6.2832f, 0.7f + random() * 0.6f);
+                glm::vec3 tint(0.8f + random() * 0.3f, 0.85f + random() * 0.3f, 0.75f + random() * 0.2f);
+                chunk.trees.push_back({ model, tint, random() * 6.2832f, random() });
+            }
+            if (random() < 0.25f)
+            {
+                glm::vec2 t = route.tangentAt(start + 0.5f * chunkRouteLength);
+                float yaw = std::atan2(t.x, -t.y);
+                SceneryKind kind = random() < 0.5f ? SCENERY_CAR_A : SCENERY_CAR_B;
+                chunk.items.push_back({ place(0.2f + random() * 0.6f, side * (halfWidth + 1.5f), 0.5f, yaw, 1.2f), kind });
+            }
+        }
+
+        // one lamp per chunk, on alternating sides
+        glm::vec3 p, right;
+        frame(start, p, right);
+        chunk.lamps.push_back(p + right * ((index % 2 ? 1.0f : -1.0f) * (halfWidth + 0.5f)) + glm::vec3(0.0f, 3.0f, 0.0f));
+
+        chunk.bounds.center = (lo + hi) * 0.5f;
+        chunk.bounds.radius = glm::length(hi - lo) * 0.5f;
+    }
+};
+#endif
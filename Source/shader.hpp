@@ -4,6 +4,8 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include "gl_handles.hpp"
+
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -60,7 +62,8 @@ public:
         glCompileShader(fragment);
         checkCompileErrors(fragment, "FRAGMENT");
         // shader Program
-        ID = glCreateProgram();
+        program = GLProgram::create();
+        ID = program;
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
         glLinkProgram(ID);
@@ -70,6 +73,12 @@ public:
         glDeleteShader(fragment);
 
     }
+    // takes over a program that was already linked, e.g. by the ProgramCache
+    // ------------------------------------------------------------------------
+    explicit Shader(GLProgram linked) : program(std::move(linked))
+    {
+        ID = program;
+    }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() const
@@ -136,6 +145,9 @@ public:
     }
 
 private:
+    // owns the linked program, ID is kept as the raw name for the uniform helpers
+    GLProgram program;
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
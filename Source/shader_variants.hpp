@@ -0,0 +1,233 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "program_cache.hpp"
+#include "shader.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Feature bits of the basic shader. Each one turns into a #define, so a variant only pays for what it uses.
+enum ShaderFeature : unsigned {
+    FEATURE_DIFFUSE_MAP = 1 << 0,   // albedo from uDiffMap1, otherwise the constant uAlbedo
+    FEATURE_SPECULAR_MAP = 1 << 1,  // specular strength from uSpecMap1
+    FEATURE_EMISSIVE = 1 << 2,      // albedo is output as is, no lighting
+    FEATURE_INSTANCING = 1 << 3,    // model matrix from vertex attributes 3-6 instead of uM
+    FEATURE_ALPHA_BLEND = 1 << 4,   // keeps the albedo alpha, opaque variants write 1.0
+    FEATURE_VEGETATION = 1 << 5,    // with INSTANCING: tint, wind phase and fade from attributes 7-8, wind sway
+};
+
+inline std::string shaderFeatureDefines(unsigned features)
+{
+    static const char* names[] = { "HAS_DIFFUSE_MAP", "HAS_SPECULAR_MAP", "EMISSIVE", "INSTANCING", "ALPHA_BLEND", "VEGETATION" };
+    std::string defines;
+    for (unsigned i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+        if (features & (1u << i))
+            defines += std::string("#define ") + names[i] + "\n";
+    return defines;
+}
+
+// All permutations of one vertex/fragment pair, kept by their feature bits. The variants a scene is known to draw
+// with are queued with prebuild() and built in the ProgramCache pass with every other program, so later runs load
+// them from stored binaries; any other variant is built through the same cache the first time it is used. Uniforms
+// that every variant shares (camera, light, model matrix, albedo) are set here instead of on a program; use()
+// uploads whatever the chosen variant has not seen yet, so switching variants mid-frame does not lose state.
+class ShaderVariants
+{
+public:
+    ShaderVariants(ProgramCache& cache, std::string vertexPath, std::string fragmentPath)
+        : cache(cache), vertexPath(std::move(vertexPath)), fragmentPath(std::move(fragmentPath))
+    {
+        vertexSource = ProgramCache::readFile(this->vertexPath);
+        fragmentSource = ProgramCache::readFile(this->fragmentPath);
+        setVec4("uAlbedo", glm::vec4(1.0f));
+    }
+
+    ShaderVariants(const ShaderVariants&) = delete;
+    ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+    // queues the variant for these features in the next ProgramCache::build(), adopt() collects it afterwards
+    void prebuild(unsigned features)
+    {
+        if (variants.count(features) || queued.count(features))
+            return;
+        queued[features] = cache.add(vertexPath, fragmentPath, shaderFeatureDefines(features));
+    }
+
+    void adopt()
+    {
+        for (auto& [features, index] : queued)
+        {
+            // a failed variant stays empty and draws nothing, like one built on first use
+            Variant& v = variants.emplace(features, Variant(Shader(cache.take(index)))).first->second;
+            initVariant(v);
+        }
+        queued.clear();
+    }
+
+    // binds the variant for these features, building it on first use unless it was prebuilt
+    Shader& use(unsigned features)
+    {
+        Variant& v = variant(features);
+        v.shader.use();
+        sync(v);
+        return v.shader;
+    }
+
+    void setInt(const std::string& name, int value)
+    {
+        float bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        set(name, Uniform::Int, &bits, 1);
+    }
+    void setFloat(const std::string& name, float value) { set(name, Uniform::Float, &value, 1); }
+    void setVec2(const std::string& name, const glm::vec2& value) { set(name, Uniform::Vec2, glm::value_ptr(value), 2); }
+    void setVec3(const std::string& name, const glm::vec3& value) { set(name, Uniform::Vec3, glm::value_ptr(value), 3); }
+    void setVec4(const std::string& name, const glm::vec4& value) { set(name, Uniform::Vec4, glm::value_ptr(value), 4); }
+    void setMat4(const std::string& name, const glm::mat4& value) { set(name, Uniform::Mat4, glm::value_ptr(value), 16); }
+
+    // Recompiles every variant built so far from new sources. Nothing changes unless all of them compile.
+    bool reload(std::string newVertexSource, std::string newFragmentSource)
+    {
+        std::map<unsigned, GLProgram> rebuilt;
+        for (auto& [features, v] : variants)
+        {
+            GLProgram program = build(features, newVertexSource, newFragmentSource);
+            if (!program)
+                return false;
+            rebuilt[features] = std::move(program);
+        }
+        vertexSource = std::move(newVertexSource);
+        fragmentSource = std::move(newFragmentSource);
+        for (auto& [features, program] : rebuilt)
+        {
+            Variant& v = variants.at(features);
+            v.shader = Shader(std::move(program));
+            initVariant(v);
+        }
+        return true;
+    }
+
+    size_t compiledCount() const { return variants.size(); }
+
+private:
+    struct Uniform {
+        enum Type { Int, Float, Vec2, Vec3, Vec4, Mat4 };
+        std::string name;
+        Type type;
+        float data[16];
+        uint64_t version;
+    };
+
+    struct Variant {
+        explicit Variant(Shader shader) : shader(std::move(shader)) {}
+
+        Shader shader;
+        uint64_t synced = 0;            // every uniform up to this version is uploaded
+        std::vector<GLint> locations;   // per uniform, -2 until looked up
+    };
+
+    ProgramCache& cache;
+    std::string vertexPath, fragmentPath;
+    std::string vertexSource, fragmentSource;
+    std::map<unsigned, Variant> variants;
+    std::map<unsigned, size_t> queued;   // features to their ProgramCache entry
+    std::vector<Uniform> uniforms;
+    uint64_t version = 0;
+
+    void set(const std::string& name, Uniform::Type type, const float* data, int count)
+    {
+        Uniform* u = nullptr;
+        for (auto& existing : uniforms)
+        {
+            if (existing.name == name)
+            {
+                u = &existing;
+                break;
+            }
+        }
+        if (!u)
+        {
+            uniforms.push_back({ name, type, {}, 0 });
+            u = &uniforms.back();
+        }
+        u->type = type;
+        std::memcpy(u->data, data, count * sizeof(float));
+        u->version = ++version;
+    }
+
+    void sync(Variant& v)
+    {
+        if (v.synced == version)
+            return;
+        v.locations.resize(uniforms.size(), -2);
+        for (size_t i = 0; i < uniforms.size(); i++)
+        {
+            const Uniform& u = uniforms[i];
+            if (u.version <= v.synced)
+                continue;
+            if (v.locations[i] == -2)
+                v.locations[i] = glGetUniformLocation(v.shader.ID, u.name.c_str());
+            GLint location = v.locations[i];
+            if (location < 0)
+                continue;   // compiled out of this variant
+            switch (u.type)
+            {
+            case Uniform::Int:
+            {
+                GLint value;
+                std::memcpy(&value, u.data, sizeof(value));
+                glUniform1i(location, value);
+                break;
+            }
+            case Uniform::Float: glUniform1fv(location, 1, u.data); break;
+            case Uniform::Vec2:  glUniform2fv(location, 1, u.data); break;
+            case Uniform::Vec3:  glUniform3fv(location, 1, u.data); break;
+            case Uniform::Vec4:  glUniform4fv(location, 1, u.data); break;
+            case Uniform::Mat4:  glUniformMatrix4fv(location, 1, GL_FALSE, u.data); break;
+            }
+        }
+        v.synced = version;
+    }
+
+    Variant& variant(unsigned features)
+    {
+        auto it = variants.find(features);
+        if (it != variants.end())
+            return it->second;
+
+        auto start = std::chrono::steady_clock::now();
+        GLProgram program = build(features, vertexSource, fragmentSource);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (program)
+            printf("Shader variant %s 0x%02x was not prebuilt, built on first use in %.2f ms\n", fragmentPath.c_str(), features, ms);
+        // a failed variant stays empty and draws nothing instead of being recompiled every frame
+        Variant& v = variants.emplace(features, Variant(Shader(std::move(program)))).first->second;
+        initVariant(v);
+        return v;
+    }
+
+    void initVariant(Variant& v)
+    {
+        v.synced = 0;
+        v.locations.assign(uniforms.size(), -2);
+        v.shader.use();
+        v.shader.setInt("uDiffMap1", 0);
+        v.shader.setInt("uSpecMap1", 1);
+    }
+
+    GLProgram build(unsigned features, const std::string& vs, const std::string& fs)
+    {
+        return cache.load(vertexPath, fragmentPath, vs, fs, shaderFeatureDefines(features));
+    }
+};
+#endif
@@ -0,0 +1,181 @@
+#ifndef SHADOW_MAP_H
+#define SHADOW_MAP_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "frustum.hpp"
+#include "gl_handles.hpp"
+#include "memory_tracker.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+// Omnidirectional shadow map for one point light, split into a cached static part and a per-frame dynamic part.
+// Static casters are rendered once into their own depth cube, in the space they do not move in (the bus), and
+// again only when the light moves within that space. Every frame that cube is copied into the sampled one and
+// only the dynamic casters are drawn on top.
+class CubeShadowMap
+{
+public:
+    static constexpr int UNIT = 12;   // texture unit of uShadowMap, next to the light cluster buffers
+
+    struct Stats {
+        double cpuMs = 0.0;     // submitting the passes of the last frame
+        double gpuMs = 0.0;     // GPU time of the passes, from a query a frame or two old
+        unsigned dynamicDraws = 0;
+        unsigned staticRebuilds = 0;
+    };
+
+    explicit CubeShadowMap(int size = 512, float nearPlane = 0.05f, float farPlane = 25.0f)
+        : size(size), nearPlane(nearPlane), farPlane(farPlane)
+    {
+        staticMap = createCube(false);
+        frameMap = createCube(true);
+        drawFbo = GLFramebuffer::create();
+        readFbo = GLFramebuffer::create();
+        glGenQueries(2, queries);
+    }
+
+    ~CubeShadowMap() { glDeleteQueries(2, queries); }
+
+    CubeShadowMap(const CubeShadowMap&) = delete;
+    CubeShadowMap& operator=(const CubeShadowMap&) = delete;
+
+    // projection * view of each cube face around position, in GL face order
+    std::array<glm::mat4, 6> faceMatrices(const glm::vec3& position) const
+    {
+        static const glm::vec3 dirs[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+        static const glm::vec3 ups[6] = { { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 } };
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, farPlane);
+        std::array<glm::mat4, 6> result;
+        for (int f = 0; f < 6; f++)
+            result[f] = projection * glm::lookAt(position, position + dirs[f], ups[f]);
+        return result;
+    }
+
+    // Renders one frame of shadows. drawStatic(faceMatrix) draws the static casters with localLight as the light
+    // position and is only called when the cache is stale; drawDynamic(faceMatrix, faceFrustum) draws the
+    // moving casters around worldLight and returns how many it drew.
+    template <typename StaticFn, typename DynamicFn>
+    void render(const glm::vec3& localLight, const glm::vec3& worldLight, StaticFn&& drawStatic, DynamicFn&& drawDynamic)
+    {
+        auto start = std::chrono::steady_clock::now();
+        collectQuery();
+        glBeginQuery(GL_TIME_ELAPSED, queries[frameIndex % 2]);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, drawFbo);
+        glViewport(0, 0, size, size);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glEnable(GL_DEPTH_TEST);
+        glDepthMask(GL_TRUE);
+
+        if (!staticValid || localLight != staticLight)
+        {
+            std::array<glm::mat4, 6> faces = faceMatrices(localLight);
+            for (int f = 0; f < 6; f++)
+            {
+                attach(GL_FRAMEBUFFER, staticMap, f);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                drawStatic(faces[f]);
+            }
+            staticLight = localLight;
+            staticValid = true;
+            stats.staticRebuilds++;
+        }
+
+        // static depth first, then the dynamic casters depth tested against it
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, readFbo);
+        glReadBuffer(GL_NONE);
+        std::array<glm::mat4, 6> faces = faceMatrices(worldLight);
+        stats.dynamicDraws = 0;
+        for (int f = 0; f < 6; f++)
+        {
+            attach(GL_READ_FRAMEBUFFER, staticMap, f);
+            attach(GL_DRAW_FRAMEBUFFER, frameMap, f);
+            glBlitFramebuffer(0, 0, size, size, 0, 0, size, size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            stats.dynamicDraws += drawDynamic(faces[f], Frustum::fromMatrix(faces[f]));
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glEndQuery(GL_TIME_ELAPSED);
+        queryIssued[frameIndex % 2] = true;
+        frameIndex++;
+        stats.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // forces the static casters to be drawn again, e.g. after one of them was reloaded
+    void invalidate() { staticValid = false; }
+
+    void bind() const
+    {
+        glActiveTexture(GL_TEXTURE0 + UNIT);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, frameMap);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // near and far of the face projections, basic.frag rebuilds the stored depth from them
+    glm::vec2 planes() const { return glm::vec2(nearPlane, farPlane); }
+
+    const Stats& lastStats() const { return stats; }
+
+private:
+    int size;
+    float nearPlane, farPlane;
+    GLTexture staticMap, frameMap;
+    GLFramebuffer drawFbo, readFbo;
+    GLuint queries[2] = {};
+    bool queryIssued[2] = {};
+    uint64_t frameIndex = 0;
+    bool staticValid = false;
+    glm::vec3 staticLight = glm::vec3(0.0f);
+    Stats stats;
+
+    GLTexture createCube(bool compare) const
+    {
+        GLTexture texture = GLTexture::create();
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        for (int f = 0; f < 6; f++)
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        // the sampled cube compares in hardware, so every tap is already a 2x2 filtered lookup
+        GLint filter = compare ? GL_LINEAR : GL_NEAREST;
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        if (compare)
+        {
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        }
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        memoryTracker.track(MemoryTracker::TEXTURE, texture, textureBytes(GL_DEPTH_COMPONENT24, size, size, false, 6), MemoryCategory::RenderTarget, "shadow map");
+        return texture;
+    }
+
+    static void attach(GLenum target, const GLTexture& cube, int face)
+    {
+        glFramebufferTexture2D(target, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, cube, 0);
+    }
+
+    // reads the query of two frames ago when the GPU is done with it, never waits
+    void collectQuery()
+    {
+        int q = frameIndex % 2;
+        if (!queryIssued[q])
+            return;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[q], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queries[q], GL_QUERY_RESULT, &ns);
+        stats.gpuMs = ns / 1e6;
+        queryIssued[q] = false;
+    }
+};
+#endif
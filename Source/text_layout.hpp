@@ -0,0 +1,77 @@
+#ifndef TEXT_LAYOUT_H
+#define TEXT_LAYOUT_H
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <cstdio>
+#include <functional>
+
+// One rendered glyph of the bitmap font: its texture and metrics in pixels, Advance in 1/64 pixels
+struct Character {
+    unsigned int TextureID;
+    int SizeX, SizeY;
+    int BearingX, BearingY;
+    unsigned int Advance;
+};
+
+// The two triangles of one glyph in clip space, as x, y, u, v. x and y are where the pen is, on the baseline.
+inline void glyphQuad(const Character& ch, float x, float y, float scale, float screenWidth, float screenHeight, float vertices[6][4])
+{
+    float xpos = x + ch.BearingX * scale / screenWidth * 2.0f;
+    float ypos = y - (ch.SizeY - ch.BearingY) * scale / screenHeight * 2.0f;
+
+    float w = ch.SizeX * scale / screenWidth * 2.0f;
+    float h = ch.SizeY * scale / screenHeight * 2.0f;
+
+    const float quad[6][4] = {
+        { xpos,     ypos + h,   0.0f, 0.0f },
+        { xpos,     ypos,       0.0f, 1.0f },
+        { xpos + w, ypos,       1.0f, 1.0f },
+
+        { xpos,     ypos + h,   0.0f, 0.0f },
+        { xpos + w, ypos,       1.0f, 1.0f },
+        { xpos + w, ypos + h,   1.0f, 0.0f }
+    };
+    for (int i = 0; i < 6; i++)
+        for (int j = 0; j < 4; j++)
+            vertices[i][j] = quad[i][j];
+}
+
+// how far the pen moves after the glyph, in clip space
+inline float glyphAdvance(const Character& ch, float scale, float screenWidth)
+{
+    return (ch.Advance >> 6) * scale / screenWidth * 2.0f;
+}
+
+// Renders the printable ASCII glyphs of a font at the given pixel height and hands each one to upload, which
+// makes its texture. Touches no GL state itself.
+inline bool rasterizeGlyphs(const char* fontPath, unsigned pixelHeight, const std::function<void(unsigned char, FT_GlyphSlot)>& upload)
+{
+    FT_Library ft;
+    if (FT_Init_FreeType(&ft)) {
+        fprintf(stderr, "ERROR::FREETYPE: Could not init FreeType Library\n");
+        return false;
+    }
+
+    FT_Face face;
+    if (FT_New_Face(ft, fontPath, 0, &face)) {
+        fprintf(stderr, "ERROR::FREETYPE: Failed to load font\n");
+        FT_Done_FreeType(ft);
+        return false;
+    }
+
+    FT_Set_Pixel_Sizes(face, 0, pixelHeight);
+    for (unsigned char c = 32; c < 128; c++) {
+        if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
+            fprintf(stderr, "ERROR::FREETYPE: Failed to load Glyph\n");
+            continue;
+        }
+        upload(c, face->glyph);
+    }
+
+    FT_Done_Face(face);
+    FT_Done_FreeType(ft);
+    return true;
+}
+#endif
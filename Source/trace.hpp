@@ -0,0 +1,283 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// CPU trace zones, counters and flow events, written as Chrome trace JSON (chrome://tracing or ui.perfetto.dev).
+// Only builds with BUS_TRACING defined record anything; in all others the macros below compile to nothing and
+// their arguments are not evaluated.
+//
+//   TRACE_ZONE("name")            times the enclosing scope
+//   TRACE_ZONE_NAMED(var, "name") ... TRACE_ZONE_END(var)  times a stretch that is not a scope of its own
+//   TRACE_COUNTER("name", value)  a value plotted over time
+//   TRACE_FLOW_BEGIN/END("name", id)  an arrow from one zone to another, possibly on another thread
+//   TRACE_THREAD(name)            names the calling thread in the viewer
+//   TRACE_FRAME_END()             once per presented frame, writes requested traces and checks the frame budget
+//   TRACE_DUMP()                  asks for a trace of what is buffered, written at the next frame end
+//
+// Names must be string literals, they are stored as pointers.
+
+#ifdef BUS_TRACING
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct TraceEvent {
+    enum Type : uint8_t { ZONE, COUNTER, FLOW_BEGIN, FLOW_END, INSTANT };
+
+    const char* name;
+    uint64_t start;   // ns since the tracer was created
+    uint64_t arg;     // zone duration in ns, or flow id
+    double value;     // counter value
+    Type type;
+};
+
+// Events of one thread. Only that thread writes, storing the event before publishing the new count, so readers
+// never see a half written one. When full it wraps around and keeps the newest CAPACITY events.
+class TraceBuffer
+{
+public:
+    static const uint64_t CAPACITY = 1 << 16;
+
+    explicit TraceBuffer(uint32_t threadId) : threadId(threadId), events(new TraceEvent[CAPACITY]) {}
+
+    void push(const TraceEvent& e)
+    {
+        uint64_t n = written.load(std::memory_order_relaxed);
+        events[n & (CAPACITY - 1)] = e;
+        written.store(n + 1, std::memory_order_release);
+    }
+
+    // Appends the buffered events to out, dropping any the writer overwrote while they were copied. Besides the
+    // published ones, the writer may be halfway through the slot of event `after`, which still holds event
+    // after - CAPACITY, so everything below after + 1 - CAPACITY is suspect.
+    void copy(std::vector<TraceEvent>& out) const
+    {
+        uint64_t end = written.load(std::memory_order_acquire);
+        uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+        size_t first = out.size();
+        for (uint64_t i = begin; i < end; i++)
+            out.push_back(events[i & (CAPACITY - 1)]);
+        // orders the plain reads above before the count is read again
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = written.load(std::memory_order_relaxed);
+        uint64_t overwritten = after + 1 > CAPACITY ? after + 1 - CAPACITY : 0;
+        if (overwritten > begin)
+            out.erase(out.begin() + first, out.begin() + first + std::min(overwritten - begin, end - begin));
+    }
+
+    const uint32_t threadId;
+    std::string threadName;   // guarded by the tracer's mutex
+
+private:
+    std::unique_ptr<TraceEvent[]> events;
+    std::atomic<uint64_t> written{ 0 };
+};
+
+class Tracer
+{
+public:
+    static Tracer& instance()
+    {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    uint64_t now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    void zone(const char* name, uint64_t start, uint64_t end) { buffer().push({ name, start, end - start, 0.0, TraceEvent::ZONE }); }
+    void counter(const char* name, double value) { buffer().push({ name, now(), 0, value, TraceEvent::COUNTER }); }
+    void instant(const char* name) { buffer().push({ name, now(), 0, 0.0, TraceEvent::INSTANT }); }
+
+    void flow(const char* name, uint64_t id, bool begin)
+    {
+        buffer().push({ name, now(), id, 0.0, begin ? TraceEvent::FLOW_BEGIN : TraceEvent::FLOW_END });
+    }
+
+    void nameThread(const std::string& name)
+    {
+        TraceBuffer& b = buffer();
+        std::lock_guard<std::mutex> lock(mutex);
+        b.threadName = name;
+    }
+
+    // Where traces go: path at exit (when writeAtExit), path-1.json, path-2.json ... for dumps. With a budget
+    // above zero, a frame longer than that dumps the buffers too, at most once a second and maxTriggeredDumps times.
+    void configure(const std::string& path, bool writeAtExit, double budgetMs)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        outputPath = path;
+        exitTrace = writeAtExit;
+        frameBudgetMs = budgetMs;
+    }
+
+    void requestDump() { dumpRequested = true; }
+
+    void frameEnd()
+    {
+        uint64_t t = now();
+        double frameMs = lastFrameEnd ? (t - lastFrameEnd) / 1e6 : 0.0;
+        lastFrameEnd = t;
+        counter("frame ms", frameMs);
+
+        bool overBudget = frameBudgetMs > 0.0 && frameMs > frameBudgetMs && triggeredDumps < maxTriggeredDumps &&
+                          (triggeredDumps == 0 || t - lastTriggeredDump > 1000000000ull);
+        if (overBudget)
+        {
+            instant("frame over budget");
+            triggeredDumps++;
+            lastTriggeredDump = t;
+        }
+        if (overBudget || dumpRequested.exchange(false))
+        {
+            std::string path = numberedPath(++dumps);
+            if (write(path))
+                printf("Trace written to %s%s\n", path.c_str(), overBudget ? " (frame over budget)" : "");
+            lastFrameEnd = now();   // writing is not part of the next frame
+        }
+    }
+
+    // writes the whole buffers when configured to, call before exiting
+    void finish()
+    {
+        if (exitTrace && write(outputPath))
+            printf("Trace written to %s\n", outputPath.c_str());
+    }
+
+    bool write(const std::string& path)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        FILE* file = fopen(path.c_str(), "w");
+        if (!file)
+        {
+            printf("ERROR::TRACE:: Could not write %s\n", path.c_str());
+            return false;
+        }
+        fprintf(file, "{\"traceEvents\":[\n");
+        bool first = true;
+        std::vector<TraceEvent> events;
+        for (const auto& b : buffers)
+        {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n",
+                    b->threadId, b->threadName.empty() ? "thread" : b->threadName.c_str());
+            first = false;
+            events.clear();
+            b->copy(events);
+            for (const TraceEvent& e : events)
+            {
+                double ts = e.start / 1000.0;
+                switch (e.type)
+                {
+                case TraceEvent::ZONE:
+                    fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", e.name, b->threadId, ts, e.arg / 1000.0);
+                    break;
+                case TraceEvent::COUNTER:
+                    fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%g}}", e.name, b->threadId, ts, e.value);
+                    break;
+                case TraceEvent::FLOW_BEGIN:
+                case TraceEvent::FLOW_END:
+                    fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"flow\",\"ph\":\"%s\",\"bp\":\"e\",\"id\":%llu,\"pid\":1,\"tid\":%u,\"ts\":%.3f}", e.name,
+                            e.type == TraceEvent::FLOW_BEGIN ? "s" : "f", (unsigned long long)e.arg, b->threadId, ts);
+                    break;
+                case TraceEvent::INSTANT:
+                    fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}", e.name, b->threadId, ts);
+                    break;
+                }
+            }
+        }
+        fprintf(file, "\n]}\n");
+        fclose(file);
+        return true;
+    }
+
+private:
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;   // one per thread that ever traced, kept after it exits
+    std::string outputPath = "trace.json";
+    bool exitTrace = false;
+    double frameBudgetMs = 0.0;
+    std::atomic<bool> dumpRequested{ false };
+    // the rest is only touched by the thread that ends frames
+    uint64_t lastFrameEnd = 0;
+    uint64_t lastTriggeredDump = 0;
+    unsigned dumps = 0;
+    unsigned triggeredDumps = 0;
+    static const unsigned maxTriggeredDumps = 20;
+
+    TraceBuffer& buffer()
+    {
+        thread_local TraceBuffer* local = nullptr;
+        if (!local)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            buffers.push_back(std::make_unique<TraceBuffer>(static_cast<uint32_t>(buffers.size() + 1)));
+            local = buffers.back().get();
+        }
+        return *local;
+    }
+
+    std::string numberedPath(unsigned n) const
+    {
+        size_t dot = outputPath.rfind('.');
+        if (dot == std::string::npos || outputPath.find('/', dot) != std::string::npos)
+            return outputPath + "-" + std::to_string(n);
+        return outputPath.substr(0, dot) + "-" + std::to_string(n) + outputPath.substr(dot);
+    }
+};
+
+class TraceZone
+{
+public:
+    explicit TraceZone(const char* name) : name(name), start(Tracer::instance().now()) {}
+    ~TraceZone() { end(); }
+
+    void end()
+    {
+        if (name)
+            Tracer::instance().zone(name, start, Tracer::instance().now());
+        name = nullptr;
+    }
+
+    TraceZone(const TraceZone&) = delete;
+    TraceZone& operator=(const TraceZone&) = delete;
+
+private:
+    const char* name;
+    uint64_t start;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(traceZone, __LINE__)(name)
+#define TRACE_ZONE_NAMED(var, name) TraceZone var(name)
+#define TRACE_ZONE_END(var) var.end()
+#define TRACE_COUNTER(name, value) Tracer::instance().counter(name, static_cast<double>(value))
+#define TRACE_FLOW_BEGIN(name, id) Tracer::instance().flow(name, static_cast<uint64_t>(id), true)
+#define TRACE_FLOW_END(name, id) Tracer::instance().flow(name, static_cast<uint64_t>(id), false)
+#define TRACE_THREAD(name) Tracer::instance().nameThread(name)
+#define TRACE_FRAME_END() Tracer::instance().frameEnd()
+#define TRACE_DUMP() Tracer::instance().requestDump()
+
+#else
+
+#define TRACE_ZONE(name) ((void)0)
+#define TRACE_ZONE_NAMED(var, name) ((void)0)
+#define TRACE_ZONE_END(var) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+#define TRACE_FLOW_BEGIN(name, id) ((void)0)
+#define TRACE_FLOW_END(name, id) ((void)0)
+#define TRACE_THREAD(name) ((void)0)
+#define TRACE_FRAME_END() ((void)0)
+#define TRACE_DUMP() ((void)0)
+
+#endif
+#endif
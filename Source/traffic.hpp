@@ -0,0 +1,166 @@
+#ifndef TRAFFIC_H
+#define TRAFFIC_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "job_system.hpp"
+#include "route.hpp"
+#include "scenery_stream.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// A lane parallel to the route: sideways offset from the route line (positive is right of the route's
+// direction) and whether traffic in it drives along the route (+1) or against it (-1).
+struct TrafficLane {
+    float offset;
+    float direction;
+};
+
+// Intelligent Driver Model parameters, in scenery units and seconds.
+struct TrafficConfig {
+    float maxAcceleration = 1.4f;
+    float comfortableBraking = 2.0f;
+    float minimumGap = 2.5f;        // standing still, bumper to bumper
+    float timeHeadway = 1.3f;       // seconds of distance kept at speed
+    float carLength = 4.5f;
+    float minDesiredSpeed = 10.0f;
+    float maxDesiredSpeed = 17.0f;
+};
+
+// Ambient traffic on closed lanes around the route, stored as columns. Every car follows the one ahead in its
+// lane with IDM acceleration. Nobody changes lanes or overtakes, so the order in a lane never changes and each
+// car's leader is fixed at reset. An update reads only the previous state and writes the next, so all cars
+// advance in parallel without locks.
+class TrafficSystem
+{
+public:
+    std::vector<float> position;       // along the lane in its direction of travel, [0, laneLength)
+    std::vector<float> speed;
+    std::vector<float> desiredSpeed;
+    std::vector<uint8_t> lane;
+    std::vector<uint8_t> model;        // which car model draws it
+    std::vector<uint32_t> leader;      // the next car ahead in the same lane, itself when alone
+
+    // spreads `count` cars over the lanes at random spacing, all at their desired speed
+    void reset(float newLaneLength, const std::vector<TrafficLane>& newLanes, int count, TrafficConfig newConfig = TrafficConfig(),
+               uint32_t seed = 1)
+    {
+        laneLength = newLaneLength;
+        lanes = newLanes;
+        config = newConfig;
+        size_t n = lanes.empty() ? 0 : static_cast<size_t>(std::max(count, 0));
+        for (auto* v : { &position, &speed, &desiredSpeed, &nextPosition, &nextSpeed })
+            v->assign(n, 0.0f);
+        lane.assign(n, 0);
+        model.assign(n, 0);
+        leader.assign(n, 0);
+
+        auto random = [&seed]() {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            return (seed & 0xffffff) / float(0x1000000);
+        };
+        size_t laneCount = lanes.size();
+        for (size_t l = 0; l < laneCount; l++)
+        {
+            // cars of this lane are i = l, l + laneCount, ... placed front to back with jittered spacing
+            size_t inLane = n / laneCount + (l < n % laneCount ? 1 : 0);
+            float spacing = inLane ? laneLength / inLane : laneLength;
+            for (size_t k = 0; k < inLane; k++)
+            {
+                size_t i = l + k * laneCount;
+                lane[i] = static_cast<uint8_t>(l);
+                model[i] = static_cast<uint8_t>(random() < 0.5f ? 0 : 1);
+                position[i] = std::fmod(k * spacing + random() * spacing * 0.3f, laneLength);
+                desiredSpeed[i] = config.minDesiredSpeed + random() * (config.maxDesiredSpeed - config.minDesiredSpeed);
+                speed[i] = desiredSpeed[i];
+                size_t ahead = k + 1 < inLane ? i + laneCount : l;
+                leader[i] = static_cast<uint32_t>(ahead);
+            }
+        }
+    }
+
+    void update(float dt, JobSystem* jobs = nullptr)
+    {
+        size_t n = count();
+        if (n == 0)
+            return;
+        auto step = [this, dt](size_t begin, size_t end) {
+            float a = config.maxAcceleration;
+            float brakeTerm = 2.0f * std::sqrt(config.maxAcceleration * config.comfortableBraking);
+            for (size_t i = begin; i < end; i++)
+            {
+                uint32_t j = leader[i];
+                float v = speed[i];
+                float gap = position[j] - position[i];
+                if (gap <= 0.0f)
+                    gap += laneLength;   // the leader is past the end of the loop, or this car is alone
+                gap = std::max(gap - config.carLength, 0.1f);
+                float approach = v - speed[j];
+                float desiredGap = config.minimumGap + std::max(0.0f, v * config.timeHeadway + v * approach / brakeTerm);
+                float ratio = v / desiredSpeed[i];
+                float acceleration = a * (1.0f - ratio * ratio * ratio * ratio - (desiredGap / gap) * (desiredGap / gap));
+                float v1 = std::max(0.0f, v + acceleration * dt);
+                float p = position[i] + (v + v1) * 0.5f * dt;
+                nextSpeed[i] = v1;
+                nextPosition[i] = p >= laneLength ? p - laneLength : p;
+            }
+        };
+        if (jobs)
+            jobs->parallelFor(n, 2048, step);
+        else
+            step(0, n);
+        position.swap(nextPosition);
+        speed.swap(nextSpeed);
+    }
+
+    size_t count() const { return position.size(); }
+    float length() const { return laneLength; }
+    const TrafficLane& laneOf(size_t i) const { return lanes[lane[i]]; }
+
+    // distance from station 0 along the route, in the same units as the lane
+    float routeDistance(size_t i) const
+    {
+        float d = lanes[lane[i]].direction > 0.0f ? position[i] : laneLength - position[i];
+        return d >= laneLength ? d - laneLength : d;
+    }
+
+    // a slowed car to start a jam, e.g. from the benchmark
+    void brake(size_t i, float factor) { speed[i] *= factor; }
+
+    // Cars from `behind` to `ahead` scenery units around busDistance (in route units, like the bus), as frames
+    // in scenery space: origin on the route line under the middle of the car, +z pointing where it drives.
+    void gatherNear(const Route& route, float busDistance, float worldScale, float behind, float ahead,
+                    std::vector<glm::mat4>& frames, std::vector<uint8_t>& models) const
+    {
+        frames.clear();
+        models.clear();
+        float center = busDistance * worldScale;
+        for (size_t i = 0; i < count(); i++)
+        {
+            float delta = routeDistance(i) - center;
+            delta -= laneLength * std::floor(delta / laneLength + 0.5f);   // the shorter way around the loop
+            if (delta < -behind || delta > ahead)
+                continue;
+            float along = routeDistance(i) / worldScale;
+            const TrafficLane& l = laneOf(i);
+            glm::vec2 t = route.tangentAt(along);
+            glm::vec3 position = sceneryPoint(route.positionAt(along), worldScale) + glm::vec3(t.y, 0.0f, t.x) * l.offset;
+            float yaw = std::atan2(t.x, -t.y) + (l.direction < 0.0f ? 3.14159265f : 0.0f);
+            frames.push_back(glm::rotate(glm::translate(glm::mat4(1.0f), position), yaw, glm::vec3(0.0f, 1.0f, 0.0f)));
+            models.push_back(model[i]);
+        }
+    }
+
+private:
+    float laneLength = 1.0f;
+    std::vector<TrafficLane> lanes;
+    TrafficConfig config;
+    std::vector<float> nextPosition, nextSpeed;
+};
+#endif
@@ -0,0 +1,110 @@
+#ifndef TRAFFIC_RENDERER_H
+#define TRAFFIC_RENDERER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "geometry_arena.hpp"
+#include "gl_handles.hpp"
+#include "memory_tracker.hpp"
+#include "model.hpp"
+#include "render_stats.hpp"
+#include "shader_variants.hpp"
+
+#include <vector>
+
+// Draws the traffic around the bus in two levels of detail, each with instancing: cars close to the eye as their
+// full arena model, one instanced submission per model and material batch, and the far ones as plain boxes in a
+// single call. The transforms are collected per frame with add() and go out with draw().
+class TrafficRenderer
+{
+public:
+    static const int MODELS = 2;
+
+    // the box is drawn from a 36 vertex unit cube in the 8 float layout of the scene geometry
+    TrafficRenderer(Model* models[MODELS], GLuint cubeBuffer) : models{ models[0], models[1] }
+    {
+        format.stride = sizeof(glm::mat4);
+        for (GLuint column = 0; column < 4; column++)
+            format.attributes.push_back({ 3 + column, 4, GL_FLOAT, column * sizeof(glm::vec4) });
+        for (auto& buffer : modelBuffers)
+            buffer = GLBuffer::create();
+        boxBuffer = GLBuffer::create();
+
+        boxVAO = GLVertexArray::create();
+        GLuint previous = boundVertexArray;
+        bindVertexArray(boxVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, cubeBuffer);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+        glBindBuffer(GL_ARRAY_BUFFER, boxBuffer);
+        for (const auto& a : format.attributes)
+        {
+            glEnableVertexAttribArray(a.location);
+            glVertexAttribPointer(a.location, a.size, a.type, GL_FALSE, format.stride, (void*)a.offset);
+            glVertexAttribDivisor(a.location, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        bindVertexArray(previous);
+    }
+
+    void clear()
+    {
+        for (auto& list : near)
+            list.clear();
+        far.clear();
+    }
+
+    void addModel(int model, const glm::mat4& transform) { near[model].push_back(transform); }
+    void addBox(const glm::mat4& transform) { far.push_back(transform); }
+
+    size_t modelInstances() const { return near[0].size() + near[1].size(); }
+    size_t boxInstances() const { return far.size(); }
+
+    void draw(ShaderVariants& shader, const glm::vec4& boxColor)
+    {
+        shader.setVec4("uAlbedo", glm::vec4(1.0f));
+        for (int m = 0; m < MODELS; m++)
+        {
+            GLuint count = static_cast<GLuint>(near[m].size());
+            if (count == 0 || !models[m]->arena)
+                continue;
+            upload(modelBuffers[m], near[m]);
+            models[m]->arena->attachInstances(modelBuffers[m], format);
+            models[m]->DrawInstanced(shader, FEATURE_INSTANCING, count);
+            models[m]->arena->detachInstances(format);
+        }
+        if (far.empty())
+            return;
+        upload(boxBuffer, far);
+        shader.setVec4("uAlbedo", boxColor);
+        shader.use(FEATURE_INSTANCING);
+        bindVertexArray(boxVAO);
+        drawArraysInstanced(GL_TRIANGLES, 0, 36, static_cast<GLsizei>(far.size()));
+    }
+
+private:
+    Model* models[MODELS];
+    VertexFormat format;
+    GLBuffer modelBuffers[MODELS];
+    GLBuffer boxBuffer;
+    GLVertexArray boxVAO;
+    std::vector<glm::mat4> near[MODELS];
+    std::vector<glm::mat4> far;
+
+    // orphaned and refilled every frame
+    static void upload(GLuint buffer, const std::vector<glm::mat4>& transforms)
+    {
+        size_t bytes = transforms.size() * sizeof(glm::mat4);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, transforms.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        memoryTracker.track(MemoryTracker::BUFFER, buffer, bytes, MemoryCategory::Streaming, "traffic");
+    }
+};
+#endif
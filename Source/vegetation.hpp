@@ -0,0 +1,80 @@
+#ifndef VEGETATION_H
+#define VEGETATION_H
+
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// One placement of the shared vegetation mesh.
+struct VegetationInstance {
+    glm::mat4 transform;
+    glm::vec3 tint;   // multiplies the albedo
+    float phase;      // of the wind sway, so neighbours do not move in step
+    float rank;       // uniform in [0, 1), decides at which density the instance drops out
+};
+
+// What the vertex shader reads per instance: attributes 3-6 (model), 7 (tint, fade) and 8 (phase).
+struct VegetationGpuInstance {
+    glm::mat4 model;
+    glm::vec4 tintFade;
+    float phase;
+};
+
+struct VegetationConfig {
+    float fullDensityDistance = 40.0f;   // every instance is drawn up to here
+    float cullDistance = 140.0f;         // and none past here
+    float farDensity = 0.2f;             // share still drawn just before cullDistance
+    float fadeWidth = 0.08f;             // of the rank, instances inside it dither out instead of popping
+};
+
+// Picks the instances worth drawing this frame and packs them for the instance buffer. Density falls with the
+// distance from the eye; an instance is kept while its rank is below the density there, and the ones close to
+// the cut fade (the fragment shader dithers them out), so thinning never pops. Pure CPU work.
+class VegetationSelection
+{
+public:
+    std::vector<VegetationGpuInstance> instances;
+
+    explicit VegetationSelection(VegetationConfig config = VegetationConfig()) : config(config) {}
+
+    // toWorld places the instance transforms, bounds are the mesh's in model space; visible() decides on the
+    // world space bounds of each instance (the camera frustum, portals)
+    template <typename Visible>
+    void add(const std::vector<VegetationInstance>& placements, const glm::mat4& toWorld, const BoundingSphere& bounds,
+             const glm::vec3& eye, Visible&& visible)
+    {
+        for (const VegetationInstance& p : placements)
+        {
+            glm::mat4 model = toWorld * p.transform;
+            glm::vec3 position(model[3]);
+            glm::vec3 d = position - eye;
+            float density = densityAt(std::sqrt(glm::dot(d, d)));
+            if (p.rank >= density)
+                continue;
+            if (!visible(transformSphere(bounds, model)))
+                continue;
+            float fade = std::min((density - p.rank) / config.fadeWidth, 1.0f);
+            instances.push_back({ model, glm::vec4(p.tint, fade), p.phase });
+        }
+    }
+
+    void clear() { instances.clear(); }
+
+    float densityAt(float distance) const
+    {
+        if (distance <= config.fullDensityDistance)
+            return 1.0f;
+        if (distance >= config.cullDistance)
+            return 0.0f;
+        float t = (distance - config.fullDensityDistance) / (config.cullDistance - config.fullDensityDistance);
+        return 1.0f + (config.farDensity - 1.0f) * t;
+    }
+
+private:
+    VegetationConfig config;
+};
+#endif
@@ -0,0 +1,55 @@
+#ifndef VEGETATION_RENDERER_H
+#define VEGETATION_RENDERER_H
+
+#include <GL/glew.h>
+
+#include "geometry_arena.hpp"
+#include "gl_handles.hpp"
+#include "memory_tracker.hpp"
+#include "model.hpp"
+#include "shader_variants.hpp"
+#include "vegetation.hpp"
+
+#include <cstddef>
+
+// Draws every selected instance of one arena model (mesh and textures shared) with a single instanced
+// submission per material batch, however many instances there are. The instance buffer is orphaned and
+// refilled every frame.
+class VegetationRenderer
+{
+public:
+    explicit VegetationRenderer(Model& model) : model(model)
+    {
+        buffer = GLBuffer::create();
+        format.stride = sizeof(VegetationGpuInstance);
+        for (GLuint column = 0; column < 4; column++)
+            format.attributes.push_back({ 3 + column, 4, GL_FLOAT, offsetof(VegetationGpuInstance, model) + column * sizeof(glm::vec4) });
+        format.attributes.push_back({ 7, 4, GL_FLOAT, offsetof(VegetationGpuInstance, tintFade) });
+        format.attributes.push_back({ 8, 1, GL_FLOAT, offsetof(VegetationGpuInstance, phase) });
+    }
+
+    void draw(ShaderVariants& shader, const VegetationSelection& selection)
+    {
+        GLuint count = static_cast<GLuint>(selection.instances.size());
+        if (count == 0 || !model.arena)
+            return;
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        size_t bytes = count * sizeof(VegetationGpuInstance);
+        glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, selection.instances.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        memoryTracker.track(MemoryTracker::BUFFER, buffer, bytes, MemoryCategory::Streaming, "vegetation");
+
+        // wind sway grows with height above the root, measured in model units
+        shader.setFloat("uWindHeightScale", 1.0f / std::max(model.bounds.center.y + model.bounds.radius, 1e-3f));
+        model.arena->attachInstances(buffer, format);
+        model.DrawInstanced(shader, FEATURE_INSTANCING | FEATURE_VEGETATION, count);
+        model.arena->detachInstances(format);
+    }
+
+private:
+    Model& model;
+    GLBuffer buffer;
+    VertexFormat format;
+};
+#endif